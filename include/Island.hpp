@@ -0,0 +1,277 @@
+#pragma once
+
+
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Sim/PetriDish.hpp"
+#include "Sim/Archipelago.hpp"
+#include "Sim/Mirror.hpp"
+#include "Sim/Stream.hpp"
+#include "Sim/Exporter.hpp"
+#include "Sim/StatsLog.hpp"
+#include "Sim/Lineage.hpp"
+#include "Sim/Checkpoint.hpp"
+#include "utils/Vec.hpp"
+#include "utils/Hash.hpp"
+#include "utils/Cpu.hpp"
+
+
+namespace island {
+    using DishParams = petridish::DishParams;
+    using Archipelago = archipelago::Archipelago;
+    using MigrationParams = archipelago::MigrationParams;
+
+
+    class IslandParams {
+        public:
+            std::string name = "warms_islands";
+
+            // Shared memory name the dish board is published under, if any
+            std::string publish;
+
+            // Socket address the dish board is streamed on, if any
+            std::string stream;
+
+            // Frames are exported when export_frames is set
+            bool export_frames = false;
+            exporter::ExportParams frames;
+
+            // Snapshots are logged when stats.path is set
+            statslog::StatsParams stats;
+
+            // Genome births are logged when lineage.path is set
+            lineage::LineageParams lineage;
+
+            // The dish is checkpointed when checkpoints is set
+            bool checkpoints = false;
+            checkpoint::CheckpointParams checkpoint;
+
+            unsigned islands = 2;
+            unsigned id = 0;
+            uint64_t seed = 1029384756;
+            UVec2 size = UVec2(256u, 256u);
+            geometry::Layout layout = geometry::Layout::Rows;
+            petridish::MemoryParams memory;
+            petridish::EventParams events;
+            uint64_t generations = 100000;
+            MigrationParams migration;
+
+            // Kernels to run, the widest the cpu has unless overridden
+            cpu::Isa isa = cpu::detect();
+
+            /**
+            * @brief Parse the island command line.
+            *
+            *   --name exp1 --islands 4 --id 2 --seed 7 --size 256x256 --layout rows|tiled
+            *   --generations 100000 --topology ring|torus|random
+            *   --interval 256 --migrants 1 --capacity 8 --publish board0
+            *   --stream tcp:7000 --export target/frames --export-every 100
+            *   --export-format png|ppm --export-block 2
+            *   --stats stats.jsonl --stats-every 1 --stats-heatmaps on|off
+            *   --huge-pages off|thp|explicit --pin 3
+            *   --food-regrowth 50 --wall-lifetime 5000 --max-period 4
+            *   --lineage lineage.bin --isa auto|scalar|sse2|avx2|avx512
+            *   --checkpoint target/checkpoints --checkpoint-every 10000
+            *   --checkpoint-keep 3 --checkpoint-keep-every 10
+            * Every process of the experiment must use the same name, island
+            *  count and capacity, and its own id.
+            */
+            static IslandParams from_args (const int argc, char** argv) {
+                IslandParams params;
+
+                for (int i = 0; i < argc; i++) {
+                    const std::string flag = argv[i];
+                    if (argc <= i + 1) throw std::invalid_argument("Missing value for " + flag);
+                    const std::string value = argv[++i];
+
+                    if ("--name" == flag) {
+                        params.name = value;
+                    } else if ("--islands" == flag) {
+                        params.islands = static_cast<unsigned>(std::stoul(value));
+                    } else if ("--id" == flag) {
+                        params.id = static_cast<unsigned>(std::stoul(value));
+                    } else if ("--seed" == flag) {
+                        params.seed = std::stoull(value);
+                    } else if ("--size" == flag) {
+                        size_t x = value.find('x');
+                        if (std::string::npos == x) throw std::invalid_argument("Bad size " + value);
+                        params.size = UVec2(
+                            static_cast<unsigned>(std::stoul(value.substr(0, x))),
+                            static_cast<unsigned>(std::stoul(value.substr(x + 1)))
+                        );
+                    } else if ("--layout" == flag) {
+                        params.layout = geometry::parse_layout(value);
+                    } else if ("--huge-pages" == flag) {
+                        params.memory.huge_pages = arena::parse_huge_pages(value);
+                    } else if ("--pin" == flag) {
+                        params.memory.cpu = std::stoi(value);
+                    } else if ("--food-regrowth" == flag) {
+                        params.events.food_regrowth = std::stoull(value);
+                    } else if ("--wall-lifetime" == flag) {
+                        params.events.wall_lifetime = std::stoull(value);
+                    } else if ("--max-period" == flag) {
+                        params.events.max_period = static_cast<unsigned>(std::stoul(value));
+                    } else if ("--generations" == flag) {
+                        params.generations = std::stoull(value);
+                    } else if ("--topology" == flag) {
+                        params.migration.topology = MigrationParams::parse_topology(value);
+                    } else if ("--interval" == flag) {
+                        params.migration.interval = std::stoull(value);
+                    } else if ("--migrants" == flag) {
+                        params.migration.migrants = static_cast<unsigned>(std::stoul(value));
+                    } else if ("--publish" == flag) {
+                        params.publish = value;
+                    } else if ("--stream" == flag) {
+                        params.stream = value;
+                    } else if ("--export" == flag) {
+                        params.export_frames = true;
+                        params.frames.directory = value;
+                    } else if ("--export-every" == flag) {
+                        params.frames.every = std::stoull(value);
+                    } else if ("--export-format" == flag) {
+                        params.frames.format = exporter::ExportParams::parse_format(value);
+                    } else if ("--export-block" == flag) {
+                        params.frames.block = std::max(1u, static_cast<unsigned>(std::stoul(value)));
+                    } else if ("--stats" == flag) {
+                        params.stats.path = value;
+                    } else if ("--stats-every" == flag) {
+                        params.stats.every = std::stoull(value);
+                    } else if ("--stats-heatmaps" == flag) {
+                        params.stats.heatmaps = ("off" != value && "0" != value);
+                    } else if ("--lineage" == flag) {
+                        params.lineage.path = value;
+                    } else if ("--checkpoint" == flag) {
+                        params.checkpoint.directory = value;
+                        params.checkpoints = true;
+                    } else if ("--checkpoint-every" == flag) {
+                        params.checkpoint.every = std::stoull(value);
+                    } else if ("--checkpoint-keep" == flag) {
+                        params.checkpoint.keep_last = static_cast<unsigned>(std::stoul(value));
+                    } else if ("--checkpoint-keep-every" == flag) {
+                        params.checkpoint.keep_every = static_cast<unsigned>(std::stoul(value));
+                    } else if ("--isa" == flag) {
+                        params.isa = cpu::parse_isa(value);
+                    } else if ("--capacity" == flag) {
+                        params.migration.capacity = std::max(1u, static_cast<unsigned>(std::stoul(value)));
+                    } else {
+                        throw std::invalid_argument("Unknown island option " + flag);
+                    }
+                }
+
+                if (params.id >= params.islands) throw std::invalid_argument("Island id out of range");
+                params.checkpoint.prefix = "island" + std::to_string(params.id);
+                return params;
+            }
+    };
+
+
+    // One headless dish of an experiment spread over several processes,
+    //  trading genomes with the others through shared memory
+    class Island {
+        public:
+            Island (const IslandParams island_params) : params(island_params) {}
+            ~Island () {}
+
+            int run () {
+                cpu::use(params.isa);
+
+                Archipelago islands = Archipelago::shared(
+                    params.name,
+                    params.islands,
+                    population::Population::topology().weight_count(),
+                    params.migration,
+                    hash::combine(params.seed, params.id)
+                );
+
+                return geometry::dispatch(params.size, params.layout, [&](auto geometry) {
+                    return run_on<decltype(geometry)>(islands);
+                });
+            }
+
+        private:
+            IslandParams params;
+
+            template <typename G>
+            int run_on (Archipelago& islands) {
+                DishParams dish_params;
+                dish_params.memory = params.memory;
+                dish_params.events = params.events;
+                dish_params.evolution.lineage = !params.lineage.path.empty();
+
+                // Opened first, so genome ids carry on from an existing log
+                lineage::LineageLog lineage_log;
+                if (!params.lineage.path.empty()) lineage_log = lineage::LineageLog(params.lineage);
+                dish_params.evolution.first_genome = lineage_log.get_next_genome();
+
+                petridish::BasicPetriDish<G> dish (hash::combine(params.seed, params.id), params.size, dish_params);
+
+                mirror::BoardPublisher publisher;
+                if (!params.publish.empty()) publisher = mirror::BoardPublisher(params.publish, params.size);
+
+                stream::StreamServer server;
+                if (!params.stream.empty()) server = stream::StreamServer(params.stream);
+
+                exporter::FrameExporter frame_exporter;
+                if (params.export_frames) frame_exporter = exporter::FrameExporter(params.frames);
+
+                statslog::StatsLog stats_log;
+                if (!params.stats.path.empty()) stats_log = statslog::StatsLog(params.stats);
+
+                std::vector<evolution::Birth> births;
+
+                checkpoint::Checkpointer checkpointer;
+                if (params.checkpoints) checkpointer = checkpoint::Checkpointer(params.checkpoint);
+
+                sim::SimStatus status;
+                status.printing = false;
+                timer::Timer timer;
+
+                for (uint64_t g = 1; g <= params.generations; g++) {
+                    timer.start_measurement();
+                    dish.foward();
+                    timer.end_measurement();
+
+                    if (publisher.is_due()) publisher.publish(dish.get_board(), timer, status, g);
+                    server.update(dish.get_board(), timer, status, g);
+                    frame_exporter.capture(dish.get_board(), g);
+                    if (stats_log.is_due(g)) stats_log.write(dish.get_stats(params.stats.heatmaps));
+
+                    if (lineage_log.is_valid()) {
+                        dish.take_births(births);
+                        lineage_log.record(births);
+                    }
+
+                    if (checkpointer.is_due(g)) {
+                        checkpointer.capture(g, [&](checkpoint::Writer& out) {
+                            checkpoint::save_header(out, g, 1);
+                            checkpoint::save_dish(out, dish);
+                        });
+                    }
+
+                    if (!islands.is_due(g)) continue;
+
+                    islands.migrate(params.id, dish.get_population());
+                    dish.adopt(islands.get_replaced());
+                    std::cout << "[island " << params.id << "] generation " << g
+                        << ", " << dish.get_population().size() << " organisms"
+                        << ", best fitness " << dish.get_evolution().get_best_fitness()
+                        << ", " << islands.get_immigrant_count() << " immigrants" << std::endl;
+                }
+
+                stats_log.flush();
+
+                if (checkpointer.is_valid()) {
+                    const checkpoint::Report r = checkpointer.finish();
+                    std::cout << "[island " << params.id << "] " << r.written << " checkpoints"
+                        << " (" << r.skipped << " skipped, " << r.failed << " failed), "
+                        << r.bytes / 1e6 << " MB at " << r.bandwidth() / 1e6 << " MB/s"
+                        << ", longest pause " << r.max_pause * 1e3 << " ms" << std::endl;
+                }
+
+                return 0;
+            }
+    };
+}
@@ -4,32 +4,118 @@
 #include <random>
 #include <vector>
 #include <sstream>
+#include <chrono>
+#include <algorithm>
 
 #include "Sim/sim_types.hpp"
 #include "Sim/PetriDish.hpp"
+#include "Sim/Archipelago.hpp"
+#include "Sim/Mirror.hpp"
+#include "Sim/Stream.hpp"
+#include "Sim/Exporter.hpp"
+#include "Sim/Checkpoint.hpp"
 #include "Sim/Printer.hpp"
 #include "Sim/Board.hpp"
 #include "utils/Term.hpp"
 // #include "utils/TermPlus.hpp"
 #include "utils/Timer.hpp"
+#include "utils/InputWatcher.hpp"
 
 
 namespace sim {
     using Term = term::Term;
     using PetriDish = petridish::PetriDish;
+    using Archipelago = archipelago::Archipelago;
+    using MigrationParams = archipelago::MigrationParams;
+
+
+    class PowersaveParams {
+        public:
+            // Turns between two steps of each background dish
+            unsigned period = POWERSAVE_PERIOD;
+
+            // When above zero, background dishes instead share this many
+            //  seconds per turn, round robin
+            double slice = 0.0;
+
+            unsigned workers = POWERSAVE_WORKERS;
+
+            // Turns background dishes get per second
+            double target_fps = POWERSAVE_FPS;
+    };
 
 
     class Sim {
         public:
-            Sim (uint64_t seed) : rng_gen(seed), term(Term::instance()) {
+            Sim (uint64_t seed) : Sim(seed, 1, MigrationParams()) {}
+
+            // Several dishes evolving as islands, exchanging their fittest
+            //  genomes every migration interval
+            Sim (uint64_t seed, const unsigned dish_count, const MigrationParams migration)
+                : rng_gen(seed), term(Term::instance()), watcher(input::InputWatcher::instance())
+            {
                 petri_dishes.push_back( PetriDish(seed) );
+                for (unsigned i = 1; i < dish_count; i++) petri_dishes.push_back( PetriDish(rng_gen()) );
+
+                if (1 < dish_count) {
+                    islands = Archipelago(
+                        dish_count,
+                        population::Population::topology().weight_count(),
+                        migration,
+                        rng_gen()
+                    );
+                }
             }
             
             ~Sim () {}
 
+            // Publishes the main board for viewers in other processes
+            void publish (const std::string& name) {
+                publisher = mirror::BoardPublisher(name, petri_dishes[0].get_board().get_dimensions());
+            }
+
+            // Streams the main board to clients of a local socket
+            void stream (const std::string& address) {
+                server = stream::StreamServer(address);
+            }
+
+            // Writes the main board as images every few generations
+            void export_frames (const exporter::ExportParams params) {
+                frame_exporter = exporter::FrameExporter(params);
+            }
+
+            // Saves every dish in the background every few generations
+            void checkpoint (const checkpoint::CheckpointParams params) {
+                checkpointer = checkpoint::Checkpointer(params);
+            }
+
+            void configure_powersave (const PowersaveParams params) {powersave = params;}
+
+            // Background dishes slow down and most workers sleep, without
+            //  stopping anything
+            void set_powersave (const bool on) {
+                status.powersave = on;
+
+                pool::ThreadPool& pool = pool::ThreadPool::instance();
+                pool.set_active(on ? powersave.workers : pool.get_size());
+            }
+
+            // Reads keys only when the watcher saw some, so a frame without
+            //  input costs no syscall
             void process_input () {
-                int input = term.input();
+                if (watcher.take_resize()) {
+                    term.resize();
+                    board_printer.invalidate();
+                }
+
+                if (!watcher.has_input()) return;
 
+                int input;
+                while (ERR != (input = term.input())) handle_key(input);
+                watcher.consumed();
+            }
+
+            void handle_key (const int input) {
                 switch (input) {
                     case 'q': // Quit
                         status.running = false; 
@@ -46,6 +132,10 @@ namespace sim {
                     case 'k': // Printing off
                         status.printing = !(status.printing);
                         break;
+
+                    case 's': // Powersave
+                        set_powersave(!status.powersave);
+                        break;
                 }
             }
 
@@ -64,35 +154,119 @@ namespace sim {
 
                     // Simulation
                     if (!status.paused) {
+                        generation += 1;
+
                         if (status.powersave) {
-                            petri_dishes[0].foward();
+                            step_powersave();
                         } else {
                             for (PetriDish& dish : petri_dishes) {
                                 dish.foward();
                             }
                         }
+
+                        if (islands.is_due(generation)) migrate();
+                        if (checkpointer.is_due(generation)) save_checkpoint();
+
+                        frame_exporter.capture(main_board, generation);
                     }
 
+                    // Paused or not, so clients connect and drain meanwhile
+                    server.update(main_board, timer, status, generation);
+
                     // Printing
+                    // The counts only change with the generation, and the
+                    //  printer shows no heatmap
+                    if (status.printing && shown_stats != generation) {
+                        board_printer.set_stats(petri_dishes[0].get_stats(false));
+                        shown_stats = generation;
+                    }
                     board_printer.print(main_board, timer, status, generation);
+                    publisher.publish(main_board, timer, status, generation);
+                    term.refresh();
 
                     // End measurement and sync
                     timer.end_measurement();
-                    if (status.syncing) timer.sync(target_delta_time);
+
+                    // A paused sim sleeps until a key or resize comes, waking
+                    //  up now and then to serve viewers and clients
+                    if (status.paused && status.running) watcher.wait_for(PAUSED_WAKEUP);
+                    else if (status.syncing) timer.sync(target_delta_time);
                 }
             }
 
         private:
             unsigned generation = 0;
+            unsigned shown_stats = ~0u;
             double target_fps = 4.0;
             double target_delta_time = 1.0 / 4.0;
 
             SimStatus status;
+            PowersaveParams powersave;
+            size_t next_background = 0;
+            uint64_t background_turns = 0;
+            std::chrono::steady_clock::time_point next_turn;
 
             std::mt19937_64 rng_gen;
 
             Term& term;
+            input::InputWatcher& watcher;
             std::vector<PetriDish> petri_dishes;
+            Archipelago islands;
             printer::Printer board_printer;
+            mirror::BoardPublisher publisher;
+            stream::StreamServer server;
+            exporter::FrameExporter frame_exporter;
+            checkpoint::Checkpointer checkpointer;
+
+            // The watched dish steps every frame. The others only get a turn
+            //  powersave.target_fps times a second, and on each turn step by
+            //  period or by sharing a time slice.
+            void step_powersave () {
+                petri_dishes[0].foward();
+
+                const size_t background = petri_dishes.size() - 1;
+                if (0 == background) return;
+
+                const auto now = std::chrono::steady_clock::now();
+                if (now < next_turn) return;
+                next_turn = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(1.0 / std::max(1e-3, powersave.target_fps))
+                );
+                background_turns += 1;
+
+                if (0.0 >= powersave.slice) {
+                    const unsigned period = std::max(1u, powersave.period);
+                    for (size_t i = 1; i < petri_dishes.size(); i++) {
+                        if (0 == (background_turns + i) % period) petri_dishes[i].foward();
+                    }
+                    return;
+                }
+
+                const auto deadline = now
+                    + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>(powersave.slice)
+                    );
+
+                for (size_t k = 0; k < background; k++) {
+                    petri_dishes[1 + next_background].foward();
+                    next_background = (next_background + 1) % background;
+                    if (std::chrono::steady_clock::now() >= deadline) break;
+                }
+            }
+
+            // Every dish as of this generation, written by a forked process
+            void save_checkpoint () {
+                checkpointer.capture(generation, [this](checkpoint::Writer& out) {
+                    checkpoint::save_header(out, generation, static_cast<uint32_t>(petri_dishes.size()));
+                    for (PetriDish& dish : petri_dishes) checkpoint::save_dish(out, dish);
+                });
+            }
+
+            void migrate () {
+                for (unsigned i = 0; i < petri_dishes.size(); i++) {
+                    islands.migrate(i, petri_dishes[i].get_population());
+                    petri_dishes[i].adopt(islands.get_replaced());
+                }
+            }
     };
 }
\ No newline at end of file
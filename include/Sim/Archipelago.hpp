@@ -0,0 +1,356 @@
+#pragma once
+
+
+#include <vector>
+#include <string>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Sim/sim_constants.hpp"
+#include "Sim/Population.hpp"
+#include "utils/SpscRing.hpp"
+#include "utils/SharedMemory.hpp"
+
+
+namespace archipelago {
+    using Population = population::Population;
+    using SpscRing = spsc::SpscRing;
+
+    // Which islands each island sends its migrants to
+    enum class Topology : uint8_t {
+        Ring = 0,   // The next island, wrapping around
+        Torus = 1,  // The four neighbours on a wrapping grid of islands
+        Random = 2  // One other island, drawn at every migration
+    };
+
+    class MigrationParams {
+        public:
+            Topology topology = Topology::Ring;
+
+            // Generations between migrations, 0 turns migration off
+            uint64_t interval = sim::MIGRATION_INTERVAL;
+
+            // Fittest genomes sent to each destination per migration
+            unsigned migrants = 1;
+
+            uint32_t capacity = sim::MIGRATION_CAPACITY;
+
+            static Topology parse_topology (const std::string& name) {
+                if ("ring" == name) return Topology::Ring;
+                if ("torus" == name) return Topology::Torus;
+                if ("random" == name) return Topology::Random;
+                throw std::invalid_argument("Unknown migration topology " + name);
+            }
+    };
+
+
+    // Islands exchanging genomes through one lock-free queue per ordered
+    //  pair of islands. The queues live either on the heap, for dishes of
+    //  the same process, or in a POSIX shared memory segment, for dishes of
+    //  separate processes. Each queue has one producer and one consumer, so
+    //  a full queue just drops the migrant and nobody ever waits.
+    class Archipelago {
+        public:
+            Archipelago () {}
+
+            // Islands of a single process
+            Archipelago (
+                const unsigned island_count,
+                const size_t genome_size,
+                const MigrationParams migration_params,
+                const uint64_t seed
+            ) :
+                params(migration_params),
+                islands(island_count),
+                genome(static_cast<uint32_t>(genome_size)),
+                rng_gen(seed)
+            {
+                bytes = segment_bytes();
+                memory = static_cast<uint8_t*>(std::aligned_alloc(64, bytes));
+                if (nullptr == memory) throw std::bad_alloc();
+
+                build(true);
+            }
+
+            /**
+            * @brief Islands shared between processes under a name.
+            *
+            * The first process to open the name creates the segment, and
+            *  every other process attaches to it and must agree on the island
+            *  count and genome size. The segment counts the processes using
+            *  it, and the last one to leave unlinks it.
+            */
+            static Archipelago shared (
+                const std::string& name,
+                const unsigned island_count,
+                const size_t genome_size,
+                const MigrationParams migration_params,
+                const uint64_t seed
+            ) {
+                Archipelago a;
+                a.params = migration_params;
+                a.islands = island_count;
+                a.genome = static_cast<uint32_t>(genome_size);
+                a.rng_gen.seed(seed);
+                a.bytes = a.segment_bytes();
+                a.segment = shm::SharedMemory::create_or_attach(name, a.bytes);
+
+                a.memory = a.segment.data();
+                a.build(a.segment.is_owner());
+                return a;
+            }
+
+            Archipelago (const Archipelago&) = delete;
+            Archipelago& operator= (const Archipelago&) = delete;
+
+            Archipelago (Archipelago&& other) noexcept {*this = std::move(other);}
+
+            Archipelago& operator= (Archipelago&& other) noexcept {
+                if (this == &other) return *this;
+                release();
+
+                params = other.params;
+                islands = other.islands;
+                genome = other.genome;
+                rng_gen = other.rng_gen;
+                segment = std::move(other.segment);
+                memory = other.memory;
+                bytes = other.bytes;
+                joined = other.joined;
+                rings = std::move(other.rings);
+                record = std::move(other.record);
+                immigrants = other.immigrants;
+
+                other.memory = nullptr;
+                other.joined = false;
+                other.rings.clear();
+                return *this;
+            }
+
+            ~Archipelago () {release();}
+
+            bool is_due (const uint64_t generation) const {
+                return 0 != params.interval && 1 < islands && 0 == generation % params.interval;
+            }
+
+            // Islands the given island sends its migrants to
+            std::vector<unsigned> destinations (const unsigned island) {
+                std::vector<unsigned> out;
+                if (2 > islands) return out;
+
+                switch (params.topology) {
+                    case Topology::Ring:
+                        out.push_back((island + 1) % islands);
+                        break;
+
+                    case Topology::Torus: {
+                        const unsigned cols = static_cast<unsigned>(std::ceil(std::sqrt(static_cast<double>(islands))));
+                        const unsigned rows = (islands + cols - 1) / cols;
+                        const unsigned r = island / cols;
+                        const unsigned c = island % cols;
+
+                        const unsigned around[4] = {
+                            r * cols + (c + 1) % cols,
+                            r * cols + (c + cols - 1) % cols,
+                            ((r + 1) % rows) * cols + c,
+                            ((r + rows - 1) % rows) * cols + c
+                        };
+
+                        // The last row may be short
+                        for (const unsigned other : around) {
+                            if (other >= islands || other == island) continue;
+                            if (out.end() == std::find(out.begin(), out.end(), other)) out.push_back(other);
+                        }
+                        break;
+                    }
+
+                    case Topology::Random: {
+                        std::uniform_int_distribution<unsigned> pick (0, islands - 2);
+                        const unsigned other = pick(rng_gen);
+                        out.push_back(other < island ? other : other + 1);
+                        break;
+                    }
+                }
+
+                return out;
+            }
+
+            // False when the queue towards the destination is full
+            bool send (const unsigned from, const unsigned to, const float* weights, const float fitness) {
+                record[0] = fitness;
+                std::memcpy(&record[1], weights, genome * sizeof(float));
+                return ring(from, to).push(record.data());
+            }
+
+            // False when no migrant from that island is waiting
+            bool receive (const unsigned to, const unsigned from, float* weights, float& fitness) {
+                if (!ring(from, to).pop(record.data())) return false;
+                fitness = record[0];
+                std::memcpy(weights, &record[1], genome * sizeof(float));
+                return true;
+            }
+
+            /**
+            * @brief Exchange genomes between an island and the rest.
+            *
+            * The fittest species of the island are sent to its destinations,
+            *  then migrants waiting for it overwrite its weakest species. The
+            *  fittest species is never overwritten.
+            */
+            void migrate (const unsigned island, Population& population) {
+                brain::Brain& brain = population.get_brain();
+                const std::vector<float>& fitness = population.get_fitness();
+                const size_t n = brain.get_species_count();
+                replaced_species.clear();
+                if (0 == n || brain.get_topology().weight_count() != genome) return;
+
+                auto fitness_of = [&](const size_t s) {return s < fitness.size() ? fitness[s] : 0.0f;};
+
+                ranking.resize(n);
+                for (size_t i = 0; i < n; i++) ranking[i] = static_cast<uint32_t>(i);
+                std::sort(ranking.begin(), ranking.end(), [&](uint32_t a, uint32_t b) {
+                    return fitness_of(a) > fitness_of(b);
+                });
+
+                const brain::Brain& parents = brain;
+                for (const unsigned to : destinations(island)) {
+                    for (size_t m = 0; m < std::min<size_t>(params.migrants, n); m++) {
+                        send(island, to, parents.get_weights(ranking[m]), fitness_of(ranking[m]));
+                    }
+                }
+
+                // Drains every queue, so old migrants never pile up
+                size_t replaced = 0;
+                float migrant_fitness;
+                for (unsigned from = 0; from < islands; from++) {
+                    if (from == island) continue;
+
+                    while (receive(island, from, incoming(), migrant_fitness)) {
+                        if (replaced + 1 >= n) continue;
+                        std::memcpy(brain.get_weights(ranking[n - 1 - replaced]), incoming(), genome * sizeof(float));
+                        replaced_species.push_back(ranking[n - 1 - replaced]);
+                        replaced += 1;
+                    }
+                }
+
+                immigrants += replaced;
+            }
+
+            unsigned get_island_count () const {return islands;}
+            uint64_t get_interval () const {return params.interval;}
+            uint64_t get_immigrant_count () const {return immigrants;}
+
+            // Species overwritten by the last migration
+            const std::vector<uint32_t>& get_replaced () const {return replaced_species;}
+            bool is_shared () const {return segment.is_valid();}
+
+        private:
+            static constexpr uint64_t MAGIC = 0x32534c5349415257ull; // "WARISLS2"
+
+            // How long a process waits for the creator to build the segment
+            static constexpr unsigned BUILD_TIMEOUT_MS = 5000;
+
+            struct Segment {
+                alignas(64) std::atomic<uint64_t> magic {0};
+                std::atomic<uint32_t> peers {0};
+                uint32_t islands = 0;
+                uint32_t genome = 0;
+                uint32_t capacity = 0;
+            };
+
+            MigrationParams params;
+            unsigned islands = 0;
+            uint32_t genome = 0;
+            std::mt19937_64 rng_gen;
+
+            shm::SharedMemory segment;
+            uint8_t* memory = nullptr;
+            size_t bytes = 0;
+            // Counted among the peers of the segment
+            bool joined = false;
+
+            std::vector<SpscRing> rings;
+            uint64_t immigrants = 0;
+            std::vector<uint32_t> replaced_species;
+
+            // Scratch reused every migration
+            std::vector<float> record;
+            std::vector<uint32_t> ranking;
+
+            uint32_t record_bytes () const {return (genome + 1) * sizeof(float);}
+
+            size_t ring_bytes () const {return SpscRing::bytes_needed(params.capacity, record_bytes());}
+
+            size_t segment_bytes () const {
+                return sizeof(Segment) + static_cast<size_t>(islands) * islands * ring_bytes();
+            }
+
+            SpscRing& ring (const unsigned from, const unsigned to) {return rings[from * islands + to];}
+
+            // The genome part of the scratch record
+            float* incoming () {return &record[1];}
+
+            void build (const bool initialize) {
+                Segment* header = reinterpret_cast<Segment*>(memory);
+
+                if (initialize) {
+                    new (header) Segment();
+                    header->islands = islands;
+                    header->genome = genome;
+                    header->capacity = params.capacity;
+                    header->peers.store(1, std::memory_order_relaxed);
+                    joined = true;
+                } else {
+                    // Attached to a segment someone else is still building,
+                    //  unless they died before finishing it
+                    unsigned waited = 0;
+                    while (MAGIC != header->magic.load(std::memory_order_acquire)) {
+                        if (BUILD_TIMEOUT_MS <= waited++) {
+                            throw std::runtime_error("Shared memory " + segment.get_name() + " was never built, remove it and retry");
+                        }
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+
+                    if (header->islands != islands || header->genome != genome || header->capacity != params.capacity) {
+                        throw std::runtime_error("Shared memory " + segment.get_name() + " belongs to another experiment");
+                    }
+                    header->peers.fetch_add(1, std::memory_order_acq_rel);
+                    joined = true;
+                }
+
+                // The peer count decides who unlinks, not who created it
+                if (segment.is_valid()) segment.disown();
+
+                rings.resize(static_cast<size_t>(islands) * islands);
+                for (size_t i = 0; i < rings.size(); i++) {
+                    uint8_t* at = memory + sizeof(Segment) + i * ring_bytes();
+                    rings[i] = SpscRing(at, initialize, params.capacity, record_bytes());
+                }
+                record.resize(genome + 1);
+
+                if (initialize) header->magic.store(MAGIC, std::memory_order_release);
+            }
+
+            void release () {
+                if (nullptr == memory) return;
+
+                if (segment.is_valid()) {
+                    Segment* header = reinterpret_cast<Segment*>(memory);
+                    if (joined && 1 == header->peers.fetch_sub(1, std::memory_order_acq_rel)) segment.remove();
+                    segment = shm::SharedMemory();
+                } else {
+                    std::free(memory);
+                }
+
+                memory = nullptr;
+                joined = false;
+            }
+    };
+}
@@ -2,113 +2,654 @@
 
 
 #include <vector>
+#include <random>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <cassert>
+#include <cmath>
 
 #include "Sim/sim_constants.hpp"
 #include "Sim/Board/Cell.hpp"
+#include "Sim/Board/Region.hpp"
+#include "Sim/Board/Stats.hpp"
+#include "Sim/Board/BitPlanes.hpp"
+#include "Sim/Board/SpatialIndex.hpp"
+#include "Sim/Board/Geometry.hpp"
 #include "utils/Vec.hpp"
+#include "utils/Hash.hpp"
+#include "utils/Option.hpp"
+#include "utils/Arena.hpp"
 
 
 namespace board {
     using Cell = cell::Cell;
-    using cell_vector = std::vector<Cell>;
-    using cell_matrix = std::vector<cell_vector>;
+    using CellType = cell::CellType;
+    using Region = region::Region;
+    using cell_vector = std::vector<Cell, arena::ArenaAllocator<Cell>>;
+    using DynamicGeometry = geometry::DynamicGeometry;
+    using BoardStats = stats::BoardStats;
+    using Snapshot = stats::Snapshot;
+    using BitPlanes = bitplane::BitPlanes;
+    using SpatialIndex = spatial::SpatialIndex;
+    using Hit = spatial::Hit;
 
-    class Board {
+    class BoardParams {
         public:
-            Board () {}
+            // Expected amount of food spawned per generation on the whole board
+            double food_rate = sim::FOOD_SPAWN_RATE;
 
-            Board (const UVec2 board_dimensions, const uint64_t seed) : 
-                dimensions(board_dimensions),
-                length(board_dimensions.x() * board_dimensions.y()),
-                rng_gen(seed)
+            // Random cells tried before a food spawn is given up
+            uint8_t max_atempts = sim::MAX_ATEMPTS;
+    };
+
+    // The cell grid of a dish. The geometry decides how positions wrap and
+    //  map to storage: Board sizes itself at runtime, while BasicBoard over
+    //  a geometry::StaticGeometry resolves all of it at compile time.
+    template <typename G>
+    class BasicBoard {
+        public:
+            using Geometry = G;
+
+            // An empty board, sized when the geometry is static. It is
+            //  meant to be assigned a real board.
+            BasicBoard () : cells(geometry.storage_length(), Cell::Empty()) {
+                planes = BitPlanes(geometry.dimensions());
+
+                init_regions();
+            }
+
+            // Cells come from the arena when given one, and are written
+            //  here first, so they live on this thread's NUMA node
+            BasicBoard (
+                const UVec2 board_dimensions,
+                const uint64_t seed,
+                const BoardParams board_params = BoardParams(),
+                std::shared_ptr<arena::Arena> memory = nullptr
+            ) :
+                rng_gen(seed),
+                geometry(board_dimensions),
+                params(board_params),
+                cells(geometry.storage_length(), Cell::Empty(), arena::ArenaAllocator<Cell>(memory))
             {
-                matrix = cell_matrix(
-                    dimensions.y(), 
-                    cell_vector(dimensions.x(), Cell::Empty())
-                );
+                planes = BitPlanes(geometry.dimensions());
+
+                init_regions();
             }
 
-            Board (unsigned board_width, unsigned board_height, uint64_t seed) 
-                : Board(UVec2(board_width, board_height), seed)
-            {}
+            BasicBoard (
+                unsigned board_width,
+                unsigned board_height,
+                uint64_t seed,
+                const BoardParams board_params = BoardParams()
+            ) : BasicBoard(UVec2(board_width, board_height), seed, board_params) {}
 
-            ~Board () {}
+            ~BasicBoard () {}
 
+            // Steps only the active regions. Sleeping ones are caught up
+            //  lazily the next time they are read or written.
             void foward () {
-                add_food();
+                generation += 1;
+
+                if (recording_hashes) hash_history.push_back(get_hash());
+
+                size_t i = 0;
+                while (i < active_regions.size()) {
+                    const size_t index = active_regions[i];
+                    Region& r = regions[index];
+
+                    catch_up(index);
+                    r.clear_pending();
+
+                    if (r.is_active()) {
+                        i += 1;
+                    } else {
+                        active_flags[index] = false;
+                        active_regions[i] = active_regions.back();
+                        active_regions.pop_back();
+                    }
+                }
             }
 
             Cell get (const UVec2 position) const {
-                UVec2 p = position % dimensions;
-                return matrix[p.y()][p.x()];
+                UVec2 p = geometry.wrap(position);
+                catch_up(region_index(p));
+                return cells[geometry.index(p)];
             }
 
             void set (const UVec2 position, const Cell c) {
-                UVec2 p = position % dimensions;
-                matrix[p.y()][p.x()] = c;
+                UVec2 p = geometry.wrap(position);
+                write(p, c);
             }
 
             Cell get_raw (const UVec2 position) const {
-                return matrix[position.y()][position.x()];
+                catch_up(region_index(position));
+                return cells[geometry.index(position)];
             }
 
             void set_raw (const UVec2 position, const Cell c) {
-                matrix[position.y()][position.x()] = c;
+                write(position, c);
             }
 
-            UVec2 get_dimensions () const {return dimensions;}
-            std::mt19937_64 get_rng_gen () const {return rng_gen;}
-            size_t get_length () const {return length;}
+            // Calls fn(x, cell) for the cells x0 to x1 (excluded) of row y,
+            //  in order, whatever the storage layout is. Regions are caught
+            //  up once each instead of once per cell.
+            template <typename F>
+            void for_each_in_row (const unsigned y, const unsigned x0, const unsigned x1, F&& fn) const {
+                UVec2 p (x0, y);
+                while (p.x() < x1) {
+                    const unsigned end = std::min(x1, (p.x() / sim::REGION_SIZE + 1) * sim::REGION_SIZE);
+                    catch_up(region_index(p));
+                    for (; p.x() < end; p.x() += 1) fn(p.x(), cells[geometry.index(p)]);
+                }
+            }
 
-            Board& operator=(const Board& other) {
-                if (this == &other) {return *this;}
+            // Keeps the region containing the position awake for the next
+            //  generation.
+            void wake (const UVec2 position) {
+                UVec2 p = geometry.wrap(position);
+                const size_t index = region_index(p);
 
-                rng_gen = other.get_rng_gen();
+                catch_up(index);
+                regions[index].add_pending(1);
+                activate(index);
+            }
+
+            // Turns every cell set in the mask (one byte per cell, row major)
+            //  into a wall. Walls do not wake regions, so this skips the
+            //  per cell bookkeeping of set.
+            void place_walls (const std::vector<uint8_t>& mask) {
+                sync();
+
+                UVec2 p;
+                for (p.y() = 0; p.y() < geometry.height(); p.y() += 1) {
+                    for (p.x() = 0; p.x() < geometry.width(); p.x() += 1) {
+                        const size_t i = cell_index(p);
+                        if (!mask[i]) continue;
+
+                        Cell& c = cells[geometry.index(p)];
+                        stats.record(region_index(p), c.get_type(), CellType::Wall, generation);
+                        planes.update(p, c.get_type(), CellType::Wall);
+                        spatial.update(p, c.get_type(), CellType::Wall);
+                        zobrist ^= cell_key(i, c) ^ cell_key(i, Cell::Wall());
+                        c = Cell::Wall();
+                        mark_changed(i);
+                    }
+                }
+            }
+
+            // Catches up every sleeping region to the current generation
+            void sync () const {
+                for (size_t i = 0; i < regions.size(); i++) catch_up(i);
+            }
 
-                UVec2 other_dim = other.get_dimensions();
+            // Zobrist hash of every cell, kept up to date on each write. Equal
+            //  boards always have equal hashes, whatever path led to them.
+            uint64_t get_hash () const {
+                sync();
+                return zobrist;
+            }
 
-                if ((0 >= matrix.size()) || (dimensions != other_dim)) {
-                    matrix = cell_matrix(
-                        other_dim.y(),
-                        cell_vector(other_dim.x(), Cell::Empty())
-                    );
+            // Starts keeping the hash of the board after every generation
+            void record_hashes () {recording_hashes = true;}
 
-                    dimensions = other_dim;
-                } 
+            const std::vector<uint64_t>& get_hash_history () const {return hash_history;}
 
-                UVec2 p = UVec2(0u, 0u);
+            // Generation at which the board first went back to an earlier
+            //  recorded state, if it ever did.
+            Option<uint64_t> find_repeat () const {
+                std::unordered_map<uint64_t, size_t> seen;
+                seen.reserve(hash_history.size());
 
-                for (p.y() = 0; p.y() < other_dim.y(); p.y() += 1) {
-                    for (p.x() = 0; p.x() < other_dim.x(); p.x() += 1) {
-                        set(p, other.get(p));
+                for (size_t i = 0; i < hash_history.size(); i++) {
+                    if (!seen.emplace(hash_history[i], i).second) {
+                        return Option<uint64_t>(generation - hash_history.size() + i + 1);
                     }
                 }
 
+                return Option<uint64_t>();
+            }
+
+            // Starts keeping which cells change, for observers streaming the
+            //  board. Observers only hold const references, hence const.
+            void track_changes () const {
+                if (tracking_changes) return;
+                tracking_changes = true;
+                changed_flags.assign(geometry.length(), 0);
+                changes.clear();
+            }
+
+            bool is_tracking_changes () const {return tracking_changes;}
+
+            // Row major indices of the cells written since the last call,
+            //  each listed once. Sleeping regions are caught up first.
+            void take_changes (std::vector<uint32_t>& out) const {
+                sync();
+
+                out.swap(changes);
+                changes.clear();
+                for (const uint32_t i : out) changed_flags[i] = 0;
+            }
+
+            // Amount of cells of the given type, kept up to date on each
+            //  write. Sleeping regions are caught up first.
+            size_t count (const CellType type) const {
+                sync();
+                return stats.get_count(type);
+            }
+
+            // Counts and per region heatmaps, without scanning the cells
+            Snapshot snapshot (const bool heatmaps = true) const {
+                sync();
+
+                Snapshot s;
+                s.generation = generation;
+                for (size_t t = 0; t < s.counts.size(); t++) s.counts[t] = stats.get_count(static_cast<CellType>(t));
+                if (!heatmaps) return s;
+
+                s.regions_x = static_cast<unsigned>(regions_x());
+                s.regions_y = static_cast<unsigned>(regions.size() / std::max<size_t>(1, regions_x()));
+                s.food_density.resize(regions.size());
+                s.food_heat.resize(regions.size());
+                s.organism_heat.resize(regions.size());
+
+                const double generations = static_cast<double>(std::max<uint64_t>(1, generation));
+                for (size_t i = 0; i < regions.size(); i++) {
+                    const UVec2 size = regions[i].get_size();
+                    const double area = static_cast<double>(size.x() * size.y());
+
+                    s.food_density[i] = static_cast<float>(stats.get_food(i) / area);
+                    s.food_heat[i] = static_cast<float>(stats.get_food_heat(i, generation) / (area * generations));
+                    s.organism_heat[i] = static_cast<float>(stats.get_organism_heat(i, generation) / (area * generations));
+                }
+
+                return s;
+            }
+
+            // Whether a wall or an organism is on the cell
+            bool is_blocked (const UVec2 position) const {
+                UVec2 p = geometry.wrap(position);
+                catch_up(region_index(p));
+                return planes.is_blocked(p);
+            }
+
+            // Cells of the type in a rectangle, which wraps around the edges
+            //  like the board does. Counts 64 cells per instruction.
+            size_t count (const CellType type, const UVec2 origin, const UVec2 size) const {
+                const UVec2 o = geometry.wrap(origin);
+                const unsigned w = std::min(size.x(), geometry.width());
+                const unsigned h = std::min(size.y(), geometry.height());
+
+                // Split where the rectangle wraps, into up to four parts
+                const unsigned w0 = std::min(w, geometry.width() - o.x());
+                const unsigned h0 = std::min(h, geometry.height() - o.y());
+                const UVec2 parts[4][2] = {
+                    {o, UVec2(w0, h0)},
+                    {UVec2(0u, o.y()), UVec2(w - w0, h0)},
+                    {UVec2(o.x(), 0u), UVec2(w0, h - h0)},
+                    {UVec2(0u, 0u), UVec2(w - w0, h - h0)}
+                };
+
+                size_t total = 0;
+                for (const auto& part : parts) {
+                    catch_up_rect(part[0], part[1]);
+                    total += planes.count(type, part[0], part[1]);
+                }
+                return total;
+            }
+
+            /**
+            * @brief Which moves onto the targets are allowed, for many at once.
+            * @param targets Wrapped positions, one per organism.
+            * @param mask Bit i (of word i / 64) set when targets[i] is free.
+            */
+            void free_targets (const std::vector<UVec2>& targets, std::vector<uint64_t>& mask) const {
+                mask.assign((targets.size() + 63) / 64, 0);
+
+                for (size_t i = 0; i < targets.size(); i++) {
+                    catch_up(region_index(targets[i]));
+                    mask[i >> 6] |= static_cast<uint64_t>(!planes.is_blocked(targets[i])) << (i & 63);
+                }
+            }
+
+            // Starts indexing where the food and the organisms are, for
+            //  nearest and within. Boards nobody queries skip the index and
+            //  its upkeep on every write.
+            void index_cells () const {
+                if (spatial.is_valid()) return;
+                sync();
+
+                // Buckets are the regions, so a bucket is caught up with its region
+                spatial = SpatialIndex(geometry.dimensions(), sim::REGION_SIZE);
+
+                UVec2 p;
+                for (p.y() = 0; p.y() < geometry.height(); p.y() += 1) {
+                    for (p.x() = 0; p.x() < geometry.width(); p.x() += 1) {
+                        spatial.update(p, CellType::Empty, cells[geometry.index(p)].get_type());
+                    }
+                }
+            }
+
+            bool is_indexing_cells () const {return spatial.is_valid();}
+
+            /**
+            * @brief The k cells of a type nearest to a position, around the
+            *  edges of the board.
+            * @param out Up to k hits, nearest first. The position itself
+            *  counts, so an organism finds itself among the organisms.
+            *
+            * Only the regions that may hold a nearer cell are caught up.
+            *  The first query starts indexing the cells.
+            */
+            void nearest (
+                const CellType type,
+                const UVec2 position,
+                const unsigned radius,
+                const size_t k,
+                std::vector<Hit>& out
+            ) const {
+                index_cells();
+                spatial.nearest(type, geometry.wrap(position), radius, k, out, [this](const size_t index) {catch_up(index);});
+            }
+
+            // Every cell of a type within the radius, in no given order
+            void within (const CellType type, const UVec2 position, const unsigned radius, std::vector<Hit>& out) const {
+                index_cells();
+                spatial.within(type, geometry.wrap(position), radius, out, [this](const size_t index) {catch_up(index);});
+            }
+
+            /**
+            * @brief nearest for many positions at once.
+            * @param positions Wrapped positions, one per organism.
+            * @param out k hits per position, position i at i * k, padded
+            *  with invalid hits.
+            *
+            * Positions sharing a region share one pass over the regions
+            *  around it.
+            */
+            void nearest_batch (
+                const CellType type,
+                const std::vector<UVec2>& positions,
+                const unsigned radius,
+                const size_t k,
+                std::vector<Hit>& out
+            ) const {
+                index_cells();
+                spatial.nearest_batch(type, positions, radius, k, out, [this](const size_t index) {catch_up(index);});
+            }
+
+            const BitPlanes& get_planes () const {
+                sync();
+                return planes;
+            }
+
+            /**
+            * @brief The bitplanes, caught up only within reach of the positions.
+            *
+            * For readers that stay within reach of those positions, as
+            *  vision does, so the regions away from them keep sleeping.
+            */
+            const BitPlanes& get_planes_around (const std::vector<UVec2>& positions, const unsigned reach) const {
+                for (const UVec2& p : positions) catch_up_around(p, reach);
+                return planes;
+            }
+
+            // Cells in storage order, every region caught up
+            const Cell* get_storage () const {
+                sync();
+                return cells.data();
+            }
+
+            const std::vector<Region>& get_regions () const {return regions;}
+
+            const BoardStats& get_stats () const {
+                sync();
+                return stats;
+            }
+
+            UVec2 get_dimensions () const {return geometry.dimensions();}
+            const G& get_geometry () const {return geometry;}
+
+            // Where the cells live, null for the heap
+            const arena::Arena* get_arena () const {return cells.get_allocator().get_arena();}
+            BoardParams get_params () const {return params;}
+            std::mt19937_64 get_rng_gen () const {return rng_gen;}
+            size_t get_length () const {return geometry.length();}
+            uint64_t get_generation () const {return generation;}
+            size_t get_region_count () const {return regions.size();}
+            size_t get_active_region_count () const {return active_regions.size();}
+
+            // Sleeping regions are copied asleep: their random streams come
+            //  along, so the copy catches them up to the same cells.
+            //
+            // Cells stay where this board was made to keep them: a board
+            //  made without an arena, as a default constructed one, copies
+            //  an arena board onto the heap. Check get_arena to tell.
+            BasicBoard& operator=(const BasicBoard& other) {
+                if (this == &other) {return *this;}
+
+                rng_gen = other.rng_gen;
+                geometry = other.geometry;
+                params = other.params;
+                generation = other.generation;
+                zobrist = other.zobrist;
+                stats = other.stats;
+                planes = other.planes;
+                spatial = other.spatial;
+                recording_hashes = other.recording_hashes;
+                hash_history = other.hash_history;
+
+                // Vector assignment reuses the old storage when the sizes
+                //  match. Otherwise the old cells go first, so an arena
+                //  hands their range out again instead of growing.
+                if (cells.size() != other.cells.size()) cells = cell_vector(cells.get_allocator());
+                cells = other.cells;
+                regions = other.regions;
+                active_regions = other.active_regions;
+                active_flags = other.active_flags;
+
+                // Copies are snapshots, whoever tracked the original keeps
+                //  tracking it alone. Tracking this one starts over.
+                if (tracking_changes) {
+                    changed_flags.assign(geometry.length(), 0);
+                    changes.clear();
+                }
+
                 return *this;
             }
 
         private:
             std::mt19937_64 rng_gen;
-            UVec2 dimensions = UVec2::Zero();
-            size_t length = 0;
-            cell_matrix matrix;
+            G geometry;
+            BoardParams params;
+            uint64_t generation = 0;
 
-            void add_food () {
-                std::uniform_int_distribution<uint32_t> width_dist (0, dimensions.x() - 1);
-                std::uniform_int_distribution<uint32_t> height_dist (0, dimensions.y() - 1);
+            // Lazily materialized state: reading a sleeping region catches it
+            //  up first, so these change even through const access.
+            mutable cell_vector cells;
+            mutable std::vector<Region> regions;
+            mutable uint64_t zobrist = 0;
+            mutable BoardStats stats;
+            mutable BitPlanes planes;
+            mutable SpatialIndex spatial;
 
-                UVec2 p;
-                for (uint8_t a = 0; a < sim::MAX_ATEMPTS; a++) {
-                    p.x() = width_dist(rng_gen);
-                    p.y() = height_dist(rng_gen);
+            std::vector<size_t> active_regions;
+            std::vector<bool> active_flags;
+
+            bool recording_hashes = false;
+            std::vector<uint64_t> hash_history;
+
+            mutable bool tracking_changes = false;
+            mutable std::vector<uint8_t> changed_flags;
+            mutable std::vector<uint32_t> changes;
+
+            // Empty cells hash to zero, so a new board needs no initial pass
+            static uint64_t cell_key (const size_t index, const Cell c) {
+                const uint32_t bits = c.pack();
+                if (Cell::Empty().pack() == bits) return 0;
+                return hash::combine(ZOBRIST_SALT ^ bits, index);
+            }
+
+            static constexpr uint64_t ZOBRIST_SALT = 0x5a0b7157c0ffee00ull;
+
+            void init_regions () {
+                constexpr unsigned rs = sim::REGION_SIZE;
+
+                const unsigned w = geometry.width();
+                const unsigned h = geometry.height();
 
-                    if (get(p).is_empty()) {
-                        set(p, Cell::Food());
+                regions.clear();
+                regions.reserve(regions_x() * ((h + rs - 1) / rs));
+
+                // Each region hashes its own stream out of one board seed
+                const uint64_t seed = rng_gen();
+
+                UVec2 origin;
+                for (origin.y() = 0; origin.y() < h; origin.y() += rs) {
+                    for (origin.x() = 0; origin.x() < w; origin.x() += rs) {
+                        UVec2 size = UVec2(
+                            std::min(rs, w - origin.x()),
+                            std::min(rs, h - origin.y())
+                        );
+
+                        double area_share = static_cast<double>(size.x() * size.y())
+                            / static_cast<double>(geometry.length());
+
+                        regions.push_back(Region(
+                            origin,
+                            size,
+                            params.food_rate * area_share,
+                            hash::combine(seed, regions.size())
+                        ));
+                    }
+                }
+
+                active_regions.clear();
+                active_flags.assign(regions.size(), false);
+
+                stats = BoardStats(geometry.length(), regions.size());
+                spatial = SpatialIndex();
+            }
+
+            size_t regions_x () const {
+                return (geometry.width() + sim::REGION_SIZE - 1) / sim::REGION_SIZE;
+            }
+
+            size_t region_index (const UVec2 p) const {
+                return (p.y() / sim::REGION_SIZE) * regions_x() + p.x() / sim::REGION_SIZE;
+            }
+
+            // Row major index of a cell, whatever the storage layout is
+            size_t cell_index (const UVec2 p) const {
+                return static_cast<size_t>(p.y()) * geometry.width() + p.x();
+            }
+
+            void mark_changed (const size_t i) const {
+                if (!tracking_changes || changed_flags[i]) return;
+                changed_flags[i] = 1;
+                changes.push_back(static_cast<uint32_t>(i));
+            }
+
+            void activate (const size_t index) {
+                if (active_flags[index]) return;
+                active_flags[index] = true;
+                active_regions.push_back(index);
+            }
+
+            void catch_up_rect (const UVec2 origin, const UVec2 size) const {
+                if (0 == size.x() || 0 == size.y()) return;
+
+                constexpr unsigned rs = sim::REGION_SIZE;
+                for (unsigned ry = origin.y() / rs; ry <= (origin.y() + size.y() - 1) / rs; ry++) {
+                    for (unsigned rx = origin.x() / rs; rx <= (origin.x() + size.x() - 1) / rs; rx++) {
+                        catch_up(ry * regions_x() + rx);
+                    }
+                }
+            }
+
+            // Catches up the regions within reach of p along both axes,
+            //  around the edges of the board
+            void catch_up_around (const UVec2 p, const unsigned reach) const {
+                constexpr unsigned rs = sim::REGION_SIZE;
+                const unsigned w = geometry.width();
+                const unsigned h = geometry.height();
+
+                const unsigned span_x = std::min(2 * reach + 1, w);
+                const unsigned span_y = std::min(2 * reach + 1, h);
+                const unsigned x0 = (p.x() + w - reach % w) % w;
+                const unsigned y0 = (p.y() + h - reach % h) % h;
+
+                // A region at a time, the last one of each axis may be narrower
+                for (unsigned oy = 0; oy < span_y;) {
+                    const unsigned y = (y0 + oy) % h;
+                    for (unsigned ox = 0; ox < span_x;) {
+                        const unsigned x = (x0 + ox) % w;
+                        catch_up(region_index(UVec2(x, y)));
+                        ox += std::min(rs - x % rs, w - x);
+                    }
+                    oy += std::min(rs - y % rs, h - y);
+                }
+            }
+
+            // Replays the food arrivals the region missed while sleeping
+            void catch_up (const size_t index) const {
+                assert(index < regions.size() && "Board used before being sized");
+                Region& r = regions[index];
+                if (r.is_synced(generation)) return;
+
+                // Food is counted from the generation it arrived at, as if
+                //  the region had been stepped all along
+                const double now = static_cast<double>(generation);
+                while (r.get_next_food() <= now) {
+                    add_food(index, static_cast<uint64_t>(std::ceil(r.get_next_food())));
+                    r.advance_food();
+                }
+
+                r.mark_synced(generation);
+            }
+
+            void add_food (const size_t index, const uint64_t arrival) const {
+                Region& r = regions[index];
+                for (uint8_t a = 0; a < params.max_atempts; a++) {
+                    UVec2 p = r.draw_position();
+                    Cell& c = cells[geometry.index(p)];
+
+                    if (c.is_empty()) {
+                        const size_t i = cell_index(p);
+                        stats.record(index, CellType::Empty, CellType::Food, arrival);
+                        planes.update(p, CellType::Empty, CellType::Food);
+                        spatial.update(p, CellType::Empty, CellType::Food);
+                        zobrist ^= cell_key(i, c) ^ cell_key(i, Cell::Food());
+                        c = Cell::Food();
+                        mark_changed(i);
                         break;
                     }
                 }
+            }
+
+            void write (const UVec2 p, const Cell c) {
+                const size_t index = region_index(p);
+                catch_up(index);
+
+                Cell& old = cells[geometry.index(p)];
+                const bool was_organism = CellType::Organism == old.get_type();
+                const bool is_organism = CellType::Organism == c.get_type();
+
+                if (was_organism != is_organism) {
+                    regions[index].add_organisms(is_organism ? 1 : -1);
+                    if (is_organism) activate(index);
+                }
 
-                set(UVec2(3u, 3u), Cell::Food());
+                stats.record(index, old.get_type(), c.get_type(), generation);
+                planes.update(p, old.get_type(), c.get_type());
+                spatial.update(p, old.get_type(), c.get_type());
+
+                const size_t i = cell_index(p);
+                zobrist ^= cell_key(i, old) ^ cell_key(i, c);
+                old = c;
+                mark_changed(i);
             }
     };
+
+    using Board = BasicBoard<DynamicGeometry>;
 }
\ No newline at end of file
@@ -0,0 +1,170 @@
+#pragma once
+
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "Sim/Board/Cell.hpp"
+#include "utils/Vec.hpp"
+#include "utils/Cpu.hpp"
+
+
+namespace bitplane {
+    using CellType = cell::CellType;
+
+    CPU_INLINE unsigned popcount (const uint64_t word) {return static_cast<unsigned>(__builtin_popcountll(word));}
+
+    // Bits from x (included) to x + n (excluded) of a word, n in 1..64
+    inline uint64_t bit_range (const unsigned x, const unsigned n) {
+        const uint64_t ones = (64 <= n) ? ~0ull : ((1ull << n) - 1);
+        return ones << x;
+    }
+
+
+    // One bit per cell for each non empty cell type, row major with every
+    //  row padded to whole words. Questions about many cells become AND, OR
+    //  and popcount over 64 cells at a time, on planes 32 times smaller
+    //  than the cells themselves.
+    class BitPlanes {
+        public:
+            BitPlanes () {}
+
+            BitPlanes (const UVec2 plane_dimensions) :
+                dimensions(plane_dimensions),
+                stride((plane_dimensions.x() + 63) / 64)
+            {
+                for (std::vector<uint64_t>& plane : planes) {
+                    plane.assign(stride * plane_dimensions.y(), 0);
+                }
+            }
+
+            ~BitPlanes () {}
+
+            // A cell went from one type to another
+            void update (const UVec2 p, const CellType from, const CellType to) {
+                if (from == to) return;
+
+                const size_t word = word_index(p);
+                const uint64_t bit = 1ull << (p.x() & 63);
+
+                if (CellType::Empty != from) planes[plane_of(from)][word] &= ~bit;
+                if (CellType::Empty != to) planes[plane_of(to)][word] |= bit;
+            }
+
+            bool test (const CellType type, const UVec2 p) const {
+                if (CellType::Empty == type) return !test_any(p);
+                return 0 != (planes[plane_of(type)][word_index(p)] >> (p.x() & 63) & 1);
+            }
+
+            bool test_any (const UVec2 p) const {
+                const size_t word = word_index(p);
+                return 0 != ((walls()[word] | food()[word] | organisms()[word]) >> (p.x() & 63) & 1);
+            }
+
+            // Walls and organisms stop a move, food does not
+            bool is_blocked (const UVec2 p) const {
+                const size_t word = word_index(p);
+                return 0 != ((walls()[word] | organisms()[word]) >> (p.x() & 63) & 1);
+            }
+
+            // 64 cells of a row starting at x = 64 * word, bit set where a
+            //  move is allowed. Padding bits past the row end are not set.
+            uint64_t free_word (const unsigned y, const size_t word) const {
+                const size_t i = static_cast<size_t>(y) * stride + word;
+                return ~(walls()[i] | organisms()[i]) & row_mask(word);
+            }
+
+            // 64 cells of a row starting at x = 64 * word, bit set where the
+            //  cell is not empty
+            uint64_t any_word (const unsigned y, const size_t word) const {
+                const size_t i = static_cast<size_t>(y) * stride + word;
+                return walls()[i] | food()[i] | organisms()[i];
+            }
+
+            CellType type_at (const UVec2 p) const {
+                const size_t word = word_index(p);
+                const unsigned bit = p.x() & 63;
+                if (walls()[word] >> bit & 1) return CellType::Wall;
+                if (food()[word] >> bit & 1) return CellType::Food;
+                if (organisms()[word] >> bit & 1) return CellType::Organism;
+                return CellType::Empty;
+            }
+
+            // Cells of the type inside a rectangle that does not wrap
+            size_t count (const CellType type, const UVec2 origin, const UVec2 size) const {
+                if (0 == size.x() || 0 == size.y()) return 0;
+
+                size_t total = 0;
+                for (unsigned y = origin.y(); y < origin.y() + size.y(); y++) {
+                    total += count_row(type, y, origin.x(), origin.x() + size.x());
+                }
+                return total;
+            }
+
+            const uint64_t* row (const CellType type, const unsigned y) const {
+                return &planes[plane_of(type)][static_cast<size_t>(y) * stride];
+            }
+
+            size_t get_stride () const {return stride;}
+            UVec2 get_dimensions () const {return dimensions;}
+
+        private:
+            UVec2 dimensions = UVec2::Zero();
+            size_t stride = 0;
+
+            // Walls, food and organisms. Empty cells are the ones in none.
+            std::array<std::vector<uint64_t>, 3> planes;
+
+            static size_t plane_of (const CellType type) {return static_cast<size_t>(type) - 1;}
+
+            const std::vector<uint64_t>& walls () const {return planes[0];}
+            const std::vector<uint64_t>& food () const {return planes[1];}
+            const std::vector<uint64_t>& organisms () const {return planes[2];}
+
+            size_t word_index (const UVec2 p) const {
+                return static_cast<size_t>(p.y()) * stride + (p.x() >> 6);
+            }
+
+            uint64_t row_mask (const size_t word) const {
+                const size_t first = word * 64;
+                if (first + 64 <= dimensions.x()) return ~0ull;
+                return bit_range(0, static_cast<unsigned>(dimensions.x() - first));
+            }
+
+            // Cells x0 (included) to x1 (excluded) of a row. Without popcnt in
+            //  the baseline, popcount is a dozen instructions, so cpus that
+            //  have it get a build of the loop using it.
+            size_t count_row (const CellType type, const unsigned y, const unsigned x0, const unsigned x1) const {
+                #if defined(CPU_DISPATCH)
+                    if (cpu::Isa::Avx2 <= cpu::level()) return count_row_popcnt(type, y, x0, x1);
+                #endif
+                return count_row_words(type, y, x0, x1);
+            }
+
+            #if defined(CPU_DISPATCH)
+                CPU_TARGET_POPCNT size_t count_row_popcnt (const CellType type, const unsigned y, const unsigned x0, const unsigned x1) const {
+                    return count_row_words(type, y, x0, x1);
+                }
+            #endif
+
+            CPU_INLINE size_t count_row_words (const CellType type, const unsigned y, const unsigned x0, const unsigned x1) const {
+                const size_t base = static_cast<size_t>(y) * stride;
+                const size_t w0 = x0 >> 6;
+                const size_t w1 = (x1 - 1) >> 6;
+
+                auto word = [&](const size_t w) -> uint64_t {
+                    if (CellType::Empty != type) return planes[plane_of(type)][base + w];
+                    return ~(walls()[base + w] | food()[base + w] | organisms()[base + w]);
+                };
+
+                if (w0 == w1) return popcount(word(w0) & bit_range(x0 & 63, x1 - x0));
+
+                size_t total = popcount(word(w0) & bit_range(x0 & 63, 64 - (x0 & 63)));
+                for (size_t w = w0 + 1; w < w1; w++) total += popcount(word(w));
+                total += popcount(word(w1) & bit_range(0, x1 - static_cast<unsigned>(w1 * 64)));
+                return total;
+            }
+    };
+}
\ No newline at end of file
@@ -18,6 +18,12 @@ namespace cell {
         public:
             static Cell Empty () {return Cell(CellType::Empty, 0);}
             static Cell Food () {return Cell(CellType::Food, 1);}
+            static Cell Wall () {return Cell(CellType::Wall, 8);}
+            static Cell Organism (const SimpleDir organism_dir) {
+                Cell c (CellType::Organism, 2);
+                c.dir = organism_dir;
+                return c;
+            }
 
             Cell () {}
             Cell (const CellType cell_type) : type(cell_type) {}
@@ -28,13 +34,33 @@ namespace cell {
 
             CellType get_type () const {return type;}
             Color get_color () const {return color;}
+            SimpleDir get_dir () const {return dir;}
             bool is_empty () const {return CellType::Empty == type;}
+
+            // Every field of the cell packed in a single word
+            uint32_t pack () const {
+                return static_cast<uint32_t>(type)
+                    | (static_cast<uint32_t>(color) << 8)
+                    | (static_cast<uint32_t>(dir) << 16)
+                    | (static_cast<uint32_t>(amount) << 24);
+            }
+
+            static Cell unpack (const uint32_t word) {
+                Cell c (static_cast<CellType>(word & 0xff), static_cast<Color>((word >> 8) & 0xff));
+                c.dir = static_cast<SimpleDir>((word >> 16) & 0xff);
+                c.amount = static_cast<uint8_t>(word >> 24);
+                return c;
+            }
             
-            std::wstring to_str () {
+            std::wstring to_str () {return std::wstring(1, glyph());}
+
+            wchar_t glyph () const {
                 switch (type) {
-                    case CellType::Empty: return L" ";
-                    case CellType::Food: return L"&";
-                    default: return L" ";
+                    case CellType::Empty: return L' ';
+                    case CellType::Wall: return L'█';
+                    case CellType::Food: return L'&';
+                    case CellType::Organism: return L'o';
+                    default: return L' ';
                 }
             }
 
@@ -0,0 +1,244 @@
+#pragma once
+
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "utils/Cpu.hpp"
+
+#if defined(CPU_DISPATCH)
+    #include <immintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+#include "Sim/sim_constants.hpp"
+#include "utils/Vec.hpp"
+#include "utils/ThreadPool.hpp"
+
+
+namespace field {
+    using ThreadPool = pool::ThreadPool;
+
+    // How a field spreads and fades every generation. The diffusion is the
+    //  share a cell gives to each of its 4 neighbors, so it must stay below
+    //  0.25 to be stable.
+    class FieldParams {
+        public:
+            float diffusion = 0.1f;
+            float decay = 0.01f;
+    };
+
+
+    // A scalar layer (scent, pheromone...) aligned with the board cells.
+    //  Every generation it is diffused with a 5 point stencil and decayed,
+    //  wrapping around the edges like the board does.
+    class Field {
+        public:
+            Field () {}
+
+            Field (const UVec2 field_dimensions, const FieldParams field_params) :
+                dimensions(field_dimensions),
+                params(field_params),
+                front(field_dimensions.x() * field_dimensions.y(), 0.0f),
+                back(field_dimensions.x() * field_dimensions.y(), 0.0f)
+            {}
+
+            ~Field () {}
+
+            void foward (ThreadPool& pool) {
+                const unsigned width = dimensions.x();
+                const unsigned height = dimensions.y();
+                if (0 == width || 0 == height) return;
+
+                const float d = params.diffusion;
+                const float keep = 1.0f - params.decay;
+
+                pool.parallel_for(0, height, sim::FIELD_TILE_ROWS, [&](size_t begin, size_t end) {
+                    for (size_t y = begin; y < end; y++) {
+                        const size_t up = (0 == y ? height : y) - 1;
+                        const size_t down = (height - 1 == y ? 0 : y + 1);
+
+                        diffuse_row(
+                            &front[up * width],
+                            &front[y * width],
+                            &front[down * width],
+                            &back[y * width],
+                            width, d, keep
+                        );
+                    }
+                });
+
+                std::swap(front, back);
+            }
+
+            float sample (const UVec2 position) const {
+                UVec2 p = position % dimensions;
+                return front[p.y() * dimensions.x() + p.x()];
+            }
+
+            float sample_raw (const UVec2 p) const {
+                return front[p.y() * dimensions.x() + p.x()];
+            }
+
+            void deposit (const UVec2 position, const float amount) {
+                UVec2 p = position % dimensions;
+                front[p.y() * dimensions.x() + p.x()] += amount;
+            }
+
+            // Central difference of the field around the position, pointing
+            //  towards where it is stronger.
+            Vec2 gradient (const UVec2 position) const {
+                const unsigned w = dimensions.x();
+                const unsigned h = dimensions.y();
+                UVec2 p = position % dimensions;
+
+                const unsigned left = (0 == p.x() ? w : p.x()) - 1;
+                const unsigned right = (w - 1 == p.x() ? 0 : p.x() + 1);
+                const unsigned up = (0 == p.y() ? h : p.y()) - 1;
+                const unsigned down = (h - 1 == p.y() ? 0 : p.y() + 1);
+
+                return Vec2(
+                    0.5f * (front[p.y() * w + right] - front[p.y() * w + left]),
+                    0.5f * (front[down * w + p.x()] - front[up * w + p.x()])
+                );
+            }
+
+            void clear () {
+                std::fill(front.begin(), front.end(), 0.0f);
+            }
+
+            UVec2 get_dimensions () const {return dimensions;}
+            FieldParams get_params () const {return params;}
+            const float* data () const {return front.data();}
+
+        private:
+            UVec2 dimensions = UVec2::Zero();
+            FieldParams params;
+            std::vector<float> front;
+            std::vector<float> back;
+
+            static inline float stencil (
+                const float center,
+                const float neighbors,
+                const float d,
+                const float keep
+            ) {
+                return keep * (center + d * (neighbors - 4.0f * center));
+            }
+
+            static void diffuse_row (
+                const float* __restrict up,
+                const float* __restrict mid,
+                const float* __restrict down,
+                float* __restrict out,
+                const unsigned width,
+                const float d,
+                const float keep
+            ) {
+                if (1 == width) {
+                    out[0] = stencil(mid[0], up[0] + down[0] + 2.0f * mid[0], d, keep);
+                    return;
+                }
+
+                // The horizontal wrap only matters on the two edge cells
+                out[0] = stencil(mid[0], up[0] + down[0] + mid[width - 1] + mid[1], d, keep);
+                out[width - 1] = stencil(
+                    mid[width - 1],
+                    up[width - 1] + down[width - 1] + mid[width - 2] + mid[0],
+                    d, keep
+                );
+
+                [[maybe_unused]] const cpu::Isa isa = cpu::level();
+                unsigned x = 1;
+
+                // Every width adds the neighbors in the same order and never
+                //  fuses a multiply with an add, so all of them give the same
+                //  field bit for bit
+                #if defined(CPU_DISPATCH)
+                    if (cpu::Isa::Avx512 == isa) x = diffuse_avx512(up, mid, down, out, width, d, keep, x);
+                    if (cpu::Isa::Avx2 <= isa) x = diffuse_avx2(up, mid, down, out, width, d, keep, x);
+                #endif
+
+                #if defined(__SSE2__)
+                    const __m128 vd = _mm_set1_ps(d);
+                    const __m128 vkeep = _mm_set1_ps(keep);
+                    const __m128 vfour = _mm_set1_ps(4.0f);
+
+                    for (; cpu::Isa::Sse2 <= isa && x + 4 < width; x += 4) {
+                        const __m128 c = _mm_loadu_ps(mid + x);
+                        __m128 n = _mm_add_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x));
+                        n = _mm_add_ps(n, _mm_loadu_ps(mid + x - 1));
+                        n = _mm_add_ps(n, _mm_loadu_ps(mid + x + 1));
+
+                        const __m128 lap = _mm_sub_ps(n, _mm_mul_ps(vfour, c));
+                        const __m128 r = _mm_mul_ps(vkeep, _mm_add_ps(c, _mm_mul_ps(vd, lap)));
+                        _mm_storeu_ps(out + x, r);
+                    }
+                #endif
+
+                for (; x + 1 < width; x++) {
+                    out[x] = stencil(mid[x], up[x] + down[x] + mid[x - 1] + mid[x + 1], d, keep);
+                }
+            }
+
+            #if defined(CPU_DISPATCH)
+                // The inner cells from x on, 8 at a time. Returns where it stopped.
+                CPU_TARGET_AVX2 static unsigned diffuse_avx2 (
+                    const float* __restrict up,
+                    const float* __restrict mid,
+                    const float* __restrict down,
+                    float* __restrict out,
+                    const unsigned width,
+                    const float d,
+                    const float keep,
+                    unsigned x
+                ) {
+                    const __m256 vd = _mm256_set1_ps(d);
+                    const __m256 vkeep = _mm256_set1_ps(keep);
+                    const __m256 vfour = _mm256_set1_ps(4.0f);
+
+                    for (; x + 8 < width; x += 8) {
+                        const __m256 c = _mm256_loadu_ps(mid + x);
+                        __m256 n = _mm256_add_ps(_mm256_loadu_ps(up + x), _mm256_loadu_ps(down + x));
+                        n = _mm256_add_ps(n, _mm256_loadu_ps(mid + x - 1));
+                        n = _mm256_add_ps(n, _mm256_loadu_ps(mid + x + 1));
+
+                        const __m256 lap = _mm256_sub_ps(n, _mm256_mul_ps(vfour, c));
+                        _mm256_storeu_ps(out + x, _mm256_mul_ps(vkeep, _mm256_add_ps(c, _mm256_mul_ps(vd, lap))));
+                    }
+
+                    return x;
+                }
+
+                // Same, 16 at a time
+                CPU_TARGET_AVX512 static unsigned diffuse_avx512 (
+                    const float* __restrict up,
+                    const float* __restrict mid,
+                    const float* __restrict down,
+                    float* __restrict out,
+                    const unsigned width,
+                    const float d,
+                    const float keep,
+                    unsigned x
+                ) {
+                    const __m512 vd = _mm512_set1_ps(d);
+                    const __m512 vkeep = _mm512_set1_ps(keep);
+                    const __m512 vfour = _mm512_set1_ps(4.0f);
+
+                    for (; x + 16 < width; x += 16) {
+                        const __m512 c = _mm512_loadu_ps(mid + x);
+                        __m512 n = _mm512_add_ps(_mm512_loadu_ps(up + x), _mm512_loadu_ps(down + x));
+                        n = _mm512_add_ps(n, _mm512_loadu_ps(mid + x - 1));
+                        n = _mm512_add_ps(n, _mm512_loadu_ps(mid + x + 1));
+
+                        const __m512 lap = _mm512_sub_ps(n, _mm512_mul_ps(vfour, c));
+                        _mm512_storeu_ps(out + x, _mm512_mul_ps(vkeep, _mm512_add_ps(c, _mm512_mul_ps(vd, lap))));
+                    }
+
+                    return x;
+                }
+            #endif
+    };
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <string>
+#include <cstdint>
+
+#include "utils/Vec.hpp"
+
+
+namespace geometry {
+    // How cells are ordered in memory
+    enum class Layout : uint8_t {
+        Rows = 0, Tiled = 1
+    };
+
+
+    // Board dimensions known only at runtime. Wrapping costs a division.
+    class DynamicGeometry {
+        public:
+            static constexpr bool IS_STATIC = false;
+            static constexpr Layout LAYOUT = Layout::Rows;
+
+            DynamicGeometry () {}
+            DynamicGeometry (const UVec2 geometry_dimensions) :
+                w(geometry_dimensions.x()),
+                h(geometry_dimensions.y())
+            {}
+
+            unsigned width () const {return w;}
+            unsigned height () const {return h;}
+            size_t length () const {return static_cast<size_t>(w) * h;}
+            size_t storage_length () const {return length();}
+            UVec2 dimensions () const {return UVec2(w, h);}
+
+            UVec2 wrap (const UVec2 p) const {return UVec2(p.x() % w, p.y() % h);}
+
+            size_t index (const UVec2 p) const {
+                return static_cast<size_t>(p.y()) * w + p.x();
+            }
+
+        private:
+            unsigned w = 0;
+            unsigned h = 0;
+    };
+
+
+    // Board dimensions fixed at compile time, so wrapping, indexing and row
+    //  loops use constants. Powers of two wrap with a mask.
+    template <unsigned W, unsigned H>
+    class StaticGeometry {
+        public:
+            static_assert(0 < W && 0 < H, "Board dimensions must not be zero");
+
+            static constexpr bool IS_STATIC = true;
+            static constexpr Layout LAYOUT = Layout::Rows;
+            static constexpr unsigned WIDTH = W;
+            static constexpr unsigned HEIGHT = H;
+
+            StaticGeometry () {}
+            StaticGeometry (const UVec2 geometry_dimensions) {
+                if (geometry_dimensions.x() != W || geometry_dimensions.y() != H) {
+                    throw std::invalid_argument("Dimensions do not match the static geometry");
+                }
+            }
+
+            static constexpr unsigned width () {return W;}
+            static constexpr unsigned height () {return H;}
+            static constexpr size_t length () {return static_cast<size_t>(W) * H;}
+            static constexpr size_t storage_length () {return length();}
+            static UVec2 dimensions () {return UVec2(W, H);}
+
+            static UVec2 wrap (const UVec2 p) {return UVec2(wrap_x(p.x()), wrap_y(p.y()));}
+
+            static constexpr size_t index (const UVec2 p) {
+                return static_cast<size_t>(p.y()) * W + p.x();
+            }
+
+        private:
+            static constexpr bool is_pow2 (const unsigned v) {return 0 == (v & (v - 1));}
+
+            static constexpr unsigned wrap_x (const unsigned x) {
+                if constexpr (is_pow2(W)) return x & (W - 1);
+                else return x % W;
+            }
+
+            static constexpr unsigned wrap_y (const unsigned y) {
+                if constexpr (is_pow2(H)) return y & (H - 1);
+                else return y % H;
+            }
+    };
+
+    // Cells stored as 8 by 8 tiles with the cells of a tile in Z order
+    //  (Morton). The 8 neighbors of most cells then sit in the same 256
+    //  bytes, where row major puts the ones above and below a whole row
+    //  away. Storage is padded to whole tiles.
+    class Tiles {
+        public:
+            static constexpr unsigned TILE_LOG = 3;
+            static constexpr unsigned TILE = 1u << TILE_LOG;
+
+            static constexpr unsigned count (const unsigned cells) {return (cells + TILE - 1) >> TILE_LOG;}
+
+            static constexpr size_t storage_length (const unsigned w, const unsigned h) {
+                return static_cast<size_t>(count(w)) * count(h) * TILE * TILE;
+            }
+
+            static size_t index (const UVec2 p, const unsigned tiles_x) {
+                const size_t tile = static_cast<size_t>(p.y() >> TILE_LOG) * tiles_x + (p.x() >> TILE_LOG);
+                return (tile << (2 * TILE_LOG)) | interleave(p.x() & (TILE - 1), p.y() & (TILE - 1));
+            }
+
+        private:
+            // Bits of x in the even positions, bits of y in the odd ones
+            static constexpr unsigned interleave (const unsigned x, const unsigned y) {
+                return spread(x) | (spread(y) << 1);
+            }
+
+            static constexpr unsigned spread (unsigned v) {
+                v = (v | (v << 2)) & 0x33u;
+                v = (v | (v << 1)) & 0x55u;
+                return v;
+            }
+    };
+
+
+    // Tiled board of dimensions known only at runtime
+    class TiledGeometry {
+        public:
+            static constexpr bool IS_STATIC = false;
+            static constexpr Layout LAYOUT = Layout::Tiled;
+
+            TiledGeometry () {}
+            TiledGeometry (const UVec2 geometry_dimensions) :
+                w(geometry_dimensions.x()),
+                h(geometry_dimensions.y()),
+                tiles_x(Tiles::count(geometry_dimensions.x()))
+            {}
+
+            unsigned width () const {return w;}
+            unsigned height () const {return h;}
+            size_t length () const {return static_cast<size_t>(w) * h;}
+            size_t storage_length () const {return Tiles::storage_length(w, h);}
+            UVec2 dimensions () const {return UVec2(w, h);}
+
+            UVec2 wrap (const UVec2 p) const {return UVec2(p.x() % w, p.y() % h);}
+
+            size_t index (const UVec2 p) const {return Tiles::index(p, tiles_x);}
+
+        private:
+            unsigned w = 0;
+            unsigned h = 0;
+            unsigned tiles_x = 0;
+    };
+
+
+    // Tiled board of dimensions fixed at compile time, wrapping like its
+    //  row major counterpart, so the two layouts only differ in the order
+    //  of the cells.
+    template <unsigned W, unsigned H>
+    class StaticTiledGeometry : public StaticGeometry<W, H> {
+        public:
+            using StaticGeometry<W, H>::StaticGeometry;
+
+            static constexpr Layout LAYOUT = Layout::Tiled;
+
+            static constexpr size_t storage_length () {return Tiles::storage_length(W, H);}
+
+            static size_t index (const UVec2 p) {return Tiles::index(p, Tiles::count(W));}
+    };
+
+
+    // Square-ish boards of 2^LOG_W by 2^LOG_H cells
+    template <unsigned LOG_W, unsigned LOG_H>
+    using Pow2Geometry = StaticGeometry<(1u << LOG_W), (1u << LOG_H)>;
+
+    template <unsigned LOG_W, unsigned LOG_H>
+    using Pow2TiledGeometry = StaticTiledGeometry<(1u << LOG_W), (1u << LOG_H)>;
+
+
+    template <typename... Gs>
+    class GeometryList {};
+
+    // Sizes used by production sweeps, which get a fully specialized board
+    using CommonGeometries = GeometryList<
+        Pow2Geometry<6, 6>,
+        Pow2Geometry<7, 7>,
+        Pow2Geometry<8, 8>,
+        Pow2Geometry<9, 9>,
+        Pow2Geometry<10, 10>,
+        Pow2Geometry<11, 11>,
+        Pow2Geometry<12, 12>,
+        Pow2Geometry<13, 13>,
+        Pow2Geometry<14, 14>
+    >;
+
+    // The same sizes, tiled
+    using CommonTiledGeometries = GeometryList<
+        Pow2TiledGeometry<6, 6>,
+        Pow2TiledGeometry<7, 7>,
+        Pow2TiledGeometry<8, 8>,
+        Pow2TiledGeometry<9, 9>,
+        Pow2TiledGeometry<10, 10>,
+        Pow2TiledGeometry<11, 11>,
+        Pow2TiledGeometry<12, 12>,
+        Pow2TiledGeometry<13, 13>,
+        Pow2TiledGeometry<14, 14>
+    >;
+
+    // Any other size falls back to the geometry D
+    template <typename D = DynamicGeometry, typename F, typename... Gs>
+    auto dispatch (GeometryList<Gs...>, const UVec2 dimensions, F&& fn) {
+        using Result = decltype(fn(D(dimensions)));
+
+        Result result {};
+        const bool found = (
+            (
+                (Gs::WIDTH == dimensions.x() && Gs::HEIGHT == dimensions.y())
+                && (result = fn(Gs()), true)
+            ) || ...
+        );
+
+        if (!found) result = fn(D(dimensions));
+        return result;
+    }
+
+    inline Layout parse_layout (const std::string& name) {
+        if ("rows" == name) return Layout::Rows;
+        if ("tiled" == name) return Layout::Tiled;
+        throw std::invalid_argument("Unknown layout " + name);
+    }
+
+    /**
+    * @brief Calls fn with the geometry matching the dimensions.
+    * @param dimensions Dimensions of the board.
+    * @param fn Generic callable taking a geometry and returning a value.
+    * @return What fn returned.
+    *
+    * Common sizes get a StaticGeometry and fn is instantiated for each of
+    *  them; any other size falls back to a DynamicGeometry.
+    */
+    template <typename F>
+    auto dispatch (const UVec2 dimensions, F&& fn) {
+        return dispatch(CommonGeometries(), dimensions, std::forward<F>(fn));
+    }
+
+    /**
+    * @brief Same as above, with the cell layout picked at runtime.
+    *
+    * Common sizes get a static geometry in both layouts and other sizes a
+    *  dynamic one, so comparing layouts on a size compares cell order only.
+    */
+    template <typename F>
+    auto dispatch (const UVec2 dimensions, const Layout layout, F&& fn) {
+        if (Layout::Tiled == layout) {
+            return dispatch<TiledGeometry>(CommonTiledGeometries(), dimensions, std::forward<F>(fn));
+        }
+        return dispatch(dimensions, std::forward<F>(fn));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+
+
+#include <cmath>
+#include <limits>
+
+#include "utils/Vec.hpp"
+#include "utils/Hash.hpp"
+
+
+namespace region {
+    // A square chunk of the board used for activity tracking.
+    //
+    // Food arrives in each region as a poisson process with its own random
+    //  stream, so the arrivals of a region only depend on that stream. A
+    //  sleeping region can then be caught up at any later generation by
+    //  replaying the arrivals in order, which gives the exact same cells as
+    //  stepping it every generation. The stream is a hash of the region seed
+    //  and a draw counter, so a region carries 16 bytes of random state
+    //  rather than a whole generator.
+    class Region {
+        public:
+            Region () {}
+
+            Region (
+                const UVec2 region_origin,
+                const UVec2 region_size,
+                const double region_food_rate,
+                const uint64_t region_seed
+            ) :
+                seed(region_seed),
+                origin(region_origin),
+                size(region_size),
+                food_rate(region_food_rate)
+            {
+                next_food = draw_interval();
+            }
+
+            ~Region () {}
+
+            uint64_t get_seed () const {return seed;}
+            uint64_t get_draws () const {return draws;}
+            UVec2 get_origin () const {return origin;}
+            UVec2 get_size () const {return size;}
+            uint64_t get_synced_generation () const {return synced_generation;}
+            unsigned get_organisms () const {return organisms;}
+            unsigned get_pending () const {return pending;}
+
+            bool is_active () const {return 0 < organisms || 0 < pending;}
+            bool is_synced (const uint64_t generation) const {
+                return generation == synced_generation;
+            }
+
+            // Time (in generations) of the next food arrival
+            double get_next_food () const {return next_food;}
+
+            // Draws a random position inside the region
+            UVec2 draw_position () {
+                const uint64_t bits = draw();
+
+                UVec2 p;
+                p.x() = origin.x() + scale(static_cast<uint32_t>(bits), size.x());
+                p.y() = origin.y() + scale(static_cast<uint32_t>(bits >> 32), size.y());
+                return p;
+            }
+
+            // Consumes the pending food arrival and schedules the next one
+            void advance_food () {next_food += draw_interval();}
+
+            void mark_synced (const uint64_t generation) {synced_generation = generation;}
+            void add_organisms (const int delta) {organisms += delta;}
+            void add_pending (const int delta) {pending += delta;}
+            void clear_pending () {pending = 0;}
+
+        private:
+            uint64_t seed = 0;
+            uint64_t draws = 0;
+            UVec2 origin = UVec2::Zero();
+            UVec2 size = UVec2::Zero();
+            double food_rate = 0.0;
+            double next_food = std::numeric_limits<double>::infinity();
+            uint64_t synced_generation = 0;
+            unsigned organisms = 0;
+            unsigned pending = 0;
+
+            uint64_t draw () {return hash::combine(seed, draws++);}
+
+            // Maps 32 random bits onto [0, n) without a division
+            static unsigned scale (const uint32_t bits, const unsigned n) {
+                return static_cast<unsigned>((static_cast<uint64_t>(bits) * n) >> 32);
+            }
+
+            double draw_interval () {
+                if (0.0 >= food_rate) return std::numeric_limits<double>::infinity();
+
+                // Uniform in (0, 1], so the log is always finite
+                const double u = static_cast<double>((draw() >> 11) + 1) * 0x1.0p-53;
+                return -std::log(u) / food_rate;
+            }
+    };
+}
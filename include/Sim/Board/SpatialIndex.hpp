@@ -0,0 +1,363 @@
+#pragma once
+
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Sim/Board/Cell.hpp"
+#include "utils/Vec.hpp"
+
+
+namespace spatial {
+    using CellType = cell::CellType;
+
+    // A cell found by a query, and its squared distance around the board
+    class Hit {
+        public:
+            UVec2 position = UVec2::Zero();
+            uint32_t distance2 = NONE;
+
+            static constexpr uint32_t NONE = 0xffffffffu;
+
+            bool is_valid () const {return NONE != distance2;}
+    };
+
+
+    // Where the food and the organisms are, bucketed on a uniform grid of
+    //  square buckets. Boards only build it for a consumer that queries it,
+    //  then update it on every write.
+    //
+    // Each bucket keeps its cells in a list of its own, so the index grows
+    //  with the amount of food and organisms rather than with the board,
+    //  and a cell leaves its bucket by a scan of that short list. Queries
+    //  walk the buckets in rings around the position and skip the ones
+    //  farther than the radius or than the k-th cell found so far.
+    class SpatialIndex {
+        public:
+            SpatialIndex () {}
+
+            SpatialIndex (const UVec2 index_dimensions, const unsigned index_bucket_size) :
+                dimensions(index_dimensions),
+                bucket_size(index_bucket_size),
+                buckets_x((index_dimensions.x() + index_bucket_size - 1) / index_bucket_size),
+                buckets_y((index_dimensions.y() + index_bucket_size - 1) / index_bucket_size)
+            {
+                if (0xffffu < index_dimensions.x() || 0xffffu < index_dimensions.y()) {
+                    throw std::invalid_argument("The spatial index only holds boards up to 65535 cells wide and high");
+                }
+
+                for (auto& list : lists) list.assign(get_bucket_count(), std::vector<uint32_t>());
+            }
+
+            ~SpatialIndex () {}
+
+            // Whether it was built, an empty index ignores every update
+            bool is_valid () const {return 0 < buckets_x;}
+
+            // A cell went from one type to another
+            void update (const UVec2 p, const CellType from, const CellType to) {
+                if (from == to || !is_valid()) return;
+
+                if (is_indexed(from)) erase(list_of(from), p);
+                if (is_indexed(to)) insert(list_of(to), p);
+            }
+
+            /**
+            * @brief The k cells of a type nearest to a position.
+            * @param radius Cells farther than this are ignored.
+            * @param out Up to k hits, nearest first, ties in row major order.
+            *  The position itself counts, at distance 0.
+            * @param ready Called as ready(bucket) before a bucket is read,
+            *  so the board can catch it up.
+            */
+            template <typename F>
+            void nearest (
+                const CellType type,
+                const UVec2 position,
+                const unsigned radius,
+                const size_t k,
+                std::vector<Hit>& out,
+                F&& ready
+            ) const {
+                out.clear();
+                if (0 == k || !is_indexed(type) || !is_valid()) return;
+
+                const size_t t = list_of(type);
+                const uint64_t radius2 = static_cast<uint64_t>(radius) * radius;
+
+                visit_buckets(position, radius, [&](const size_t bucket, const uint64_t box2) {
+                    if (box2 > radius2) return;
+                    if (k == out.size() && box2 > out.back().distance2) return;
+
+                    ready(bucket);
+                    for (const uint32_t bits : lists[t][bucket]) {
+                        const UVec2 c = unpack(bits);
+                        const uint64_t d2 = distance2(position, c);
+                        if (d2 > radius2) continue;
+
+                        Hit hit;
+                        hit.position = c;
+                        hit.distance2 = static_cast<uint32_t>(d2);
+                        keep(out, hit, k);
+                    }
+                });
+            }
+
+            /**
+            * @brief Every cell of a type within a radius, in no given order.
+            */
+            template <typename F>
+            void within (
+                const CellType type,
+                const UVec2 position,
+                const unsigned radius,
+                std::vector<Hit>& out,
+                F&& ready
+            ) const {
+                out.clear();
+                if (!is_indexed(type) || !is_valid()) return;
+
+                const size_t t = list_of(type);
+                const uint64_t radius2 = static_cast<uint64_t>(radius) * radius;
+
+                visit_buckets(position, radius, [&](const size_t bucket, const uint64_t box2) {
+                    if (box2 > radius2) return;
+
+                    ready(bucket);
+                    for (const uint32_t bits : lists[t][bucket]) {
+                        const UVec2 c = unpack(bits);
+                        const uint64_t d2 = distance2(position, c);
+                        if (d2 > radius2) continue;
+
+                        Hit hit;
+                        hit.position = c;
+                        hit.distance2 = static_cast<uint32_t>(d2);
+                        out.push_back(hit);
+                    }
+                });
+            }
+
+            /**
+            * @brief nearest for many positions at once.
+            * @param positions Wrapped positions.
+            * @param out k hits per position, position i at i * k, padded
+            *  with invalid hits.
+            *
+            * Positions are grouped by bucket. The cells within the radius of
+            *  a bucket are gathered once for its whole group, so buckets are
+            *  walked and caught up once per group instead of per position.
+            */
+            template <typename F>
+            void nearest_batch (
+                const CellType type,
+                const std::vector<UVec2>& positions,
+                const unsigned radius,
+                const size_t k,
+                std::vector<Hit>& out,
+                F&& ready
+            ) const {
+                out.assign(positions.size() * k, Hit());
+                if (0 == k || positions.empty() || !is_indexed(type) || !is_valid()) return;
+
+                const size_t t = list_of(type);
+                const uint64_t radius2 = static_cast<uint64_t>(radius) * radius;
+
+                // Counting sort of the positions by bucket
+                starts.assign(get_bucket_count() + 1, 0);
+                for (const UVec2& p : positions) starts[bucket_of(p) + 1] += 1;
+                for (size_t b = 1; b < starts.size(); b++) starts[b] += starts[b - 1];
+
+                order.resize(positions.size());
+                for (size_t i = 0; i < positions.size(); i++) order[starts[bucket_of(positions[i])]++] = static_cast<uint32_t>(i);
+
+                std::vector<Hit> hits;
+                size_t first = 0;
+                while (first < order.size()) {
+                    const size_t group = bucket_of(positions[order[first]]);
+                    size_t last = first;
+                    while (last < order.size() && bucket_of(positions[order[last]]) == group) last += 1;
+
+                    gather(t, group, radius, ready);
+
+                    for (size_t g = first; g < last; g++) {
+                        const uint32_t i = order[g];
+                        hits.clear();
+                        for (const uint32_t bits : candidates) {
+                            const UVec2 c = unpack(bits);
+                            const uint64_t d2 = distance2(positions[i], c);
+                            if (d2 > radius2) continue;
+
+                            Hit hit;
+                            hit.position = c;
+                            hit.distance2 = static_cast<uint32_t>(d2);
+                            keep(hits, hit, k);
+                        }
+                        std::copy(hits.begin(), hits.end(), out.begin() + static_cast<size_t>(i) * k);
+                    }
+
+                    first = last;
+                }
+            }
+
+            size_t bucket_of (const UVec2 p) const {
+                return static_cast<size_t>(p.y() / bucket_size) * buckets_x + p.x() / bucket_size;
+            }
+
+            uint32_t get_size (const CellType type, const size_t bucket) const {
+                return (is_indexed(type) && is_valid()) ? static_cast<uint32_t>(lists[list_of(type)][bucket].size()) : 0;
+            }
+
+            size_t get_bucket_count () const {return static_cast<size_t>(buckets_x) * buckets_y;}
+            unsigned get_bucket_size () const {return bucket_size;}
+
+        private:
+            UVec2 dimensions = UVec2::Zero();
+            unsigned bucket_size = 1;
+            unsigned buckets_x = 0;
+            unsigned buckets_y = 0;
+
+            // Food and organisms of each bucket, x | y << 16 per cell
+            std::array<std::vector<std::vector<uint32_t>>, 2> lists;
+
+            // Scratch of nearest_batch
+            mutable std::vector<uint32_t> starts;
+            mutable std::vector<uint32_t> order;
+            mutable std::vector<uint32_t> candidates;
+
+            static bool is_indexed (const CellType type) {
+                return CellType::Food == type || CellType::Organism == type;
+            }
+
+            static size_t list_of (const CellType type) {return CellType::Food == type ? 0 : 1;}
+
+            static uint32_t pack (const UVec2 p) {return p.x() | (p.y() << 16);}
+            static UVec2 unpack (const uint32_t bits) {return UVec2(bits & 0xffffu, bits >> 16);}
+
+            void insert (const size_t t, const UVec2 p) {
+                lists[t][bucket_of(p)].push_back(pack(p));
+            }
+
+            // Moves the last cell of the bucket into the freed place
+            void erase (const size_t t, const UVec2 p) {
+                std::vector<uint32_t>& cells = lists[t][bucket_of(p)];
+                const auto found = std::find(cells.begin(), cells.end(), pack(p));
+                if (cells.end() == found) return;
+
+                *found = cells.back();
+                cells.pop_back();
+            }
+
+            // Distance along one axis of size n, going the short way around
+            static unsigned wrapped (const unsigned a, const unsigned b, const unsigned n) {
+                const unsigned d = a > b ? a - b : b - a;
+                return std::min(d, n - d);
+            }
+
+            uint64_t distance2 (const UVec2 a, const UVec2 b) const {
+                const uint64_t dx = wrapped(a.x(), b.x(), dimensions.x());
+                const uint64_t dy = wrapped(a.y(), b.y(), dimensions.y());
+                return dx * dx + dy * dy;
+            }
+
+            // Distance along one axis from a to the cells first to last
+            static unsigned to_span (const unsigned a, const unsigned first, const unsigned last, const unsigned n) {
+                if (first <= a && a <= last) return 0;
+                return std::min(wrapped(a, first, n), wrapped(a, last, n));
+            }
+
+            // Cells of list t close enough to the bucket that one of its
+            //  positions may find them within the radius
+            template <typename F>
+            void gather (const size_t t, const size_t bucket, const unsigned radius, F&& ready) const {
+                const unsigned x0 = static_cast<unsigned>(bucket % buckets_x) * bucket_size;
+                const unsigned y0 = static_cast<unsigned>(bucket / buckets_x) * bucket_size;
+                const unsigned x1 = std::min(x0 + bucket_size, dimensions.x()) - 1;
+                const unsigned y1 = std::min(y0 + bucket_size, dimensions.y()) - 1;
+
+                // Buckets are visited in square rings, so reaching a side
+                //  farther than the radius from the middle covers every
+                //  bucket within the radius of this one
+                const UVec2 middle ((x0 + x1) / 2, (y0 + y1) / 2);
+                const unsigned reach = radius + std::max(x1 - x0, y1 - y0);
+
+                candidates.clear();
+                visit_buckets(middle, reach, [&](const size_t other, uint64_t) {
+                    if (lists[t][other].empty()) return;
+
+                    ready(other);
+                    for (const uint32_t bits : lists[t][other]) {
+                        const UVec2 c = unpack(bits);
+                        if (to_span(c.x(), x0, x1, dimensions.x()) > radius) continue;
+                        if (to_span(c.y(), y0, y1, dimensions.y()) > radius) continue;
+                        candidates.push_back(bits);
+                    }
+                });
+            }
+
+            // Inserts the hit in the sorted hits, keeping the k nearest
+            static void keep (std::vector<Hit>& out, const Hit& hit, const size_t k) {
+                auto before = [](const Hit& a, const Hit& b) {
+                    if (a.distance2 != b.distance2) return a.distance2 < b.distance2;
+                    if (a.position.y() != b.position.y()) return a.position.y() < b.position.y();
+                    return a.position.x() < b.position.x();
+                };
+
+                if (k == out.size()) {
+                    if (!before(hit, out.back())) return;
+                    out.pop_back();
+                }
+                out.insert(std::upper_bound(out.begin(), out.end(), hit, before), hit);
+            }
+
+            // Bucket offsets along an axis of count buckets, each bucket
+            //  reached once whichever way around is shorter
+            static int lowest_offset (const unsigned count) {return -static_cast<int>((count - 1) / 2);}
+            static int highest_offset (const unsigned count) {return static_cast<int>(count - 1 - (count - 1) / 2);}
+
+            // Calls fn(bucket, squared distance to its nearest cell) for the
+            //  buckets that may hold cells within the radius, ring by ring
+            //  around the one holding the position
+            template <typename F>
+            void visit_buckets (const UVec2 position, const unsigned radius, F&& fn) const {
+                const int bx = static_cast<int>(position.x() / bucket_size);
+                const int by = static_cast<int>(position.y() / bucket_size);
+
+                const int lo_x = lowest_offset(buckets_x), hi_x = highest_offset(buckets_x);
+                const int lo_y = lowest_offset(buckets_y), hi_y = highest_offset(buckets_y);
+
+                // One ring more than the radius spans, for the narrower last
+                //  bucket of each axis which wrapping may cross
+                const int reach = static_cast<int>(radius / bucket_size) + 2;
+                const int rings = std::min(reach, std::max(std::max(-lo_x, hi_x), std::max(-lo_y, hi_y)));
+
+                auto bucket = [&](const int ox, const int oy) {
+                    const unsigned x = static_cast<unsigned>((bx + ox + static_cast<int>(buckets_x)) % static_cast<int>(buckets_x));
+                    const unsigned y = static_cast<unsigned>((by + oy + static_cast<int>(buckets_y)) % static_cast<int>(buckets_y));
+
+                    const unsigned x0 = x * bucket_size, y0 = y * bucket_size;
+                    const uint64_t dx = to_span(position.x(), x0, std::min(x0 + bucket_size, dimensions.x()) - 1, dimensions.x());
+                    const uint64_t dy = to_span(position.y(), y0, std::min(y0 + bucket_size, dimensions.y()) - 1, dimensions.y());
+
+                    fn(static_cast<size_t>(y) * buckets_x + x, dx * dx + dy * dy);
+                };
+
+                for (int ring = 0; ring <= rings; ring++) {
+                    const int x_first = std::max(-ring, lo_x), x_last = std::min(ring, hi_x);
+                    const int y_first = std::max(-ring, lo_y), y_last = std::min(ring, hi_y);
+
+                    for (int oy = y_first; oy <= y_last; oy++) {
+                        if (ring == oy || -ring == oy) {
+                            for (int ox = x_first; ox <= x_last; ox++) bucket(ox, oy);
+                        } else {
+                            if (-ring == x_first) bucket(-ring, oy);
+                            if (ring == x_last && 0 < ring) bucket(ring, oy);
+                        }
+                    }
+                }
+            }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,145 @@
+#pragma once
+
+
+#include <array>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <cstdint>
+#include <algorithm>
+
+#include "Sim/Board/Cell.hpp"
+
+
+namespace stats {
+    using CellType = cell::CellType;
+
+    // Cell counts of a board, in total and per region, updated by the board
+    //  on every write instead of being recounted.
+    //
+    // Heatmaps integrate the food and organisms of each region over time:
+    //  a region only adds its count times the generations since its last
+    //  change, so nothing is done for regions that do not change.
+    class BoardStats {
+        public:
+            BoardStats () {}
+
+            BoardStats (const size_t cell_count, const size_t region_count) :
+                food(region_count, 0),
+                organisms(region_count, 0),
+                food_area(region_count, 0),
+                organism_area(region_count, 0),
+                since(region_count, 0)
+            {
+                counts.fill(0);
+                counts[static_cast<size_t>(CellType::Empty)] = cell_count;
+            }
+
+            ~BoardStats () {}
+
+            // A cell of the region went from one type to another
+            void record (const size_t region, const CellType from, const CellType to, const uint64_t generation) {
+                if (from == to) return;
+
+                counts[static_cast<size_t>(from)] -= 1;
+                counts[static_cast<size_t>(to)] += 1;
+
+                const bool food_changed = CellType::Food == from || CellType::Food == to;
+                const bool organisms_changed = CellType::Organism == from || CellType::Organism == to;
+                if (!food_changed && !organisms_changed) return;
+
+                integrate(region, generation);
+                if (CellType::Food == from) food[region] -= 1;
+                if (CellType::Food == to) food[region] += 1;
+                if (CellType::Organism == from) organisms[region] -= 1;
+                if (CellType::Organism == to) organisms[region] += 1;
+            }
+
+            uint64_t get_count (const CellType type) const {return counts[static_cast<size_t>(type)];}
+            size_t get_region_count () const {return food.size();}
+            uint32_t get_food (const size_t region) const {return food[region];}
+            uint32_t get_organisms (const size_t region) const {return organisms[region];}
+
+            // Food of the region summed over every generation up to now
+            uint64_t get_food_heat (const size_t region, const uint64_t generation) const {
+                return food_area[region] + static_cast<uint64_t>(food[region]) * elapsed(region, generation);
+            }
+
+            uint64_t get_organism_heat (const size_t region, const uint64_t generation) const {
+                return organism_area[region] + static_cast<uint64_t>(organisms[region]) * elapsed(region, generation);
+            }
+
+        private:
+            std::array<uint64_t, 4> counts {};
+            std::vector<uint32_t> food;
+            std::vector<uint32_t> organisms;
+            std::vector<uint64_t> food_area;
+            std::vector<uint64_t> organism_area;
+            std::vector<uint64_t> since;
+
+            uint64_t elapsed (const size_t region, const uint64_t generation) const {
+                return generation > since[region] ? generation - since[region] : 0;
+            }
+
+            void integrate (const size_t region, const uint64_t generation) {
+                const uint64_t dt = elapsed(region, generation);
+                food_area[region] += static_cast<uint64_t>(food[region]) * dt;
+                organism_area[region] += static_cast<uint64_t>(organisms[region]) * dt;
+                since[region] = std::max(since[region], generation);
+            }
+    };
+
+
+    // The figures of a dish at one generation. Heatmaps are one value per
+    //  region, row major over regions_x columns.
+    class Snapshot {
+        public:
+            uint64_t generation = 0;
+            std::array<uint64_t, 4> counts {};
+            uint64_t births = 0;
+            uint64_t deaths = 0;
+
+            unsigned regions_x = 0;
+            unsigned regions_y = 0;
+
+            // Food per cell of each region now, and averaged over the run
+            std::vector<float> food_density;
+            std::vector<float> food_heat;
+
+            // Organisms per cell of each region, averaged over the run
+            std::vector<float> organism_heat;
+
+            uint64_t get_count (const CellType type) const {return counts[static_cast<size_t>(type)];}
+
+            std::string to_jsonl (const bool heatmaps) const {
+                std::stringstream ss;
+                ss << "{\"generation\":" << generation
+                    << ",\"empty\":" << get_count(CellType::Empty)
+                    << ",\"walls\":" << get_count(CellType::Wall)
+                    << ",\"food\":" << get_count(CellType::Food)
+                    << ",\"organisms\":" << get_count(CellType::Organism)
+                    << ",\"births\":" << births
+                    << ",\"deaths\":" << deaths;
+
+                if (heatmaps) {
+                    ss << ",\"regions_x\":" << regions_x
+                        << ",\"regions_y\":" << regions_y
+                        << std::setprecision(4);
+                    write_array(ss, "food_density", food_density);
+                    write_array(ss, "food_heat", food_heat);
+                    write_array(ss, "organism_heat", organism_heat);
+                }
+
+                ss << "}";
+                return ss.str();
+            }
+
+        private:
+            static void write_array (std::stringstream& ss, const char* name, const std::vector<float>& values) {
+                ss << ",\"" << name << "\":[";
+                for (size_t i = 0; i < values.size(); i++) ss << (0 < i ? "," : "") << values[i];
+                ss << "]";
+            }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,421 @@
+#pragma once
+
+
+#include <vector>
+#include <array>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <mutex>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+#include "Sim/sim_constants.hpp"
+#include "utils/Vec.hpp"
+#include "utils/ThreadPool.hpp"
+#include "utils/Hash.hpp"
+#include "utils/Cpu.hpp"
+
+
+namespace walls {
+    using ThreadPool = pool::ThreadPool;
+    using wall_mask = std::vector<uint8_t>;
+
+    class WallParams {
+        public:
+            // Share of the board covered by walls
+            float factor = sim::PROCEDURAL_WALLS_FACTOR;
+
+            // Size (in cells) of the biggest noise features
+            unsigned scale = 32;
+            unsigned octaves = 3;
+
+            // Majority rule passes run after thresholding to round the caves
+            unsigned smoothing = 2;
+    };
+
+
+    // Generates cave-like walls by thresholding tileable value noise at the
+    //  quantile that leaves `factor` of the cells as walls, then smoothing
+    //  them with a cellular automaton. Masks are cached on disk by seed,
+    //  dimensions and parameters, so later runs just load them.
+    class WallGenerator {
+        public:
+            WallGenerator (const WallParams wall_params) : params(wall_params) {}
+            ~WallGenerator () {}
+
+            wall_mask load_or_generate (const UVec2 dimensions, const uint64_t seed) {
+                const std::string path = cache_path(dimensions, seed);
+
+                wall_mask mask;
+                if (load(path, dimensions, seed, mask)) return mask;
+
+                mask = generate(dimensions, seed);
+                store(path, dimensions, seed, mask);
+                return mask;
+            }
+
+            wall_mask generate (const UVec2 dimensions, const uint64_t seed) {
+                const unsigned w = dimensions.x();
+                const unsigned h = dimensions.y();
+                ThreadPool& pool = ThreadPool::instance();
+
+                wall_mask mask(static_cast<size_t>(w) * h, 0);
+                if (0 == mask.size() || 0.0f >= params.factor) return mask;
+
+                // Noise pass, keeping a histogram to find the threshold
+                const std::vector<Octave> octaves = make_octaves(dimensions);
+                std::vector<float> noise(mask.size());
+                std::array<size_t, HISTOGRAM_BINS> histogram {};
+                std::mutex histogram_mutex;
+
+                pool.parallel_for(0, h, sim::FIELD_TILE_ROWS, [&](size_t begin, size_t end) {
+                    std::array<size_t, HISTOGRAM_BINS> local {};
+                    std::vector<float> row_a, row_b;
+
+                    for (size_t y = begin; y < end; y++) {
+                        float* row = &noise[y * w];
+                        noise_row(row, row_a, row_b, octaves, static_cast<unsigned>(y), dimensions, seed);
+
+                        for (unsigned x = 0; x < w; x++) local[bin(row[x])] += 1;
+                    }
+
+                    std::lock_guard<std::mutex> lock (histogram_mutex);
+                    for (size_t i = 0; i < HISTOGRAM_BINS; i++) histogram[i] += local[i];
+                });
+
+                const size_t target = static_cast<size_t>(
+                    std::min(1.0f, params.factor) * static_cast<float>(mask.size())
+                );
+
+                size_t covered = 0;
+                size_t threshold = HISTOGRAM_BINS;
+                while (0 < threshold && covered + histogram[threshold - 1] <= target) {
+                    threshold -= 1;
+                    covered += histogram[threshold];
+                }
+
+                pool.parallel_for(0, h, sim::FIELD_TILE_ROWS, [&](size_t begin, size_t end) {
+                    for (size_t i = begin * w; i < end * w; i++) {
+                        mask[i] = bin(noise[i]) >= threshold;
+                    }
+                });
+
+                // Smoothing passes
+                wall_mask back(mask.size());
+                for (unsigned pass = 0; pass < params.smoothing; pass++) {
+                    pool.parallel_for(0, h, sim::FIELD_TILE_ROWS, [&](size_t begin, size_t end) {
+                        for (size_t y = begin; y < end; y++) smooth_row(mask, back, dimensions, y);
+                    });
+
+                    std::swap(mask, back);
+                }
+
+                return mask;
+            }
+
+        private:
+            static constexpr size_t HISTOGRAM_BINS = 1024;
+            static constexpr uint64_t CACHE_MAGIC = 0x31534c4c4157ull; // "WALLS1"
+
+            WallParams params;
+
+            // The columns of an octave: which lattice cell each x falls in
+            //  and where in it, the same for every row
+            struct Octave {
+                unsigned cells_x = 1;
+                unsigned cells_y = 1;
+                std::vector<unsigned> starts;
+                std::vector<float> fx;
+            };
+
+            static size_t bin (const float v) {
+                return std::min(HISTOGRAM_BINS - 1, static_cast<size_t>(v * HISTOGRAM_BINS));
+            }
+
+            static float lattice (
+                const uint64_t seed,
+                const unsigned octave,
+                const unsigned ix,
+                const unsigned iy
+            ) {
+                uint64_t z = hash::combine(seed, (uint64_t(octave) << 56) ^ (uint64_t(iy) << 28) ^ ix);
+                return static_cast<float>(z >> 40) / static_cast<float>(1ull << 24);
+            }
+
+            static float smooth (const float t) {return t * t * (3.0f - 2.0f * t);}
+
+            std::vector<Octave> make_octaves (const UVec2 dimensions) const {
+                const unsigned w = dimensions.x();
+                const unsigned h = dimensions.y();
+
+                std::vector<Octave> octaves (std::max(1u, params.octaves));
+                unsigned scale = std::max(1u, params.scale);
+
+                for (Octave& o : octaves) {
+                    o.cells_x = std::max(1u, (w + scale / 2) / scale);
+                    o.cells_y = std::max(1u, (h + scale / 2) / scale);
+                    o.starts.assign(o.cells_x + 1, w);
+                    o.fx.resize(w);
+
+                    const float step = static_cast<float>(o.cells_x) / static_cast<float>(w);
+                    for (unsigned x = w; 0 < x; x--) {
+                        const float u = static_cast<float>(x - 1) * step;
+                        const unsigned ix = std::min(o.cells_x - 1, static_cast<unsigned>(u));
+                        o.fx[x - 1] = smooth(u - static_cast<float>(ix));
+                        o.starts[ix] = x - 1;
+                    }
+
+                    // Lattice cells no column falls in start where the next one does
+                    for (unsigned ix = o.cells_x; 0 < ix; ix--) {
+                        o.starts[ix - 1] = std::min(o.starts[ix - 1], o.starts[ix]);
+                    }
+
+                    scale = std::max(1u, scale / 2);
+                }
+
+                return octaves;
+            }
+
+            // Fills a row with octaves of value noise. The lattice of each
+            //  octave has a whole amount of cells per axis, so it wraps
+            //  around like the board. Within a lattice cell only fx changes
+            //  along the row, so each cell is one vector loop.
+            void noise_row (
+                float* row,
+                std::vector<float>& lattice_a,
+                std::vector<float>& lattice_b,
+                const std::vector<Octave>& octaves,
+                const unsigned y,
+                const UVec2 dimensions,
+                const uint64_t seed
+            ) const {
+                const unsigned w = dimensions.x();
+                const unsigned h = dimensions.y();
+
+                std::fill(row, row + w, 0.0f);
+
+                float amplitude = 1.0f;
+                float total = 0.0f;
+
+                #if defined(__SSE2__)
+                    const bool sse2 = cpu::Isa::Sse2 <= cpu::level();
+                #endif
+
+                for (unsigned octave = 0; octave < octaves.size(); octave++) {
+                    const Octave& o = octaves[octave];
+
+                    const float v = static_cast<float>(y) * o.cells_y / static_cast<float>(h);
+                    const unsigned iy = static_cast<unsigned>(v);
+                    const float fy = smooth(v - static_cast<float>(iy));
+
+                    // Both lattice rows around y, with the wrapped column at the end
+                    lattice_a.resize(o.cells_x + 1);
+                    lattice_b.resize(o.cells_x + 1);
+                    for (unsigned ix = 0; ix <= o.cells_x; ix++) {
+                        lattice_a[ix] = lattice(seed, octave, ix % o.cells_x, iy % o.cells_y);
+                        lattice_b[ix] = lattice(seed, octave, ix % o.cells_x, (iy + 1) % o.cells_y);
+                    }
+
+                    for (unsigned ix = 0; ix < o.cells_x; ix++) {
+                        const float a = lattice_a[ix];
+                        const float da = lattice_a[ix + 1] - lattice_a[ix];
+                        const float b = lattice_b[ix];
+                        const float db = lattice_b[ix + 1] - lattice_b[ix];
+
+                        unsigned x = o.starts[ix];
+                        const unsigned end = o.starts[ix + 1];
+
+                        #if defined(__SSE2__)
+                            const __m128 va = _mm_set1_ps(a), vda = _mm_set1_ps(da);
+                            const __m128 vb = _mm_set1_ps(b), vdb = _mm_set1_ps(db);
+                            const __m128 vfy = _mm_set1_ps(fy), vamplitude = _mm_set1_ps(amplitude);
+
+                            for (; sse2 && x + 4 <= end; x += 4) {
+                                const __m128 fx = _mm_loadu_ps(&o.fx[x]);
+                                const __m128 top = _mm_add_ps(va, _mm_mul_ps(fx, vda));
+                                const __m128 bottom = _mm_add_ps(vb, _mm_mul_ps(fx, vdb));
+                                const __m128 value = _mm_add_ps(top, _mm_mul_ps(vfy, _mm_sub_ps(bottom, top)));
+                                _mm_storeu_ps(row + x, _mm_add_ps(_mm_loadu_ps(row + x), _mm_mul_ps(vamplitude, value)));
+                            }
+                        #endif
+
+                        for (; x < end; x++) {
+                            const float top = a + o.fx[x] * da;
+                            const float bottom = b + o.fx[x] * db;
+                            row[x] += amplitude * (top + fy * (bottom - top));
+                        }
+                    }
+
+                    total += amplitude;
+                    amplitude *= 0.5f;
+                }
+
+                const float inv_total = 1.0f / total;
+                for (unsigned x = 0; x < w; x++) row[x] *= inv_total;
+            }
+
+            static void smooth_row (
+                const wall_mask& src,
+                wall_mask& dst,
+                const UVec2 dimensions,
+                const size_t y
+            ) {
+                const unsigned w = dimensions.x();
+                const unsigned h = dimensions.y();
+
+                const uint8_t* up = &src[((0 == y ? h : y) - 1) * w];
+                const uint8_t* mid = &src[y * w];
+                const uint8_t* down = &src[(h - 1 == y ? 0 : y + 1) * w];
+                uint8_t* out = &dst[y * w];
+
+                auto cell = [&](const unsigned x) {
+                    const unsigned l = (0 == x ? w : x) - 1;
+                    const unsigned r = (w - 1 == x ? 0 : x + 1);
+
+                    const unsigned n = up[l] + up[x] + up[r]
+                        + mid[l] + mid[r]
+                        + down[l] + down[x] + down[r];
+
+                    out[x] = (4 < n) ? 1 : ((4 > n) ? 0 : mid[x]);
+                };
+
+                // The columns that wrap around are done one by one
+                unsigned x = 1;
+                if (0 < w) cell(0);
+
+                #if defined(__SSE2__)
+                if (cpu::Isa::Sse2 <= cpu::level()) {
+                    const __m128i four = _mm_set1_epi8(4);
+                    const __m128i one = _mm_set1_epi8(1);
+
+                    // Cells are 0 or 1, so 8 neighbors add up within a byte
+                    for (; x + 17 <= w; x += 16) {
+                        auto sum3 = [x](const uint8_t* row) {
+                            return _mm_add_epi8(
+                                _mm_add_epi8(
+                                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1)),
+                                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x))
+                                ),
+                                _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 1))
+                            );
+                        };
+
+                        const __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mid + x));
+                        const __m128i n = _mm_sub_epi8(_mm_add_epi8(_mm_add_epi8(sum3(up), sum3(mid)), sum3(down)), center);
+
+                        const __m128i more = _mm_and_si128(_mm_cmpgt_epi8(n, four), one);
+                        const __m128i tie = _mm_and_si128(_mm_cmpeq_epi8(n, four), center);
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_or_si128(more, tie));
+                    }
+                }
+                #endif
+
+                for (; x < w; x++) cell(x);
+            }
+
+            std::string cache_path (const UVec2 dimensions, const uint64_t seed) const {
+                uint64_t key = hash::mix(seed);
+                key = hash::mix(key ^ dimensions.x());
+                key = hash::mix(key ^ dimensions.y());
+                key = hash::mix(key ^ static_cast<uint64_t>(params.factor * 1e6f));
+                key = hash::mix(key ^ params.scale);
+                key = hash::mix(key ^ params.octaves);
+                key = hash::mix(key ^ params.smoothing);
+
+                char name[32];
+                std::snprintf(name, sizeof(name), "%016llx.walls", static_cast<unsigned long long>(key));
+                return std::string(sim::WALLS_CACHE_DIR) + "/" + name;
+            }
+
+            // The file holds a header with everything the key was made of,
+            //  followed by the mask packed at 1 bit per cell.
+            void header (uint64_t (&out)[8], const UVec2 dimensions, const uint64_t seed) const {
+                out[0] = CACHE_MAGIC;
+                out[1] = seed;
+                out[2] = dimensions.x();
+                out[3] = dimensions.y();
+                out[4] = static_cast<uint64_t>(params.factor * 1e6f);
+                out[5] = params.scale;
+                out[6] = params.octaves;
+                out[7] = params.smoothing;
+            }
+
+            bool load (
+                const std::string& path,
+                const UVec2 dimensions,
+                const uint64_t seed,
+                wall_mask& mask
+            ) const {
+                std::FILE* file = std::fopen(path.c_str(), "rb");
+                if (nullptr == file) return false;
+
+                uint64_t expected[8], found[8];
+                header(expected, dimensions, seed);
+
+                const size_t cells = static_cast<size_t>(dimensions.x()) * dimensions.y();
+                std::vector<uint8_t> packed((cells + 7) / 8);
+
+                bool ok = (
+                    1 == std::fread(found, sizeof(found), 1, file)
+                    && 0 == std::memcmp(found, expected, sizeof(found))
+                    && packed.size() == std::fread(packed.data(), 1, packed.size(), file)
+                );
+                std::fclose(file);
+
+                if (!ok) return false;
+
+                mask.resize(cells);
+                ThreadPool::instance().parallel_for(0, packed.size(), 1 << 16, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++) {
+                        const size_t base = i * 8;
+                        const size_t bits = std::min<size_t>(8, cells - base);
+                        for (size_t b = 0; b < bits; b++) mask[base + b] = (packed[i] >> b) & 1;
+                    }
+                });
+
+                return true;
+            }
+
+            void store (
+                const std::string& path,
+                const UVec2 dimensions,
+                const uint64_t seed,
+                const wall_mask& mask
+            ) const {
+                std::error_code error;
+                std::filesystem::create_directories(sim::WALLS_CACHE_DIR, error);
+                if (error) return;
+
+                std::vector<uint8_t> packed((mask.size() + 7) / 8, 0);
+                for (size_t i = 0; i < mask.size(); i++) packed[i / 8] |= mask[i] << (i % 8);
+
+                uint64_t head[8];
+                header(head, dimensions, seed);
+
+                // Written aside and renamed so a concurrent run never reads half a file
+                const std::string temp_path = path + ".tmp"
+                    + std::to_string(getpid()) + "_"
+                    + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+                std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+                if (nullptr == file) return;
+
+                bool ok = (
+                    1 == std::fwrite(head, sizeof(head), 1, file)
+                    && packed.size() == std::fwrite(packed.data(), 1, packed.size(), file)
+                );
+                ok = (0 == std::fclose(file)) && ok;
+
+                if (ok) std::filesystem::rename(temp_path, path, error);
+                else std::filesystem::remove(temp_path, error);
+            }
+    };
+}
@@ -0,0 +1,780 @@
+#pragma once
+
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <type_traits>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "Sim/sim_constants.hpp"
+#include "Sim/Board/Cell.hpp"
+#include "utils/Hash.hpp"
+#include "utils/Vec.hpp"
+
+
+namespace checkpoint {
+    class CheckpointParams {
+        public:
+            std::string directory = sim::CHECKPOINT_DIR;
+
+            // Files are named PREFIX_GENERATION.bin
+            std::string prefix = "checkpoint";
+
+            // Generations between two checkpoints
+            uint64_t every = 10000;
+
+            // The newest keep_last checkpoints are kept, plus every
+            //  keep_every-th one for good when keep_every is set
+            unsigned keep_last = 3;
+            unsigned keep_every = 0;
+    };
+
+    // A checkpoint holds, in native byte order:
+    //
+    //   FILE_MAGIC, generation u64, dish count u32, 0 u32
+    //   then for each dish:
+    //     DISH_MAGIC u32, width u32, height u32, field count u32
+    //     tick u64, board hash u64, organisms u64, species u32, weights u32
+    //     layout u32, storage cells u64, regions u32, pending events u32
+    //     state      epoch generation u64, next organism id u64, next
+    //                genome u64, epochs u64, events tick u64, then the
+    //                generators of the dish, board, evolution and events,
+    //                each a text length u32 and the text of its operator<<,
+    //                then the simd lanes of evolution 4 u64
+    //     regions    seed u64, draws u64, next food f64, synced generation
+    //                u64, pending u32, organisms u32 each
+    //     events     tick u64, kind u8, x u32, y u32, organism u64 each
+    //     cells      storage cells, 4 bytes each (type, color, dir, amount)
+    //                in the order of the layout: rows, or 8 by 8 tiles in
+    //                Z order padded to whole tiles
+    //     organisms  id u64, position x u32 and y u32, dir u8, energy f32,
+    //                species u32, period u8, each a column of its own
+    //     genomes    species * weights f32, then the genome id u64 and the
+    //                fitness f32 of each
+    //     fields     width * height f32 each
+    //   and last a trailer: content bytes u64, checksum u64
+    //
+    // The checksum folds the content 8 bytes at a time, so a checkpoint cut
+    //  short or damaged is told apart from a whole one.
+    constexpr char FILE_MAGIC[8] = {'W', 'C', 'H', 'K', 'P', 'T', '0', '2'};
+    constexpr uint32_t DISH_MAGIC = 0x48534944u; // "DISH"
+    constexpr uint64_t CHECKSUM_SEED = 0x74706b6863ull;
+
+    // Bytes of one organism over all the organism columns
+    constexpr size_t ORGANISM_BYTES = 8 + 4 + 4 + 1 + 4 + 4 + 1;
+    constexpr size_t REGION_BYTES = 8 + 8 + 8 + 8 + 4 + 4;
+    constexpr size_t EVENT_BYTES = 8 + 1 + 4 + 4 + 8;
+
+    static_assert(4 == sizeof(cell::Cell), "Cells are saved as they are stored");
+    static_assert(8 == sizeof(UVec2), "Positions are saved as they are stored");
+
+    // Folds bytes into a checksum. Only the last call over some content
+    //  may pass a length that is not a multiple of 8.
+    inline uint64_t fold (uint64_t h, const uint8_t* data, const size_t n) {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            h = hash::combine(h, word);
+        }
+
+        if (i < n) {
+            uint64_t word = 0;
+            std::memcpy(&word, data + i, n - i);
+            h = hash::combine(h, word);
+        }
+
+        return h;
+    }
+
+    // Writes all n bytes, through interrupted and partial writes
+    inline bool write_all (const int fd, const void* data, size_t n) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        while (0 < n) {
+            const ssize_t written = ::write(fd, p, n);
+            if (0 > written) {
+                if (EINTR != errno) return false;
+                continue;
+            }
+            p += written;
+            n -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+
+    /**
+    * @brief The content of a checkpoint, laid out before the fork.
+    *
+    * Small values are copied aside as they are put. Large arrays are only
+    *  referred to, and must stay untouched until the fork, which freezes
+    *  them for the snapshot process. That process then only copies, folds
+    *  and writes memory, since a fork of a threaded process may only call
+    *  async signal safe functions: no allocation, no lock, no lazy board.
+    */
+    class Writer {
+        public:
+            Writer () {}
+
+            void bytes (const void* data, const size_t n) {
+                const uint8_t* p = static_cast<const uint8_t*>(data);
+                if (pieces.empty() || nullptr != pieces.back().data) pieces.push_back(Piece {nullptr, staged.size(), 0});
+
+                staged.insert(staged.end(), p, p + n);
+                pieces.back().bytes += n;
+                size += n;
+            }
+
+            template <typename T>
+            void put (const T value) {bytes(&value, sizeof(value));}
+
+            template <typename T>
+            void put_all (const T* values, const size_t n) {bytes(values, n * sizeof(T));}
+
+            // Writes n values from where they are, when the snapshot is taken
+            template <typename T>
+            void refer (const T* values, const size_t n) {
+                if (0 == n) return;
+                pieces.push_back(Piece {reinterpret_cast<const uint8_t*>(values), 0, n * sizeof(T)});
+                size += n * sizeof(T);
+            }
+
+            // Keeps the memory for the next checkpoint
+            void clear () {
+                staged.clear();
+                pieces.clear();
+                size = 0;
+            }
+
+            uint64_t get_size () const {return size;}
+
+            /**
+            * @brief Writes the content and the trailer, and waits for the disk.
+            * @param buffer Scratch allocated beforehand, a multiple of 8
+            *  bytes long, for the checksum.
+            */
+            bool emit (const int fd, uint8_t* buffer, const size_t capacity) const {
+                size_t used = 0;
+                uint64_t written = 0;
+                uint64_t checksum = CHECKSUM_SEED;
+                bool ok = true;
+
+                auto flush = [&] {
+                    checksum = fold(checksum, buffer, used);
+                    ok = ok && write_all(fd, buffer, used);
+                    written += used;
+                    used = 0;
+                };
+
+                for (const Piece& piece : pieces) {
+                    const uint8_t* p = (nullptr != piece.data) ? piece.data : staged.data() + piece.offset;
+                    size_t n = piece.bytes;
+
+                    while (0 < n) {
+                        const size_t take = std::min(n, capacity - used);
+                        std::memcpy(buffer + used, p, take);
+                        used += take;
+                        p += take;
+                        n -= take;
+                        if (capacity == used) flush();
+                    }
+                }
+                flush();
+
+                const uint64_t trailer[2] = {written, checksum};
+                ok = ok && write_all(fd, trailer, sizeof(trailer));
+                return ok && 0 == fsync(fd);
+            }
+
+        private:
+            // Referred memory, or a run of the staged bytes when data is null
+            struct Piece {
+                const uint8_t* data = nullptr;
+                size_t offset = 0;
+                size_t bytes = 0;
+            };
+
+            std::vector<uint8_t> staged;
+            std::vector<Piece> pieces;
+            uint64_t size = 0;
+    };
+
+
+    inline void save_header (Writer& out, const uint64_t generation, const uint32_t dish_count) {
+        out.bytes(FILE_MAGIC, sizeof(FILE_MAGIC));
+        out.put(generation);
+        out.put(dish_count);
+        out.put(uint32_t(0));
+    }
+
+    // A generator as the text of its operator<<, the only portable form
+    inline void save_generator (Writer& out, const std::mt19937_64& generator) {
+        std::ostringstream text;
+        text << generator;
+        const std::string state = text.str();
+
+        out.put(static_cast<uint32_t>(state.size()));
+        out.bytes(state.data(), state.size());
+    }
+
+    // Everything that makes a dish go on from where it is. The board is
+    //  caught up first, then its cells and the organism, genome and field
+    //  columns are referred to where they are.
+    template <typename D>
+    void save_dish (Writer& out, D& dish) {
+        const auto& board = dish.get_board();
+        const auto& population = dish.get_population();
+        const auto& brain = population.get_brain();
+        const auto& evolution = dish.get_evolution();
+        const auto& events = dish.get_events();
+
+        const cell::Cell* cells = board.get_storage();
+        const auto& regions = board.get_regions();
+
+        const UVec2 dims = board.get_dimensions();
+        const size_t n = population.size();
+        const uint32_t species = static_cast<uint32_t>(brain.get_species_count());
+        const uint32_t weights = static_cast<uint32_t>(brain.get_topology().weight_count());
+        const uint64_t storage = board.get_geometry().storage_length();
+        using Geometry = typename std::decay_t<decltype(board)>::Geometry;
+
+        out.put(DISH_MAGIC);
+        out.put(dims.x());
+        out.put(dims.y());
+        out.put(static_cast<uint32_t>(dish.get_field_count()));
+        out.put(dish.get_tick());
+        out.put(board.get_hash());
+        out.put(static_cast<uint64_t>(n));
+        out.put(species);
+        out.put(weights);
+        out.put(static_cast<uint32_t>(Geometry::LAYOUT));
+        out.put(storage);
+        out.put(static_cast<uint32_t>(regions.size()));
+        out.put(static_cast<uint32_t>(events.get_pending()));
+
+        out.put(dish.get_epoch_generation());
+        out.put(population.get_next_id());
+        out.put(evolution.get_next_genome());
+        out.put(evolution.get_epoch_count());
+        out.put(events.get_now());
+        save_generator(out, dish.get_rng_gen());
+        save_generator(out, board.get_rng_gen());
+        save_generator(out, evolution.get_rng_gen());
+        save_generator(out, events.get_rng_gen());
+        const std::array<uint64_t, 4> lanes = evolution.get_simd_rng().get_state();
+        out.put_all(lanes.data(), lanes.size());
+
+        for (const auto& r : regions) {
+            out.put(r.get_seed());
+            out.put(r.get_draws());
+            out.put(r.get_next_food());
+            out.put(r.get_synced_generation());
+            out.put(static_cast<uint32_t>(r.get_pending()));
+            out.put(static_cast<uint32_t>(r.get_organisms()));
+        }
+
+        events.for_each_pending([&](const auto& e, const uint64_t at) {
+            out.put(at);
+            out.put(static_cast<uint8_t>(e.kind));
+            out.put(e.position.x());
+            out.put(e.position.y());
+            out.put(e.organism);
+        });
+
+        out.refer(cells, storage);
+
+        out.refer(population.get_ids().data(), n);
+        out.refer(population.get_positions().data(), n);
+        out.refer(population.get_dirs().data(), n);
+        out.refer(population.get_energies().data(), n);
+        out.refer(population.get_species_of().data(), n);
+        out.refer(population.get_periods().data(), n);
+
+        if (0 < species) out.refer(brain.get_weights(0), static_cast<size_t>(species) * weights);
+        out.refer(evolution.get_genome_ids().data(), species);
+        out.refer(population.get_fitness().data(), std::min<size_t>(species, population.get_fitness().size()));
+        for (size_t s = population.get_fitness().size(); s < species; s++) out.put(0.0f);
+
+        for (size_t f = 0; f < dish.get_field_count(); f++) {
+            out.refer(dish.get_field(f).data(), static_cast<size_t>(dims.x()) * dims.y());
+        }
+    }
+
+
+    // Figures over the checkpoints written so far
+    class Report {
+        public:
+            uint64_t written = 0;
+            uint64_t failed = 0;
+
+            // Not taken because the one before was still being written
+            uint64_t skipped = 0;
+
+            uint64_t last_generation = 0;
+            uint64_t last_bytes = 0;
+            double last_seconds = 0.0;
+
+            // Longest the sim waited for the layout and the fork, all it
+            //  pays up front
+            double max_pause = 0.0;
+
+            uint64_t bytes = 0;
+            double seconds = 0.0;
+
+            // Bytes per second, from the fork to the fsync of each checkpoint
+            double bandwidth () const {return 0.0 < seconds ? static_cast<double>(bytes) / seconds : 0.0;}
+    };
+
+
+    /**
+    * @brief Saves every dish every few generations, without stopping them.
+    *
+    * Capturing lays the checkpoint out in a Writer, then forks the process
+    *  at a generation boundary. The child gets a copy-on-write image of
+    *  the dishes frozen at that generation, and writes, fsyncs and renames
+    *  it into place while the sim goes on, with raw system calls only. A
+    *  fork only copies page tables, so the sim pays for that, for the
+    *  small values copied into the layout and for the pages it writes to
+    *  while the child is alive. A waiter thread
+    *  reaps the child, keeps the figures and prunes old checkpoints. While
+    *  one is being written, the ones falling due are skipped.
+    */
+    class Checkpointer {
+        public:
+            Checkpointer () {}
+
+            Checkpointer (const CheckpointParams checkpoint_params) : params(checkpoint_params) {
+                std::error_code error;
+                std::filesystem::create_directories(params.directory, error);
+                if (error) throw std::runtime_error("Can not create " + params.directory);
+
+                state = std::make_unique<State>();
+                state->params = params;
+                state->buffer.resize(sim::CHECKPOINT_BUFFER);
+
+                State* shared = state.get();
+                state->waiter = std::thread([shared] {wait_loop(*shared);});
+            }
+
+            Checkpointer (const Checkpointer&) = delete;
+            Checkpointer& operator= (const Checkpointer&) = delete;
+
+            Checkpointer& operator= (Checkpointer&& other) {
+                if (this == &other) return *this;
+                stop();
+
+                params = other.params;
+                state = std::move(other.state);
+                return *this;
+            }
+
+            // Waits for the checkpoint being written, if any
+            ~Checkpointer () {stop();}
+
+            bool is_valid () const {return nullptr != state;}
+
+            bool is_due (const uint64_t generation) const {
+                return is_valid() && 0 != params.every && 0 == generation % params.every;
+            }
+
+            /**
+            * @brief Start writing a checkpoint of the current generation.
+            * @param save Called with a Writer before the fork, to lay out
+            *  the header and the dishes.
+            * @return Whether a checkpoint was started.
+            */
+            template <typename F>
+            bool capture (const uint64_t generation, F&& save) {
+                if (!is_valid()) return false;
+
+                if (state->busy.load()) {
+                    std::lock_guard<std::mutex> lock (state->mutex);
+                    state->report.skipped += 1;
+                    return false;
+                }
+
+                Job job;
+                job.generation = generation;
+                job.path = path_of(params, generation);
+                job.start = Clock::now();
+
+                const std::string temp_path = job.path + ".tmp";
+                state->layout.clear();
+                save(state->layout);
+
+                const pid_t pid = fork();
+
+                // Only this thread lives on in the child, maybe while other
+                //  threads held locks, so it sticks to system calls on
+                //  memory set up above and leaves without running the
+                //  destructors and exit handlers of the parent
+                if (0 == pid) {
+                    const bool ok = write_file(job.path.c_str(), temp_path.c_str(), params.directory.c_str(), state->layout, state->buffer);
+                    _exit(ok ? 0 : 1);
+                }
+
+                const double pause = std::chrono::duration<double>(Clock::now() - job.start).count();
+
+                {
+                    std::lock_guard<std::mutex> lock (state->mutex);
+                    state->report.max_pause = std::max(state->report.max_pause, pause);
+                    if (0 > pid) {
+                        state->report.failed += 1;
+                        return false;
+                    }
+
+                    job.pid = pid;
+                    state->job = std::move(job);
+                    state->pending = true;
+                    state->busy = true;
+                }
+                state->wake.notify_one();
+
+                return true;
+            }
+
+            Report get_report () const {
+                if (!is_valid()) return Report();
+
+                std::lock_guard<std::mutex> lock (state->mutex);
+                return state->report;
+            }
+
+            // Waits for the checkpoint being written and stops, returning
+            //  the final figures
+            Report finish () {
+                stop();
+                const Report report = get_report();
+                state.reset();
+                return report;
+            }
+
+            static std::string path_of (const CheckpointParams& params, const uint64_t generation) {
+                char name[32];
+                std::snprintf(name, sizeof(name), "_%010llu.bin", static_cast<unsigned long long>(generation));
+                return params.directory + "/" + params.prefix + name;
+            }
+
+        private:
+            using Clock = std::chrono::steady_clock;
+
+            struct Job {
+                pid_t pid = -1;
+                uint64_t generation = 0;
+                std::string path;
+                Clock::time_point start;
+            };
+
+            // Owned through a pointer, so the waiter keeps it while the
+            //  checkpointer itself moves around
+            struct State {
+                CheckpointParams params;
+                std::thread waiter;
+                std::mutex mutex;
+                std::condition_variable wake;
+                bool stopping = false;
+
+                Job job;
+                bool pending = false;
+                std::atomic<bool> busy {false};
+
+                // Laid out by the sim before each fork, its memory kept
+                Writer layout;
+
+                // Allocated once, and written to by the children only
+                std::vector<uint8_t> buffer;
+
+                Report report;
+            };
+
+            CheckpointParams params;
+            std::unique_ptr<State> state;
+
+            void stop () {
+                if (nullptr == state) return;
+
+                {
+                    std::lock_guard<std::mutex> lock (state->mutex);
+                    state->stopping = true;
+                }
+                state->wake.notify_all();
+                if (state->waiter.joinable()) state->waiter.join();
+            }
+
+            // Written aside and renamed, so a checkpoint is either whole or
+            //  missing. The rename only lasts once the directory is synced.
+            //  Runs in the child, so only async signal safe calls.
+            static bool write_file (
+                const char* path,
+                const char* temp_path,
+                const char* directory,
+                const Writer& layout,
+                std::vector<uint8_t>& buffer
+            ) {
+                const int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (0 > fd) return false;
+
+                bool ok = layout.emit(fd, buffer.data(), buffer.size() & ~size_t(7));
+                ok = (0 == close(fd)) && ok;
+
+                if (!ok || 0 != ::rename(temp_path, path)) {
+                    unlink(temp_path);
+                    return false;
+                }
+
+                const int dir = open(directory, O_RDONLY | O_DIRECTORY);
+                if (0 <= dir) {
+                    fsync(dir);
+                    close(dir);
+                }
+                return true;
+            }
+
+            static void wait_loop (State& s) {
+                while (true) {
+                    Job job;
+
+                    {
+                        std::unique_lock<std::mutex> lock (s.mutex);
+                        s.wake.wait(lock, [&s] {return s.stopping || s.pending;});
+
+                        if (!s.pending) return;
+
+                        job = std::move(s.job);
+                        s.pending = false;
+                    }
+
+                    int status = 0;
+                    pid_t reaped;
+                    do {
+                        reaped = waitpid(job.pid, &status, 0);
+                    } while (0 > reaped && EINTR == errno);
+
+                    const double seconds = std::chrono::duration<double>(Clock::now() - job.start).count();
+                    const bool ok = job.pid == reaped && WIFEXITED(status) && 0 == WEXITSTATUS(status);
+
+                    std::error_code error;
+                    const uint64_t bytes = ok ? std::filesystem::file_size(job.path, error) : 0;
+                    if (ok) prune(s.params);
+
+                    {
+                        std::lock_guard<std::mutex> lock (s.mutex);
+                        if (ok && !error) {
+                            s.report.written += 1;
+                            s.report.last_generation = job.generation;
+                            s.report.last_bytes = bytes;
+                            s.report.last_seconds = seconds;
+                            s.report.bytes += bytes;
+                            s.report.seconds += seconds;
+                        } else {
+                            s.report.failed += 1;
+                        }
+                    }
+                    s.busy = false;
+                }
+            }
+
+            // Keeps the newest keep_last checkpoints, and every keep_every-th
+            static void prune (const CheckpointParams& params) {
+                const std::string head = params.prefix + "_";
+                const std::string tail = ".bin";
+                std::vector<uint64_t> generations;
+
+                std::error_code error;
+                for (const auto& entry : std::filesystem::directory_iterator(params.directory, error)) {
+                    const std::string name = entry.path().filename().string();
+                    if (name.size() <= head.size() + tail.size()) continue;
+                    if (0 != name.compare(0, head.size(), head)) continue;
+                    if (0 != name.compare(name.size() - tail.size(), tail.size(), tail)) continue;
+
+                    const std::string digits = name.substr(head.size(), name.size() - head.size() - tail.size());
+                    if (std::string::npos != digits.find_first_not_of("0123456789")) continue;
+                    generations.push_back(std::stoull(digits));
+                }
+
+                std::sort(generations.begin(), generations.end(), std::greater<uint64_t>());
+
+                for (size_t i = std::max(1u, params.keep_last); i < generations.size(); i++) {
+                    const uint64_t g = generations[i];
+                    if (0 != params.keep_every && 0 != params.every && 0 == (g / params.every) % params.keep_every) continue;
+                    std::filesystem::remove(path_of(params, g), error);
+                }
+            }
+    };
+
+
+    class DishInfo {
+        public:
+            UVec2 dimensions;
+            uint32_t fields = 0;
+            uint64_t tick = 0;
+            uint64_t hash = 0;
+            uint64_t organisms = 0;
+            uint32_t species = 0;
+            uint32_t weights = 0;
+            uint32_t layout = 0;
+            uint64_t storage = 0;
+            uint32_t regions = 0;
+            uint32_t events = 0;
+
+            uint64_t epoch_generation = 0;
+            uint64_t next_genome = 0;
+
+            // Everything after the state and its generators
+            uint64_t body_bytes () const {
+                const uint64_t cells = static_cast<uint64_t>(dimensions.x()) * dimensions.y();
+                return static_cast<uint64_t>(regions) * REGION_BYTES
+                    + static_cast<uint64_t>(events) * EVENT_BYTES
+                    + storage * sizeof(uint32_t)
+                    + organisms * ORGANISM_BYTES
+                    + static_cast<uint64_t>(species) * weights * sizeof(float)
+                    + static_cast<uint64_t>(species) * (sizeof(uint64_t) + sizeof(float))
+                    + fields * cells * sizeof(float);
+            }
+    };
+
+    class CheckpointInfo {
+        public:
+            uint64_t generation = 0;
+            uint64_t bytes = 0;
+            bool intact = false;
+            std::vector<DishInfo> dishes;
+    };
+
+    // Reads the headers of a checkpoint back and checks it is whole
+    inline CheckpointInfo inspect (const std::string& path) {
+        std::ifstream in (path, std::ios::binary | std::ios::ate);
+        if (!in) throw std::runtime_error("Can not open checkpoint " + path);
+
+        CheckpointInfo info;
+        info.bytes = static_cast<uint64_t>(in.tellg());
+
+        constexpr uint64_t TRAILER = 2 * sizeof(uint64_t);
+        if (sizeof(FILE_MAGIC) + 16 + TRAILER > info.bytes) throw std::runtime_error(path + " is not a checkpoint");
+
+        auto get = [&in](auto& value) {in.read(reinterpret_cast<char*>(&value), sizeof(value));};
+
+        uint64_t content = 0, checksum = 0;
+        in.seekg(static_cast<std::streamoff>(info.bytes - TRAILER));
+        get(content);
+        get(checksum);
+
+        std::vector<uint8_t> chunk (sim::CHECKPOINT_BUFFER);
+        uint64_t h = CHECKSUM_SEED;
+        uint64_t left = info.bytes - TRAILER;
+        in.seekg(0);
+        while (0 < left && in) {
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(left, chunk.size()));
+            in.read(reinterpret_cast<char*>(chunk.data()), static_cast<std::streamsize>(n));
+            h = fold(h, chunk.data(), n);
+            left -= n;
+        }
+        info.intact = in && content == info.bytes - TRAILER && checksum == h;
+
+        char magic[sizeof(FILE_MAGIC)] = {};
+        uint32_t dish_count = 0, reserved = 0;
+        in.clear();
+        in.seekg(0);
+        in.read(magic, sizeof(magic));
+        if (0 != std::memcmp(magic, FILE_MAGIC, sizeof(magic))) throw std::runtime_error(path + " is not a checkpoint");
+        get(info.generation);
+        get(dish_count);
+        get(reserved);
+
+        for (uint32_t d = 0; d < dish_count && in; d++) {
+            DishInfo dish;
+            uint32_t dish_magic = 0, width = 0, height = 0;
+            get(dish_magic);
+            get(width);
+            get(height);
+            get(dish.fields);
+            get(dish.tick);
+            get(dish.hash);
+            get(dish.organisms);
+            get(dish.species);
+            get(dish.weights);
+            get(dish.layout);
+            get(dish.storage);
+            get(dish.regions);
+            get(dish.events);
+            if (!in || DISH_MAGIC != dish_magic) break;
+
+            uint64_t next_id = 0, epochs = 0, events_tick = 0;
+            get(dish.epoch_generation);
+            get(next_id);
+            get(dish.next_genome);
+            get(epochs);
+            get(events_tick);
+
+            // Generator texts, then the simd lanes
+            for (unsigned g = 0; g < 4 && in; g++) {
+                uint32_t length = 0;
+                get(length);
+                in.seekg(length, std::ios::cur);
+            }
+            in.seekg(4 * sizeof(uint64_t), std::ios::cur);
+            if (!in) break;
+
+            dish.dimensions = UVec2(width, height);
+            info.dishes.push_back(dish);
+            in.seekg(static_cast<std::streamoff>(dish.body_bytes()), std::ios::cur);
+        }
+
+        if (info.dishes.size() != dish_count) info.intact = false;
+        return info;
+    }
+
+    /**
+    * @brief The checkpoint inspection tool.
+    *
+    *   FILE...
+    * Prints what each checkpoint holds, and fails if one is damaged.
+    */
+    inline int query (const int argc, char** argv) {
+        if (1 > argc) throw std::invalid_argument("Usage: checkpoint FILE...");
+
+        int result = 0;
+        for (int i = 0; i < argc; i++) {
+            const CheckpointInfo info = inspect(argv[i]);
+            if (!info.intact) result = 1;
+
+            std::cout << argv[i] << ": generation " << info.generation
+                << ", " << info.dishes.size() << " dishes, " << info.bytes << " bytes, "
+                << (info.intact ? "intact" : "damaged") << "\n";
+
+            for (const DishInfo& d : info.dishes) {
+                std::cout << "  " << d.dimensions.x() << "x" << d.dimensions.y()
+                    << " tick " << d.tick
+                    << ", " << d.organisms << " organisms"
+                    << ", " << d.species << " species"
+                    << ", " << d.fields << " fields"
+                    << ", " << d.events << " events pending"
+                    << ", next genome " << d.next_genome
+                    << ", hash " << std::hex << d.hash << std::dec << "\n";
+            }
+        }
+
+        return result;
+    }
+}
\ No newline at end of file
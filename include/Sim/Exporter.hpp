@@ -0,0 +1,251 @@
+#pragma once
+
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+
+#include "Sim/sim_constants.hpp"
+#include "Sim/Board/Cell.hpp"
+#include "utils/Image.hpp"
+#include "utils/Vec.hpp"
+
+
+namespace exporter {
+    enum class ImageFormat : uint8_t {
+        Ppm = 0, Png = 1
+    };
+
+    class ExportParams {
+        public:
+            std::string directory = sim::EXPORT_DIR;
+            ImageFormat format = ImageFormat::Png;
+
+            // Generations between two frames
+            uint64_t every = 100;
+
+            // Side in pixels of the square drawn for each cell
+            unsigned block = 1;
+
+            unsigned workers = 2;
+
+            // Frames waiting for a worker before new ones are dropped
+            size_t queue = 8;
+
+            static ImageFormat parse_format (const std::string& name) {
+                if ("png" == name) return ImageFormat::Png;
+                if ("ppm" == name) return ImageFormat::Ppm;
+                throw std::invalid_argument("Unknown image format " + name);
+            }
+    };
+
+    // The 16 terminal colors, indexed by Cell::get_color
+    constexpr uint8_t PALETTE[16][3] = {
+        {0, 0, 0}, {128, 0, 0}, {0, 128, 0}, {128, 128, 0},
+        {0, 0, 128}, {128, 0, 128}, {0, 128, 128}, {192, 192, 192},
+        {128, 128, 128}, {255, 0, 0}, {0, 255, 0}, {255, 255, 0},
+        {0, 0, 255}, {255, 0, 255}, {0, 255, 255}, {255, 255, 255}
+    };
+
+
+    /**
+    * @brief Writes board snapshots as numbered images, for time-lapses.
+    *
+    * The sim thread only copies the cell colors. Rendering, encoding and
+    *  writing happen on the exporter's own workers, behind a bounded queue:
+    *  when the workers fall behind, frames are dropped rather than making
+    *  the sim wait.
+    */
+    class FrameExporter {
+        public:
+            FrameExporter () {}
+
+            FrameExporter (const ExportParams export_params) : params(export_params) {
+                std::error_code error;
+                std::filesystem::create_directories(params.directory, error);
+                if (error) throw std::runtime_error("Can not create " + params.directory);
+
+                state = std::make_unique<State>();
+                state->params = params;
+
+                State* shared = state.get();
+                for (unsigned i = 0; i < std::max(1u, params.workers); i++) {
+                    state->workers.emplace_back([shared] {work_loop(*shared);});
+                }
+            }
+
+            FrameExporter (const FrameExporter&) = delete;
+            FrameExporter& operator= (const FrameExporter&) = delete;
+
+            FrameExporter& operator= (FrameExporter&& other) {
+                if (this == &other) return *this;
+                stop();
+
+                params = other.params;
+                state = std::move(other.state);
+                return *this;
+            }
+
+            // Writes every queued frame before returning
+            ~FrameExporter () {stop();}
+
+            bool is_valid () const {return nullptr != state;}
+
+            bool is_due (const uint64_t generation) const {
+                return is_valid() && 0 != params.every && 0 == generation % params.every;
+            }
+
+            template <typename B>
+            void capture (const B& board, const uint64_t generation) {
+                if (!is_due(generation)) return;
+
+                {
+                    std::lock_guard<std::mutex> lock (state->mutex);
+                    if (state->jobs.size() >= params.queue) {
+                        state->dropped += 1;
+                        return;
+                    }
+                }
+
+                Job job;
+                job.generation = generation;
+                job.dimensions = board.get_dimensions();
+                job.colors.resize(static_cast<size_t>(job.dimensions.x()) * job.dimensions.y());
+
+                UVec2 p;
+                size_t i = 0;
+                for (p.y() = 0; p.y() < job.dimensions.y(); p.y() += 1) {
+                    for (p.x() = 0; p.x() < job.dimensions.x(); p.x() += 1) {
+                        job.colors[i++] = board.get_raw(p).get_color();
+                    }
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock (state->mutex);
+                    state->jobs.push_back(std::move(job));
+                }
+                state->wake.notify_one();
+            }
+
+            uint64_t get_written () const {return is_valid() ? state->written.load() : 0;}
+            uint64_t get_dropped () const {return is_valid() ? state->dropped.load() : 0;}
+
+        private:
+            struct Job {
+                uint64_t generation = 0;
+                UVec2 dimensions;
+                std::vector<uint8_t> colors;
+            };
+
+            // Owned through a pointer, so workers keep it while the exporter
+            //  itself moves around
+            struct State {
+                ExportParams params;
+                std::vector<std::thread> workers;
+                std::deque<Job> jobs;
+                std::mutex mutex;
+                std::condition_variable wake;
+                bool stopping = false;
+
+                std::atomic<uint64_t> written {0};
+                std::atomic<uint64_t> dropped {0};
+            };
+
+            ExportParams params;
+            std::unique_ptr<State> state;
+
+            void stop () {
+                if (nullptr == state) return;
+
+                {
+                    std::lock_guard<std::mutex> lock (state->mutex);
+                    state->stopping = true;
+                }
+                state->wake.notify_all();
+                for (std::thread& w : state->workers) w.join();
+                state->workers.clear();
+            }
+
+            static void work_loop (State& s) {
+                while (true) {
+                    Job job;
+
+                    {
+                        std::unique_lock<std::mutex> lock (s.mutex);
+                        s.wake.wait(lock, [&s] {return s.stopping || !s.jobs.empty();});
+
+                        if (s.jobs.empty()) return;
+
+                        job = std::move(s.jobs.front());
+                        s.jobs.pop_front();
+                    }
+
+                    if (write(job, s.params)) s.written += 1;
+                }
+            }
+
+            static std::vector<uint8_t> render (const Job& job, const unsigned block) {
+                const size_t width = static_cast<size_t>(job.dimensions.x()) * block;
+                const size_t height = static_cast<size_t>(job.dimensions.y()) * block;
+
+                std::vector<uint8_t> rgb (width * height * 3);
+                for (size_t y = 0; y < job.dimensions.y(); y++) {
+                    uint8_t* row = &rgb[y * block * width * 3];
+
+                    for (size_t x = 0; x < job.dimensions.x(); x++) {
+                        const uint8_t* color = PALETTE[job.colors[y * job.dimensions.x() + x] & 15];
+                        for (unsigned b = 0; b < block; b++) {
+                            uint8_t* px = row + (x * block + b) * 3;
+                            px[0] = color[0]; px[1] = color[1]; px[2] = color[2];
+                        }
+                    }
+
+                    // The other rows of the block repeat the first one
+                    for (unsigned b = 1; b < block; b++) {
+                        std::copy(row, row + width * 3, row + b * width * 3);
+                    }
+                }
+
+                return rgb;
+            }
+
+            static bool write (const Job& job, const ExportParams& params) {
+                const unsigned block = std::max(1u, params.block);
+                const uint32_t width = job.dimensions.x() * block;
+                const uint32_t height = job.dimensions.y() * block;
+
+                const std::vector<uint8_t> rgb = render(job, block);
+                const bool png = ImageFormat::Png == params.format;
+                const std::vector<uint8_t> bytes = png
+                    ? image::encode_png(rgb, width, height)
+                    : image::encode_ppm(rgb, width, height);
+
+                char name[32];
+                std::snprintf(name, sizeof(name), "frame_%010llu.%s",
+                    static_cast<unsigned long long>(job.generation), png ? "png" : "ppm");
+                const std::string path = params.directory + "/" + name;
+
+                // Written aside and renamed so a reader never sees half a frame
+                const std::string temp_path = path + ".tmp";
+                std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+                if (nullptr == file) return false;
+
+                bool ok = bytes.size() == std::fwrite(bytes.data(), 1, bytes.size(), file);
+                ok = (0 == std::fclose(file)) && ok;
+
+                std::error_code error;
+                if (ok) std::filesystem::rename(temp_path, path, error);
+                else std::filesystem::remove(temp_path, error);
+                return ok && !error;
+            }
+    };
+}
@@ -0,0 +1,592 @@
+#pragma once
+
+
+#include <array>
+#include <deque>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <fstream>
+#include <filesystem>
+#include <iostream>
+#include <algorithm>
+#include <unordered_set>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "Sim/sim_constants.hpp"
+#include "Sim/PetriDish/Evolution.hpp"
+#include "utils/Option.hpp"
+
+
+namespace lineage {
+    using Birth = evolution::Birth;
+    using BirthKind = evolution::BirthKind;
+
+    class LineageParams {
+        public:
+            std::string path;
+
+            // Births per block, the unit the file is written and read in
+            size_t block = sim::LINEAGE_BLOCK;
+    };
+
+    // The file starts with FILE_MAGIC, then holds blocks back to back. Each
+    //  block is a BlockHeader followed by its columns, one after the other:
+    //
+    //    child        varint, delta from the previous child
+    //    parent_a     varint, child - parent, 0 when there is none
+    //    parent_b     same
+    //    generation   varint, delta from the previous generation
+    //    genome_hash  8 bytes
+    //    mutations    varint
+    //    kind         1 byte
+    //
+    // Headers carry the id and generation ranges of their block, so they
+    //  are the index: a reader hops from header to header and only decodes
+    //  the blocks, and the columns, a query needs. A block cut short by a
+    //  crash is ignored, and cut off when the file is appended to again.
+    constexpr char FILE_MAGIC[8] = {'W', 'L', 'I', 'N', 'E', 'A', 'G', '1'};
+    constexpr uint32_t BLOCK_MAGIC = 0x314b4c42u; // "BLK1"
+    constexpr size_t COLUMNS = 7;
+
+    enum Column : size_t {
+        Child = 0, ParentA = 1, ParentB = 2, Generation = 3, GenomeHash = 4, Mutations = 5, Kind = 6
+    };
+
+    class BlockHeader {
+        public:
+            uint32_t magic = BLOCK_MAGIC;
+            uint32_t rows = 0;
+            uint64_t first_child = 0;
+            uint64_t last_child = 0;
+            uint64_t first_generation = 0;
+            uint64_t last_generation = 0;
+            std::array<uint32_t, COLUMNS> column_bytes {};
+            uint32_t reserved = 0;
+
+            uint64_t body_bytes () const {
+                uint64_t total = 0;
+                for (const uint32_t b : column_bytes) total += b;
+                return total;
+            }
+    };
+
+    // Where a block is, and what it holds
+    class BlockInfo {
+        public:
+            uint64_t offset = 0;
+            BlockHeader header;
+    };
+
+    inline void put_varint (std::vector<uint8_t>& out, uint64_t value) {
+        while (0x80 <= value) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    inline uint64_t get_varint (const uint8_t*& p, const uint8_t* end) {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (p == end) throw std::runtime_error("Lineage block is cut short");
+            const uint8_t byte = *p++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (0 == (byte & 0x80)) return value;
+        }
+        throw std::runtime_error("Lineage block holds a bad varint");
+    }
+
+    // The whole blocks of a file, from its magic on, stopping at the first
+    //  one cut short or damaged
+    inline std::vector<BlockInfo> scan_blocks (std::istream& in, const uint64_t size) {
+        std::vector<BlockInfo> blocks;
+
+        uint64_t offset = sizeof(FILE_MAGIC);
+        while (offset + sizeof(BlockHeader) <= size) {
+            BlockInfo info;
+            info.offset = offset;
+            in.seekg(static_cast<std::streamoff>(offset));
+            in.read(reinterpret_cast<char*>(&info.header), sizeof(BlockHeader));
+
+            if (!in || BLOCK_MAGIC != info.header.magic) break;
+            const uint64_t end = offset + sizeof(BlockHeader) + info.header.body_bytes();
+            if (end > size) break;
+
+            blocks.push_back(info);
+            offset = end;
+        }
+
+        return blocks;
+    }
+
+    inline uint64_t parent_delta (const uint64_t child, const uint64_t parent) {
+        return Birth::NO_PARENT == parent ? 0 : child - parent;
+    }
+
+    inline uint64_t parent_of (const uint64_t child, const uint64_t delta) {
+        return 0 == delta ? Birth::NO_PARENT : child - delta;
+    }
+
+    // One block, header and columns, ready to be appended
+    inline std::vector<uint8_t> encode_block (const std::vector<Birth>& births) {
+        BlockHeader header;
+        header.rows = static_cast<uint32_t>(births.size());
+        header.first_child = births.front().child;
+        header.last_child = births.back().child;
+        header.first_generation = births.front().generation;
+        header.last_generation = births.back().generation;
+
+        std::array<std::vector<uint8_t>, COLUMNS> columns;
+        uint64_t child = header.first_child;
+        uint64_t generation = header.first_generation;
+
+        for (const Birth& b : births) {
+            put_varint(columns[Child], b.child - child);
+            put_varint(columns[ParentA], parent_delta(b.child, b.parent_a));
+            put_varint(columns[ParentB], parent_delta(b.child, b.parent_b));
+            put_varint(columns[Generation], b.generation - generation);
+
+            uint8_t hash[8];
+            std::memcpy(hash, &b.genome_hash, sizeof(hash));
+            columns[GenomeHash].insert(columns[GenomeHash].end(), hash, hash + sizeof(hash));
+
+            put_varint(columns[Mutations], b.mutations);
+            columns[Kind].push_back(static_cast<uint8_t>(b.kind));
+
+            child = b.child;
+            generation = b.generation;
+        }
+
+        for (size_t c = 0; c < COLUMNS; c++) header.column_bytes[c] = static_cast<uint32_t>(columns[c].size());
+
+        std::vector<uint8_t> out (sizeof(BlockHeader));
+        std::memcpy(out.data(), &header, sizeof(BlockHeader));
+        for (const std::vector<uint8_t>& column : columns) out.insert(out.end(), column.begin(), column.end());
+        return out;
+    }
+
+
+    /**
+    * @brief Appends the births of a dish to a lineage file.
+    *
+    * The sim thread only copies births into the block being filled. Full
+    *  blocks are handed to a writer thread, which encodes and appends them,
+    *  and handed back empty to be filled again, so recording never waits
+    *  on the disk and allocates nothing once warm.
+    */
+    class LineageLog {
+        public:
+            LineageLog () {}
+
+            // An existing file is appended to. It is cut back to its last
+            //  whole block first, so the blocks written next follow on from
+            //  it, and get_next_genome tells where the ids resume.
+            LineageLog (const LineageParams log_params) : params(log_params) {
+                state = std::make_unique<State>();
+                resume();
+
+                state->out.open(params.path, std::ios::binary | std::ios::in | std::ios::out | std::ios::ate);
+                if (!state->out) {
+                    state->out.clear();
+                    state->out.open(params.path, std::ios::binary | std::ios::out);
+                }
+                if (!state->out) throw std::runtime_error("Can not open lineage output " + params.path);
+
+                if (0 == state->out.tellp()) state->out.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+
+                filling.reserve(params.block);
+
+                State* shared = state.get();
+                state->writer = std::thread([shared] {write_loop(*shared);});
+            }
+
+            LineageLog (const LineageLog&) = delete;
+            LineageLog& operator= (const LineageLog&) = delete;
+
+            LineageLog& operator= (LineageLog&& other) {
+                if (this == &other) return *this;
+                stop();
+
+                params = other.params;
+                state = std::move(other.state);
+                filling.swap(other.filling);
+                next_genome = other.next_genome;
+                return *this;
+            }
+
+            // Writes every pending birth before returning
+            ~LineageLog () {stop();}
+
+            bool is_valid () const {return nullptr != state;}
+
+            void record (const std::vector<Birth>& births) {
+                if (!is_valid()) return;
+
+                for (const Birth& b : births) {
+                    filling.push_back(b);
+                    if (filling.size() >= params.block) hand_off();
+                }
+            }
+
+            // Hands the block being filled to the writer, even if not full
+            void flush () {
+                if (is_valid() && !filling.empty()) hand_off();
+            }
+
+            uint64_t get_blocks () const {return is_valid() ? state->blocks.load() : 0;}
+            uint64_t get_rows () const {return is_valid() ? state->rows.load() : 0;}
+            uint64_t get_bytes () const {return is_valid() ? state->bytes.load() : 0;}
+
+            // One past the last genome the file held when opened
+            uint64_t get_next_genome () const {return next_genome;}
+
+        private:
+            // Owned through a pointer, so the writer keeps it while the log
+            //  itself moves around
+            struct State {
+                std::fstream out;
+                std::thread writer;
+                std::deque<std::vector<Birth>> full;
+                std::vector<std::vector<Birth>> empty;
+                std::mutex mutex;
+                std::condition_variable wake;
+                bool stopping = false;
+
+                std::atomic<uint64_t> blocks {0};
+                std::atomic<uint64_t> rows {0};
+                std::atomic<uint64_t> bytes {0};
+            };
+
+            LineageParams params;
+            std::unique_ptr<State> state;
+            std::vector<Birth> filling;
+            uint64_t next_genome = 0;
+
+            // Drops a block cut short by a crash from the end of the file,
+            //  and reads where the genome ids left off
+            void resume () {
+                std::ifstream in (params.path, std::ios::binary | std::ios::ate);
+                if (!in) return;
+
+                const uint64_t size = static_cast<uint64_t>(in.tellg());
+                if (0 == size) return;
+
+                char magic[sizeof(FILE_MAGIC)] = {};
+                in.seekg(0);
+                in.read(magic, sizeof(magic));
+                if (!in || 0 != std::memcmp(magic, FILE_MAGIC, sizeof(magic))) {
+                    throw std::runtime_error(params.path + " is not a lineage file");
+                }
+
+                const std::vector<BlockInfo> blocks = scan_blocks(in, size);
+                in.close();
+
+                uint64_t end = sizeof(FILE_MAGIC);
+                if (!blocks.empty()) {
+                    const BlockInfo& last = blocks.back();
+                    end = last.offset + sizeof(BlockHeader) + last.header.body_bytes();
+                    next_genome = last.header.last_child + 1;
+                }
+                if (end == size) return;
+
+                std::error_code error;
+                std::filesystem::resize_file(params.path, end, error);
+                if (error) throw std::runtime_error("Can not cut " + params.path + " back to its last whole block: " + error.message());
+            }
+
+            void hand_off () {
+                std::vector<Birth> next;
+
+                {
+                    std::lock_guard<std::mutex> lock (state->mutex);
+                    state->full.push_back(std::move(filling));
+                    if (!state->empty.empty()) {
+                        next.swap(state->empty.back());
+                        state->empty.pop_back();
+                    }
+                }
+                state->wake.notify_one();
+
+                filling.swap(next);
+                filling.clear();
+                filling.reserve(params.block);
+            }
+
+            void stop () {
+                if (nullptr == state) return;
+
+                flush();
+                {
+                    std::lock_guard<std::mutex> lock (state->mutex);
+                    state->stopping = true;
+                }
+                state->wake.notify_all();
+                if (state->writer.joinable()) state->writer.join();
+            }
+
+            static void write_loop (State& s) {
+                while (true) {
+                    std::vector<Birth> births;
+
+                    {
+                        std::unique_lock<std::mutex> lock (s.mutex);
+                        s.wake.wait(lock, [&s] {return s.stopping || !s.full.empty();});
+
+                        if (s.full.empty()) return;
+
+                        births = std::move(s.full.front());
+                        s.full.pop_front();
+                    }
+
+                    const std::vector<uint8_t> block = encode_block(births);
+                    s.out.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(block.size()));
+                    s.out.flush();
+
+                    s.blocks += 1;
+                    s.rows += births.size();
+                    s.bytes += block.size();
+
+                    births.clear();
+                    std::lock_guard<std::mutex> lock (s.mutex);
+                    s.empty.push_back(std::move(births));
+                }
+            }
+    };
+
+
+    // Figures over a whole lineage file
+    class Summary {
+        public:
+            uint64_t births = 0;
+            uint64_t blocks = 0;
+            std::array<uint64_t, 5> kinds {};
+            uint64_t mutations = 0;
+            uint64_t first_generation = 0;
+            uint64_t last_generation = 0;
+            uint64_t distinct_genomes = 0;
+    };
+
+
+    /**
+    * @brief Queries over a lineage file, one block in memory at a time.
+    *
+    * Opening only reads the block headers. Looking a genome up finds its
+    *  block from the id ranges, and walking ancestry only decodes the id
+    *  columns of the blocks it passes through.
+    */
+    class LineageReader {
+        public:
+            LineageReader (const std::string& path) {
+                in.open(path, std::ios::binary);
+                if (!in) throw std::runtime_error("Can not open lineage file " + path);
+
+                char magic[sizeof(FILE_MAGIC)] = {};
+                in.read(magic, sizeof(magic));
+                if (!in || 0 != std::memcmp(magic, FILE_MAGIC, sizeof(magic))) {
+                    throw std::runtime_error(path + " is not a lineage file");
+                }
+
+                in.seekg(0, std::ios::end);
+                blocks = scan_blocks(in, static_cast<uint64_t>(in.tellg()));
+                in.clear();
+            }
+
+            const std::vector<BlockInfo>& get_blocks () const {return blocks;}
+
+            /**
+            * @brief Decode a block.
+            * @param details Also decode the hashes, mutations and kinds, or
+            *  only the ids and generations.
+            */
+            void read_block (const size_t index, std::vector<Birth>& out, const bool details = true) {
+                const BlockHeader& h = blocks[index].header;
+                const uint64_t wanted = details ? h.body_bytes()
+                    : static_cast<uint64_t>(h.column_bytes[Child]) + h.column_bytes[ParentA] + h.column_bytes[ParentB] + h.column_bytes[Generation];
+
+                body.resize(wanted);
+                in.clear();
+                in.seekg(static_cast<std::streamoff>(blocks[index].offset + sizeof(BlockHeader)));
+                in.read(reinterpret_cast<char*>(body.data()), static_cast<std::streamsize>(wanted));
+                if (!in) throw std::runtime_error("Can not read lineage block " + std::to_string(index));
+
+                std::array<const uint8_t*, COLUMNS> column {};
+                const uint8_t* p = body.data();
+                for (size_t c = 0; c < COLUMNS; c++) {
+                    column[c] = p;
+                    p += h.column_bytes[c];
+                }
+                const uint8_t* end = body.data() + body.size();
+
+                out.resize(h.rows);
+                uint64_t child = h.first_child;
+                uint64_t generation = h.first_generation;
+
+                for (uint32_t r = 0; r < h.rows; r++) {
+                    Birth& b = out[r];
+                    b.child = child += get_varint(column[Child], end);
+                    b.parent_a = parent_of(b.child, get_varint(column[ParentA], end));
+                    b.parent_b = parent_of(b.child, get_varint(column[ParentB], end));
+                    b.generation = generation += get_varint(column[Generation], end);
+
+                    if (!details) continue;
+                    std::memcpy(&b.genome_hash, column[GenomeHash], sizeof(b.genome_hash));
+                    column[GenomeHash] += sizeof(b.genome_hash);
+                    b.mutations = static_cast<uint32_t>(get_varint(column[Mutations], end));
+                    b.kind = static_cast<BirthKind>(*column[Kind]++);
+                }
+            }
+
+            // The birth of a genome, if the file holds it
+            Option<Birth> find (const uint64_t id) {
+                const auto block = std::lower_bound(blocks.begin(), blocks.end(), id, [](const BlockInfo& b, const uint64_t value) {
+                    return b.header.last_child < value;
+                });
+                if (blocks.end() == block || block->header.first_child > id) return Option<Birth>();
+
+                const size_t index = static_cast<size_t>(block - blocks.begin());
+                if (cached != index) {
+                    read_block(index, cache);
+                    cached = index;
+                }
+
+                const auto found = std::lower_bound(cache.begin(), cache.end(), id, [](const Birth& b, const uint64_t value) {
+                    return b.child < value;
+                });
+                if (cache.end() == found || found->child != id) return Option<Birth>();
+                return Option<Birth>(*found);
+            }
+
+            /**
+            * @brief The genome and every ancestor of it the file holds,
+            *  youngest first, each listed once.
+            * @param limit Stops after this many births.
+            */
+            std::vector<Birth> ancestry (const uint64_t id, const size_t limit = ~size_t(0)) {
+                std::vector<Birth> out;
+                std::vector<uint64_t> pending = {id};
+                std::unordered_set<uint64_t> seen = {id};
+
+                // Parents are always older, so taking the largest id first
+                //  walks the blocks backwards
+                while (!pending.empty() && out.size() < limit) {
+                    std::pop_heap(pending.begin(), pending.end());
+                    const uint64_t next = pending.back();
+                    pending.pop_back();
+
+                    const Option<Birth> birth = find(next);
+                    if (!birth.has_value()) continue;
+                    out.push_back(birth.unwrap());
+
+                    for (const uint64_t parent : {out.back().parent_a, out.back().parent_b}) {
+                        if (Birth::NO_PARENT == parent || !seen.insert(parent).second) continue;
+                        pending.push_back(parent);
+                        std::push_heap(pending.begin(), pending.end());
+                    }
+                }
+
+                return out;
+            }
+
+            // Reads every block once
+            Summary summarize () {
+                Summary s;
+                std::unordered_set<uint64_t> genomes;
+                std::vector<Birth> births;
+
+                for (size_t i = 0; i < blocks.size(); i++) {
+                    read_block(i, births);
+                    if (0 == i) s.first_generation = blocks[i].header.first_generation;
+                    s.last_generation = blocks[i].header.last_generation;
+                    s.blocks += 1;
+
+                    for (const Birth& b : births) {
+                        s.births += 1;
+                        s.kinds[std::min<size_t>(static_cast<size_t>(b.kind), s.kinds.size() - 1)] += 1;
+                        s.mutations += b.mutations;
+                        genomes.insert(b.genome_hash);
+                    }
+                }
+
+                s.distinct_genomes = genomes.size();
+                return s;
+            }
+
+        private:
+            std::ifstream in;
+            std::vector<BlockInfo> blocks;
+            std::vector<uint8_t> body;
+
+            std::vector<Birth> cache;
+            size_t cached = ~size_t(0);
+    };
+
+
+    inline const char* kind_name (const BirthKind kind) {
+        switch (kind) {
+            case BirthKind::Seed: return "seed";
+            case BirthKind::Elite: return "elite";
+            case BirthKind::Crossover: return "crossover";
+            case BirthKind::Clone: return "clone";
+            case BirthKind::Immigrant: return "immigrant";
+        }
+        return "unknown";
+    }
+
+    /**
+    * @brief The lineage query tool.
+    *
+    *   FILE stats
+    *   FILE ancestry ID [LIMIT]
+    *   FILE birth ID
+    */
+    inline int query (const int argc, char** argv) {
+        if (2 > argc) throw std::invalid_argument("Usage: lineage FILE stats|ancestry ID [LIMIT]|birth ID");
+
+        LineageReader reader (argv[0]);
+        const std::string command = argv[1];
+
+        auto print = [](const Birth& b) {
+            std::cout << b.child << " gen " << b.generation << " " << kind_name(b.kind);
+            if (Birth::NO_PARENT != b.parent_a) std::cout << " of " << b.parent_a;
+            if (Birth::NO_PARENT != b.parent_b) std::cout << " and " << b.parent_b;
+            std::cout << ", " << b.mutations << " mutations, hash " << std::hex << b.genome_hash << std::dec << "\n";
+        };
+
+        if ("stats" == command) {
+            const Summary s = reader.summarize();
+            std::cout << "births " << s.births << " in " << s.blocks << " blocks\n"
+                << "generations " << s.first_generation << " to " << s.last_generation << "\n"
+                << "distinct genomes " << s.distinct_genomes << "\n"
+                << "mean mutations " << (0 == s.births ? 0.0 : static_cast<double>(s.mutations) / s.births) << "\n";
+            for (size_t k = 0; k < s.kinds.size(); k++) {
+                std::cout << kind_name(static_cast<BirthKind>(k)) << " " << s.kinds[k] << "\n";
+            }
+            return 0;
+        }
+
+        if (3 > argc) throw std::invalid_argument("Missing genome id");
+        const uint64_t id = std::stoull(argv[2]);
+
+        if ("birth" == command) {
+            const Option<Birth> birth = reader.find(id);
+            if (!birth.has_value()) throw std::runtime_error("No genome " + std::to_string(id));
+            print(birth.unwrap());
+            return 0;
+        }
+
+        if ("ancestry" == command) {
+            const size_t limit = (3 < argc) ? std::stoull(argv[3]) : ~size_t(0);
+            for (const Birth& b : reader.ancestry(id, limit)) print(b);
+            return 0;
+        }
+
+        throw std::invalid_argument("Unknown lineage command " + command);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,226 @@
+#pragma once
+
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include "Sim/sim_constants.hpp"
+#include "Sim/sim_types.hpp"
+#include "Sim/Board/Cell.hpp"
+#include "utils/Timer.hpp"
+#include "utils/Vec.hpp"
+#include "utils/SharedMemory.hpp"
+
+
+namespace mirror {
+    using Cell = cell::Cell;
+    using SimStatus = sim::SimStatus;
+    using Timer = timer::Timer;
+
+    // Everything a viewer shows besides the cells
+    class Frame {
+        public:
+            uint32_t width = 0;
+            uint32_t height = 0;
+            uint64_t generation = 0;
+            SimStatus status;
+
+            double delta_time = 0.0;
+            double mean_time = 0.0;
+            double up_time = 0.0;
+            uint64_t frame_count = 0;
+
+            // Packed cells, row major
+            std::vector<uint32_t> cells;
+
+            std::string timer_text () const {
+                return Timer::format(delta_time, mean_time, up_time, frame_count);
+            }
+    };
+
+
+    // Layout of the published segment. The sequence is odd while the
+    //  publisher writes, so readers retry any copy that saw it odd or saw it
+    //  change (a seqlock): the publisher never waits for a viewer. Viewers
+    //  stamp when they last read, and nothing is published while nobody
+    //  did for a while.
+    struct Header {
+        alignas(64) std::atomic<uint64_t> sequence {0};
+        alignas(64) std::atomic<int64_t> last_read {0};
+        uint64_t magic = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint64_t generation = 0;
+        uint32_t status = 0;
+        double delta_time = 0.0;
+        double mean_time = 0.0;
+        double up_time = 0.0;
+        uint64_t frame_count = 0;
+    };
+
+    constexpr uint64_t MAGIC = 0x3252524f5252494dull; // "MIRROR2"
+
+    inline int64_t now_ticks () {
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+
+    inline uint32_t pack_status (const SimStatus& s) {
+        return static_cast<uint32_t>(s.running)
+            | (static_cast<uint32_t>(s.syncing) << 1)
+            | (static_cast<uint32_t>(s.printing) << 2)
+            | (static_cast<uint32_t>(s.paused) << 3)
+            | (static_cast<uint32_t>(s.powersave) << 4);
+    }
+
+    inline SimStatus unpack_status (const uint32_t bits) {
+        SimStatus s;
+        s.running = bits & 1;
+        s.syncing = bits & 2;
+        s.printing = bits & 4;
+        s.paused = bits & 8;
+        s.powersave = bits & 16;
+        return s;
+    }
+
+
+    // Writes the main board of a sim into shared memory, at most once every
+    //  sim::PUBLISH_INTERVAL seconds
+    class BoardPublisher {
+        public:
+            BoardPublisher () {}
+
+            BoardPublisher (const std::string& name, const UVec2 dimensions) {
+                const size_t length = static_cast<size_t>(dimensions.x()) * dimensions.y();
+                segment = shm::SharedMemory::create(name, sizeof(Header) + length * sizeof(uint32_t));
+
+                header = new (segment.data()) Header();
+                header->width = dimensions.x();
+                header->height = dimensions.y();
+                header->magic = MAGIC;
+                cells = reinterpret_cast<uint32_t*>(segment.data() + sizeof(Header));
+            }
+
+            bool is_valid () const {return segment.is_valid();}
+
+            // A viewer read recently
+            bool is_watched () const {
+                const int64_t idle = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(sim::PUBLISH_IDLE)
+                ).count();
+                return now_ticks() - header->last_read.load(std::memory_order_relaxed) < idle;
+            }
+
+            bool is_due () const {
+                return is_valid() && std::chrono::steady_clock::now() >= next_publish && is_watched();
+            }
+
+            template <typename B>
+            void publish (
+                const B& board,
+                const Timer& timer,
+                const SimStatus& status,
+                const uint64_t generation
+            ) {
+                if (!is_due() || board.get_dimensions() != UVec2(header->width, header->height)) return;
+                next_publish = std::chrono::steady_clock::now() + std::chrono::duration_cast<
+                    std::chrono::steady_clock::duration
+                >(std::chrono::duration<double>(sim::PUBLISH_INTERVAL));
+
+                const uint64_t sequence = header->sequence.load(std::memory_order_relaxed);
+                header->sequence.store(sequence + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+
+                header->generation = generation;
+                header->status = pack_status(status);
+                header->delta_time = timer.delta_time();
+                header->mean_time = timer.mean_time();
+                header->up_time = timer.up_time();
+                header->frame_count = timer.get_frame_count();
+
+                // Cells only change between generations, a paused sim just
+                //  refreshes the header
+                if (generation != published_generation || !published) {
+                    for (unsigned y = 0; y < header->height; y++) {
+                        uint32_t* row = cells + static_cast<size_t>(y) * header->width;
+                        board.for_each_in_row(y, 0, header->width, [row](const unsigned x, const Cell c) {
+                            row[x] = c.pack();
+                        });
+                    }
+                    published_generation = generation;
+                    published = true;
+                }
+
+                header->sequence.store(sequence + 2, std::memory_order_release);
+            }
+
+        private:
+            shm::SharedMemory segment;
+            Header* header = nullptr;
+            uint32_t* cells = nullptr;
+            std::chrono::steady_clock::time_point next_publish;
+            uint64_t published_generation = 0;
+            bool published = false;
+    };
+
+
+    // Reads frames published by another process
+    class BoardViewer {
+        public:
+            // Writable only to stamp reads, the cells are never written
+            BoardViewer (const std::string& name) : segment(shm::SharedMemory::attach(name, true)) {
+                if (sizeof(Header) > segment.size()) throw std::runtime_error("Not a published board");
+
+                header = reinterpret_cast<Header*>(segment.data());
+                if (MAGIC != header->magic) throw std::runtime_error("Not a published board");
+
+                cells = reinterpret_cast<const uint32_t*>(segment.data() + sizeof(Header));
+            }
+
+            /**
+            * @brief Copy the latest frame, if there is a new one.
+            * @return False when nothing changed since the last read, or the
+            *  publisher kept writing through every attempt.
+            */
+            bool read (Frame& frame) {
+                header->last_read.store(now_ticks(), std::memory_order_relaxed);
+
+                for (unsigned a = 0; a < sim::MAX_ATEMPTS; a++) {
+                    const uint64_t before = header->sequence.load(std::memory_order_acquire);
+                    if (before == last_sequence) return false;
+                    if (before & 1) continue;
+
+                    frame.width = header->width;
+                    frame.height = header->height;
+                    frame.generation = header->generation;
+                    frame.status = unpack_status(header->status);
+                    frame.delta_time = header->delta_time;
+                    frame.mean_time = header->mean_time;
+                    frame.up_time = header->up_time;
+                    frame.frame_count = header->frame_count;
+
+                    const size_t length = static_cast<size_t>(frame.width) * frame.height;
+                    frame.cells.resize(length);
+                    std::memcpy(frame.cells.data(), cells, length * sizeof(uint32_t));
+
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (before == header->sequence.load(std::memory_order_relaxed)) {
+                        last_sequence = before;
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+        private:
+            shm::SharedMemory segment;
+            Header* header = nullptr;
+            const uint32_t* cells = nullptr;
+            uint64_t last_sequence = 0;
+    };
+}
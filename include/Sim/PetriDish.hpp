@@ -1,39 +1,228 @@
 #pragma once
 
 
+#include <vector>
+#include <memory>
+#include <string>
+#include <stdexcept>
+
 #include "Sim/Board.hpp"
+#include "Sim/Board/Field.hpp"
+#include "Sim/Board/Walls.hpp"
 #include "Sim/Population.hpp"
+#include "Sim/PetriDish/Evolution.hpp"
+#include "Sim/PetriDish/Events.hpp"
 #include "utils/Vec.hpp"
 #include "utils/Term.hpp"
+#include "utils/ThreadPool.hpp"
+#include "utils/Arena.hpp"
 
 
 namespace petridish {
     using Population = population::Population;
     using Board = board::Board;
+    using DynamicGeometry = geometry::DynamicGeometry;
+    using Field = field::Field;
+    using FieldParams = field::FieldParams;
+    using BoardParams = board::BoardParams;
+    using WallParams = walls::WallParams;
+    using SimpleDir = types::SimpleDir;
+    using Evolution = evolution::Evolution;
+    using EvolutionParams = evolution::EvolutionParams;
+    using EventParams = events::EventParams;
+    using WorldEvents = events::WorldEvents;
+
+    // Where the memory of a dish comes from. By default it is the heap.
+    class MemoryParams {
+        public:
+            arena::HugePages huge_pages = arena::HugePages::Off;
+
+            // Cpu the thread building and stepping the dish is pinned to,
+            //  so its memory is local to it. Negative leaves it unpinned.
+            int cpu = -1;
+
+            bool uses_arena () const {return arena::HugePages::Off != huge_pages || 0 <= cpu;}
+    };
 
-    class PetriDish {
+    class DishParams {
         public:
-            PetriDish(uint64_t seed) : rng_gen(seed) {
-                uint64_t board_seed = rng_gen();
+            MemoryParams memory;
+            BoardParams board;
+            WallParams walls;
+            EvolutionParams evolution;
+            EventParams events;
+    };
+
+    template <typename G>
+    class BasicPetriDish {
+        public:
+            using BoardType = board::BasicBoard<G>;
 
-                board = Board(
-                    term::Term::instance().get_width() - 2,
-                    term::Term::instance().get_height() - 2,
-                    board_seed
+            // A dish filling the terminal, as seen by the printer
+            BasicPetriDish(uint64_t seed) : BasicPetriDish(
+                seed,
+                UVec2(
+                    static_cast<unsigned>(term::Term::instance().get_width() - 2),
+                    static_cast<unsigned>(term::Term::instance().get_height() - 2)
+                ),
+                DishParams()
+            ) {}
+
+            // A dish of any size, which does not need the terminal
+            BasicPetriDish(uint64_t seed, const UVec2 dimensions, const DishParams params) :
+                rng_gen(seed),
+                board(dimensions, rng_gen(), params.board, make_arena(dimensions, params.memory))
+            {
+                walls::WallGenerator wall_generator (params.walls);
+                board.place_walls(
+                    wall_generator.load_or_generate(board.get_dimensions(), rng_gen())
                 );
+
+                evolution = Evolution(params.evolution, rng_gen());
+
+                // Only drawn when used, so dishes without events stay the same
+                if (params.events.any()) {
+                    world_events = WorldEvents(params.events, rng_gen());
+                    population.index_ids();
+                }
+
+                seed_species();
+                evolution.found(population.get_brain(), tick);
+                spawn_organisms();
+                world_events.schedule_walls(board);
             }
 
-            ~PetriDish() {}
+            ~BasicPetriDish() {}
 
             void foward () {
+                pool::ThreadPool& pool = pool::ThreadPool::instance();
+
+                tick += 1;
+                if (world_events.is_enabled()) world_events.advance(tick, board, population);
+
+                population.sense(board, pool);
+                population.think(pool);
+                population.act(board);
+
+                // Breed the next round when the epoch ends or everyone died
+                epoch_generation += 1;
+                if (evolution.get_epoch() <= epoch_generation || 0 == population.size()) {
+                    evolve();
+                }
+
+                if (world_events.is_enabled()) world_events.record(population);
+                else population.clear_events();
+
                 board.foward();
+
+                for (Field& f : fields) f.foward(pool);
             }
 
-            const Board& get_board () {return board;}
+            // Genome births since the last call, when the evolution params
+            //  ask for lineage
+            void take_births (std::vector<evolution::Birth>& out) {evolution.take_births(out);}
+
+            // Species whose genomes were overwritten from outside the dish
+            void adopt (const std::vector<uint32_t>& species) {
+                evolution.adopt(population.get_brain(), species, tick);
+            }
+
+            // Adds a scalar layer aligned with the board, returning its index
+            size_t add_field (const FieldParams params) {
+                fields.push_back(Field(board.get_dimensions(), params));
+                return fields.size() - 1;
+            }
+
+            // Board figures plus the births and deaths of the population,
+            //  with or without the per region heatmaps
+            stats::Snapshot get_stats (const bool heatmaps = true) const {
+                stats::Snapshot s = board.snapshot(heatmaps);
+                s.births = population.get_births();
+                s.deaths = population.get_deaths();
+                return s;
+            }
+
+            const BoardType& get_board () {return board;}
+            Population& get_population () {return population;}
+            const Evolution& get_evolution () const {return evolution;}
+            const WorldEvents& get_events () const {return world_events;}
+            Field& get_field (const size_t index) {return fields[index];}
+            const arena::Arena* get_arena () const {return board.get_arena();}
+            size_t get_field_count () const {return fields.size();}
+            uint64_t get_tick () const {return tick;}
+            uint64_t get_epoch_generation () const {return epoch_generation;}
+            std::mt19937_64 get_rng_gen () const {return rng_gen;}
 
         private:
             std::mt19937_64 rng_gen;
-            Board board;
+
+            // Cells come from the arena of the dish, shared by its copies and
+            //  kept alive by the boards allocating from it
+            BoardType board;
             Population population;
+            std::vector<Field> fields;
+            Evolution evolution;
+            uint64_t epoch_generation = 0;
+
+            WorldEvents world_events;
+            uint64_t tick = 0;
+
+            // Pins the calling thread first, so the arena pages are touched
+            //  from the right node. The thread pool is started before, or
+            //  its workers would inherit that single cpu.
+            static std::shared_ptr<arena::Arena> make_arena (const UVec2 dimensions, const MemoryParams params) {
+                if (0 <= params.cpu) pool::ThreadPool::instance();
+                if (0 <= params.cpu && !arena::pin_thread(static_cast<unsigned>(params.cpu))) {
+                    throw std::runtime_error("Can not pin the dish to cpu " + std::to_string(params.cpu));
+                }
+
+                if (!params.uses_arena()) return nullptr;
+
+                // Only address space: the board and a few copies of it
+                const size_t cells = G(dimensions).storage_length() * sizeof(board::Cell);
+                return std::make_shared<arena::Arena>(16 * cells + (size_t(32) << 20), params.huge_pages);
+            }
+
+            void evolve () {
+                evolution.step(population.get_brain(), population.get_fitness(), tick);
+
+                population.clear(board);
+                population.reset_fitness();
+                spawn_organisms();
+
+                epoch_generation = 0;
+            }
+
+            void seed_species () {
+                brain::Brain& brain = population.get_brain();
+                std::normal_distribution<float> weight_dist (0.0f, 0.5f);
+
+                std::vector<float> weights (Population::topology().weight_count());
+                for (unsigned s = 0; s < sim::INITIAL_SPECIES; s++) {
+                    for (float& w : weights) w = weight_dist(rng_gen);
+                    brain.add_species(weights.data());
+                }
+
+                population.reset_fitness();
+            }
+
+            // Organisms scattered over free cells, split evenly between species
+            void spawn_organisms () {
+                const UVec2 dims = board.get_dimensions();
+                std::uniform_int_distribution<uint32_t> width_dist (0, dims.x() - 1);
+                std::uniform_int_distribution<uint32_t> height_dist (0, dims.y() - 1);
+                std::uniform_int_distribution<int> dir_dist (1, 4);
+
+                for (unsigned i = 0; i < sim::INITIAL_ORGANISMS; i++) {
+                    for (uint8_t a = 0; a < sim::MAX_ATEMPTS; a++) {
+                        const UVec2 p = UVec2(width_dist(rng_gen), height_dist(rng_gen));
+                        const SimpleDir dir = static_cast<SimpleDir>(dir_dist(rng_gen));
+
+                        if (population.spawn(board, p, dir, i % sim::INITIAL_SPECIES, sim::ORGANISM_ENERGY, world_events.draw_period())) break;
+                    }
+                }
+            }
     };
+
+    using PetriDish = BasicPetriDish<DynamicGeometry>;
 }
\ No newline at end of file
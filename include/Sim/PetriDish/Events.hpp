@@ -0,0 +1,164 @@
+#pragma once
+
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <unordered_map>
+
+#include "Sim/Board/Cell.hpp"
+#include "Sim/Population.hpp"
+#include "utils/TimingWheel.hpp"
+#include "utils/Vec.hpp"
+
+
+namespace events {
+    using Cell = cell::Cell;
+    using CellType = cell::CellType;
+    using Population = population::Population;
+
+    class EventParams {
+        public:
+            // Generations before eaten food grows back on its cell, 0 for never
+            uint64_t food_regrowth = 0;
+
+            // Mean generations a wall stands before it crumbles, 0 for ever
+            uint64_t wall_lifetime = 0;
+
+            // Organisms move once every 1 to max_period generations, drawn
+            //  when they are born
+            unsigned max_period = 1;
+
+            bool any () const {return 0 < food_regrowth || 0 < wall_lifetime || 1 < max_period;}
+    };
+
+    enum class EventKind : uint8_t {
+        FoodRegrowth = 0, WallDecay = 1, OrganismWake = 2
+    };
+
+    class Event {
+        public:
+            EventKind kind = EventKind::FoodRegrowth;
+            UVec2 position = UVec2::Zero();
+            uint64_t organism = 0;
+    };
+
+
+    // The delayed happenings of a dish, kept in a timing wheel so nothing
+    //  is polled: each generation only touches the events due then.
+    class WorldEvents {
+        public:
+            using Wheel = wheel::TimingWheel<Event>;
+
+            WorldEvents () {}
+            WorldEvents (const EventParams event_params, const uint64_t seed) :
+                params(event_params),
+                rng_gen(seed)
+            {}
+
+            ~WorldEvents () {}
+
+            bool is_enabled () const {return params.any();}
+
+            // Period of a newborn organism
+            uint8_t draw_period () {
+                if (1 >= params.max_period) return 1;
+                std::uniform_int_distribution<unsigned> period_dist (1, std::min(255u, params.max_period));
+                return static_cast<uint8_t>(period_dist(rng_gen));
+            }
+
+            // Gives every wall of the board a time to crumble, read from the
+            //  wall bitplane 64 cells at a time
+            template <typename B>
+            void schedule_walls (const B& board) {
+                if (0 == params.wall_lifetime) return;
+
+                std::uniform_int_distribution<uint64_t> life_dist (params.wall_lifetime / 2, params.wall_lifetime * 3 / 2);
+                const auto& planes = board.get_planes();
+                const UVec2 dims = board.get_dimensions();
+
+                for (unsigned y = 0; y < dims.y(); y++) {
+                    const uint64_t* row = planes.row(CellType::Wall, y);
+                    for (size_t w = 0; w < planes.get_stride(); w++) {
+                        for (uint64_t bits = row[w]; 0 != bits; bits &= bits - 1) {
+                            Event e;
+                            e.kind = EventKind::WallDecay;
+                            e.position = UVec2(static_cast<unsigned>(w * 64 + __builtin_ctzll(bits)), y);
+                            events.schedule(events.get_now() + life_dist(rng_gen), e);
+                        }
+                    }
+                }
+            }
+
+            // Fires what is due at the tick
+            template <typename B>
+            void advance (const uint64_t tick, B& board, Population& population) {
+                events.advance(tick, [&](const Event& e, uint64_t) {
+                    switch (e.kind) {
+                        case EventKind::FoodRegrowth:
+                            if (board.get(e.position).is_empty()) board.set(e.position, Cell::Food());
+                            break;
+
+                        case EventKind::WallDecay:
+                            if (CellType::Wall == board.get(e.position).get_type()) board.set(e.position, Cell::Empty());
+                            break;
+
+                        case EventKind::OrganismWake:
+                            waking.erase(e.organism);
+                            population.wake(e.organism);
+                            break;
+                    }
+                });
+            }
+
+            // Schedules what the population's last moves started, and drops
+            //  the wake ups of organisms that died since
+            void record (Population& population) {
+                const uint64_t now = events.get_now();
+
+                if (0 < params.food_regrowth) {
+                    for (const UVec2& p : population.get_eaten()) {
+                        Event e;
+                        e.kind = EventKind::FoodRegrowth;
+                        e.position = p;
+                        events.schedule(now + params.food_regrowth, e);
+                    }
+                }
+
+                for (const uint64_t id : population.get_acted()) {
+                    const uint8_t period = population.get_period_of(id);
+                    if (0 == period) continue;
+
+                    Event e;
+                    e.kind = EventKind::OrganismWake;
+                    e.organism = id;
+                    waking[id] = events.schedule(now + period, e);
+                }
+
+                for (const uint64_t id : population.get_died()) {
+                    const auto found = waking.find(id);
+                    if (waking.end() == found) continue;
+                    events.cancel(found->second);
+                    waking.erase(found);
+                }
+
+                population.clear_events();
+            }
+
+            size_t get_pending () const {return events.size();}
+            uint64_t get_now () const {return events.get_now();}
+            std::mt19937_64 get_rng_gen () const {return rng_gen;}
+
+            // Calls fn(event, tick) for every pending event
+            template <typename F>
+            void for_each_pending (F&& fn) const {events.for_each(fn);}
+
+        private:
+            EventParams params;
+            std::mt19937_64 rng_gen;
+            Wheel events;
+
+            // Pending wake ups, to cancel them when organisms die
+            std::unordered_map<uint64_t, Wheel::Handle> waking;
+    };
+}
\ No newline at end of file
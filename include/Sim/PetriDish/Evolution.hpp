@@ -0,0 +1,360 @@
+#pragma once
+
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+#include "Sim/sim_constants.hpp"
+#include "Sim/Population/Brain.hpp"
+#include "utils/SimdRng.hpp"
+#include "utils/Cpu.hpp"
+#include "utils/Hash.hpp"
+
+
+namespace evolution {
+    using Brain = brain::Brain;
+
+    enum class Selection : uint8_t {
+        Tournament = 0, Roulette = 1
+    };
+
+    class EvolutionParams {
+        public:
+            // Generations between two rounds of breeding
+            uint64_t epoch = sim::EVOLUTION_EPOCH;
+
+            Selection selection = Selection::Tournament;
+            unsigned tournament_size = 3;
+
+            // Best genomes copied unchanged into the next round
+            unsigned elites = 1;
+
+            float crossover_rate = 0.7f;
+            float mutation_rate = 0.05f;
+            float mutation_strength = 0.2f;
+
+            // Keep a Birth for every genome made, for lineage logs
+            bool lineage = false;
+
+            // Id of the first genome, past those a lineage log already holds
+            uint64_t first_genome = 0;
+    };
+
+    enum class BirthKind : uint8_t {
+        Seed = 0, Elite = 1, Crossover = 2, Clone = 3, Immigrant = 4
+    };
+
+    // How a genome came to be. Genomes are numbered in the order they are
+    //  made, so parents always have smaller ids than their children.
+    class Birth {
+        public:
+            static constexpr uint64_t NO_PARENT = ~0ull;
+
+            uint64_t child = 0;
+            uint64_t parent_a = NO_PARENT;
+            uint64_t parent_b = NO_PARENT;
+            uint64_t generation = 0;
+            uint64_t genome_hash = 0;
+
+            // Weights changed by mutation
+            uint32_t mutations = 0;
+            BirthKind kind = BirthKind::Seed;
+    };
+
+
+    // Offspring genomes are bred into this buffer while the parents stay in
+    //  the brain, then the two buffers trade places. Both only ever grow, so
+    //  after the first round breeding allocates nothing.
+    class GenomeArena {
+        public:
+            GenomeArena () {}
+            ~GenomeArena () {}
+
+            void reserve (const size_t genome_count, const size_t genome_size) {
+                count = genome_count;
+                size = genome_size;
+                if (offspring.size() < count * size) offspring.resize(count * size);
+            }
+
+            float* child (const size_t i) {return &offspring[i * size];}
+
+            // Hands the offspring to the brain, taking the parents back
+            void swap_into (Brain& brain) {
+                offspring.resize(count * size);
+                brain.swap_weights(offspring);
+            }
+
+            size_t get_genome_count () const {return count;}
+            size_t get_genome_size () const {return size;}
+
+        private:
+            std::vector<float> offspring;
+            size_t count = 0;
+            size_t size = 0;
+    };
+
+
+    // Genetic algorithm over the species genomes (brain weights) of a dish
+    class Evolution {
+        public:
+            Evolution () {}
+
+            Evolution (const EvolutionParams evolution_params, const uint64_t seed) :
+                params(evolution_params),
+                rng_gen(seed),
+                simd_rng(rng_gen()),
+                next_genome(evolution_params.first_genome)
+            {}
+
+            ~Evolution () {}
+
+            /**
+            * @brief Breed the next round of species from the current one.
+            * @param brain Brain whose species are the parents, and get replaced.
+            * @param fitness Fitness of each species.
+            * @param generation Stamped on the births of the new genomes.
+            */
+            void step (Brain& brain, const std::vector<float>& fitness, const uint64_t generation = 0) {
+                const size_t n = brain.get_species_count();
+                const size_t size = brain.get_topology().weight_count();
+                if (0 == n || fitness.size() < n) return;
+
+                found(brain, generation);
+                child_ids.resize(n);
+
+                arena.reserve(n, size);
+                noise_a.resize(size);
+                noise_b.resize(size);
+
+                ranking.resize(n);
+                for (size_t i = 0; i < n; i++) ranking[i] = i;
+                std::sort(ranking.begin(), ranking.end(), [&](size_t a, size_t b) {
+                    return fitness[a] > fitness[b];
+                });
+
+                if (Selection::Roulette == params.selection) build_roulette(fitness, n);
+
+                const Brain& parents = brain;
+                std::uniform_real_distribution<float> chance (0.0f, 1.0f);
+
+                for (size_t c = 0; c < n; c++) {
+                    float* child = arena.child(c);
+
+                    Birth birth;
+                    birth.child = child_ids[c] = next_genome++;
+                    birth.generation = generation;
+
+                    if (c < params.elites) {
+                        std::memcpy(child, parents.get_weights(static_cast<uint32_t>(ranking[c])), size * sizeof(float));
+                        birth.parent_a = genome_ids[ranking[c]];
+                        birth.kind = BirthKind::Elite;
+                        keep(birth, child, size);
+                        continue;
+                    }
+
+                    const size_t pa = select(fitness, n);
+                    const size_t pb = select(fitness, n);
+                    const float* a = parents.get_weights(static_cast<uint32_t>(pa));
+                    const float* b = parents.get_weights(static_cast<uint32_t>(pb));
+                    birth.parent_a = genome_ids[pa];
+
+                    if (chance(rng_gen) < params.crossover_rate) {
+                        simd_rng.fill_uniform(noise_a.data(), size);
+                        crossover(a, b, noise_a.data(), child, size);
+                        birth.parent_b = genome_ids[pb];
+                        birth.kind = BirthKind::Crossover;
+                    } else {
+                        std::memcpy(child, a, size * sizeof(float));
+                        birth.kind = BirthKind::Clone;
+                    }
+
+                    simd_rng.fill_uniform(noise_a.data(), size);
+                    simd_rng.fill_uniform(noise_b.data(), size);
+                    birth.mutations = mutate(child, noise_a.data(), noise_b.data(), size);
+                    keep(birth, child, size);
+                }
+
+                best_fitness = fitness[ranking[0]];
+                arena.swap_into(brain);
+                genome_ids.swap(child_ids);
+                epochs += 1;
+            }
+
+            // Numbers the species that have no genome id yet, as seeds
+            void found (const Brain& brain, const uint64_t generation) {
+                const size_t size = brain.get_topology().weight_count();
+
+                for (size_t s = genome_ids.size(); s < brain.get_species_count(); s++) {
+                    Birth birth;
+                    birth.child = next_genome++;
+                    birth.generation = generation;
+                    birth.kind = BirthKind::Seed;
+
+                    genome_ids.push_back(birth.child);
+                    keep(birth, brain.get_weights(static_cast<uint32_t>(s)), size);
+                }
+            }
+
+            // Species whose genomes were replaced from outside, like
+            //  immigrants, get new ids without parents
+            void adopt (const Brain& brain, const std::vector<uint32_t>& species, const uint64_t generation) {
+                found(brain, generation);
+                const size_t size = brain.get_topology().weight_count();
+
+                for (const uint32_t s : species) {
+                    Birth birth;
+                    birth.child = genome_ids[s] = next_genome++;
+                    birth.generation = generation;
+                    birth.kind = BirthKind::Immigrant;
+                    keep(birth, brain.get_weights(s), size);
+                }
+            }
+
+            // Births since the last call, oldest first
+            void take_births (std::vector<Birth>& out) {
+                out.swap(births);
+                births.clear();
+            }
+
+            uint64_t get_genome_id (const size_t species) const {return genome_ids[species];}
+            const std::vector<uint64_t>& get_genome_ids () const {return genome_ids;}
+            uint64_t get_next_genome () const {return next_genome;}
+
+            std::mt19937_64 get_rng_gen () const {return rng_gen;}
+            const rng::SimdRng& get_simd_rng () const {return simd_rng;}
+
+            uint64_t get_epoch () const {return params.epoch;}
+            uint64_t get_epoch_count () const {return epochs;}
+            float get_best_fitness () const {return best_fitness;}
+
+        private:
+            EvolutionParams params;
+            std::mt19937_64 rng_gen;
+            rng::SimdRng simd_rng;
+            GenomeArena arena;
+
+            uint64_t epochs = 0;
+            float best_fitness = 0.0f;
+
+            // Genome id of each species, and of each child while breeding
+            std::vector<uint64_t> genome_ids;
+            std::vector<uint64_t> child_ids;
+            uint64_t next_genome = 0;
+            std::vector<Birth> births;
+
+            // Scratch reused every round
+            std::vector<size_t> ranking;
+            std::vector<double> cumulative;
+            std::vector<float> noise_a;
+            std::vector<float> noise_b;
+
+            void build_roulette (const std::vector<float>& fitness, const size_t n) {
+                cumulative.resize(n);
+
+                double total = 0.0;
+                for (size_t i = 0; i < n; i++) {
+                    total += std::max(0.0f, fitness[i]);
+                    cumulative[i] = total;
+                }
+            }
+
+            size_t select (const std::vector<float>& fitness, const size_t n) {
+                if (Selection::Roulette == params.selection && 0.0 < cumulative.back()) {
+                    std::uniform_real_distribution<double> spin (0.0, cumulative.back());
+                    const double r = spin(rng_gen);
+                    return std::min<size_t>(
+                        n - 1,
+                        std::upper_bound(cumulative.begin(), cumulative.begin() + n, r) - cumulative.begin()
+                    );
+                }
+
+                std::uniform_int_distribution<size_t> pick (0, n - 1);
+                size_t best = pick(rng_gen);
+                for (unsigned t = 1; t < params.tournament_size; t++) {
+                    const size_t other = pick(rng_gen);
+                    if (fitness[other] > fitness[best]) best = other;
+                }
+
+                return best;
+            }
+
+            // Uniform crossover: each weight comes from a or b by coin flip
+            static void crossover (
+                const float* a,
+                const float* b,
+                const float* coin,
+                float* out,
+                const size_t n
+            ) {
+                size_t i = 0;
+
+                #if defined(__SSE2__)
+                    const bool sse2 = cpu::Isa::Sse2 <= cpu::level();
+                    const __m128 half = _mm_set1_ps(0.5f);
+                    for (; sse2 && i + 4 <= n; i += 4) {
+                        const __m128 take_a = _mm_cmplt_ps(_mm_loadu_ps(coin + i), half);
+                        _mm_storeu_ps(out + i, _mm_or_ps(
+                            _mm_and_ps(take_a, _mm_loadu_ps(a + i)),
+                            _mm_andnot_ps(take_a, _mm_loadu_ps(b + i))
+                        ));
+                    }
+                #endif
+
+                for (; i < n; i++) out[i] = (0.5f > coin[i]) ? a[i] : b[i];
+            }
+
+            void keep (Birth& birth, const float* genome, const size_t n) {
+                if (!params.lineage) return;
+                birth.genome_hash = genome_hash(genome, n);
+                births.push_back(birth);
+            }
+
+            static uint64_t genome_hash (const float* genome, const size_t n) {
+                uint64_t h = n;
+                for (size_t i = 0; i < n; i++) {
+                    uint32_t bits;
+                    std::memcpy(&bits, genome + i, sizeof(bits));
+                    h = hash::combine(h, bits);
+                }
+                return h;
+            }
+
+            // Each weight moves by up to mutation_strength with probability
+            //  mutation_rate. Returns the amount of weights moved.
+            uint32_t mutate (float* genome, const float* chance, const float* noise, const size_t n) const {
+                const float rate = params.mutation_rate;
+                const float strength = params.mutation_strength;
+                uint32_t moved = 0;
+                size_t i = 0;
+
+                #if defined(__SSE2__)
+                    const bool sse2 = cpu::Isa::Sse2 <= cpu::level();
+                    const __m128 vrate = _mm_set1_ps(rate);
+                    const __m128 vscale = _mm_set1_ps(2.0f * strength);
+                    const __m128 vstrength = _mm_set1_ps(strength);
+
+                    for (; sse2 && i + 4 <= n; i += 4) {
+                        const __m128 hit = _mm_cmplt_ps(_mm_loadu_ps(chance + i), vrate);
+                        moved += static_cast<uint32_t>(__builtin_popcount(_mm_movemask_ps(hit)));
+                        const __m128 delta = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(noise + i), vscale), vstrength);
+                        _mm_storeu_ps(genome + i, _mm_add_ps(_mm_loadu_ps(genome + i), _mm_and_ps(hit, delta)));
+                    }
+                #endif
+
+                for (; i < n; i++) {
+                    if (rate > chance[i]) {
+                        genome[i] += noise[i] * 2.0f * strength - strength;
+                        moved += 1;
+                    }
+                }
+
+                return moved;
+            }
+    };
+}
@@ -1,9 +1,443 @@
 #pragma once
 
 
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "Sim/sim_constants.hpp"
+#include "Sim/Board/Cell.hpp"
+#include "Sim/Board/SpatialIndex.hpp"
+#include "Sim/Population/Brain.hpp"
+#include "Sim/Population/Vision.hpp"
+#include "utils/Vec.hpp"
+#include "utils/ThreadPool.hpp"
+
+
 namespace population {
+    using Cell = cell::Cell;
+    using CellType = cell::CellType;
+    using SimpleDir = types::SimpleDir;
+    using Brain = brain::Brain;
+    using BrainTopology = brain::BrainTopology;
+    using ThreadPool = pool::ThreadPool;
+
+    enum class Action : uint8_t {
+        Forward = 0, TurnLeft = 1, TurnRight = 2, Stay = 3
+    };
+
+
+    // The organisms of a dish, stored as parallel arrays so sensing and
+    //  thinking run over contiguous memory. Each generation goes through
+    //  sense (board to sensor matrix), think (batched brains) and act
+    //  (decisions back onto the board).
+    //
+    // Slow organisms sleep between their moves. Only the awake ones, kept
+    //  in a list fed by wake ups, are sensed, thought for and moved, while
+    //  every organism keeps spending energy.
     class Population {
         public:
+            using Eyes = vision::Vision<>;
+
+            // Cell ahead, left and right as one-hot cell types, energy, how
+            //  far ahead and to the right the nearest food smells, then what
+            //  each ray of sight ran into: wall, food or organism, as one-hot
+            //  closeness (1 next to the organism, down to 1 / DISTANCE)
+            static constexpr unsigned SMELL_INPUT = 3 * 4 + 1;
+            static constexpr unsigned SIGHT_INPUT = SMELL_INPUT + 2;
+            static constexpr unsigned SENSOR_COUNT = SIGHT_INPUT + 3 * Eyes::RAY_COUNT;
+            static constexpr unsigned ACTION_COUNT = 4;
+
+            static BrainTopology topology () {
+                BrainTopology t;
+                t.inputs = SENSOR_COUNT;
+                t.hidden = sim::BRAIN_HIDDEN;
+                t.outputs = ACTION_COUNT;
+                return t;
+            }
+
+            Population () : brain(topology()) {}
+            ~Population () {}
+
+            // Places an organism on the board unless a wall or another
+            //  organism is there. Food under it is lost. It acts once every
+            //  period generations, when woken up after each of its moves.
+            template <typename B>
+            bool spawn (
+                B& board,
+                const UVec2 position,
+                const SimpleDir dir,
+                const uint32_t species,
+                const float organism_energy,
+                const uint8_t period = 1
+            ) {
+                if (board.is_blocked(position)) return false;
+
+                board.set(position, Cell::Organism(dir));
+
+                ids.push_back(next_id++);
+                positions.push_back(board.get_geometry().wrap(position));
+                dirs.push_back(dir);
+                energy.push_back(organism_energy);
+                species_of.push_back(species);
+                decisions.push_back(static_cast<uint8_t>(Action::Stay));
+                periods.push_back(period);
+                ready.push_back(0);
+                awake_slot.push_back(0);
+                wake_index(ids.size() - 1);
+                if (indexing) index_of[ids.back()] = static_cast<uint32_t>(ids.size() - 1);
+
+                births += 1;
+                return true;
+            }
+
+            // Rows of the sensor matrix follow the awake list, or the
+            //  organisms in order when everyone is awake
+            template <typename B>
+            void sense (const B& board, ThreadPool& pool) {
+                const size_t n = awake.size();
+                all_awake = (n == size());
+                sensors.assign(n * SENSOR_COUNT, 0.0f);
+
+                if (!all_awake) {
+                    row_positions.resize(n);
+                    row_dirs.resize(n);
+                    for (size_t r = 0; r < n; r++) {
+                        row_positions[r] = positions[awake[r]];
+                        row_dirs[r] = dirs[awake[r]];
+                    }
+                }
+                const std::vector<UVec2>& sensed = all_awake ? positions : row_positions;
+
+                // Food within the smell radius from the spatial index, and
+                //  rays of sight over the bitplanes
+                board.nearest_batch(CellType::Food, sensed, sim::SMELL_RADIUS, 1, smelled);
+                Eyes::evaluate(board, sensed, all_awake ? dirs : row_dirs, sights, pool);
+
+                const UVec2 dims = board.get_dimensions();
+                for (size_t r = 0; r < n; r++) {
+                    const size_t i = all_awake ? r : awake[r];
+                    float* s = &sensors[r * SENSOR_COUNT];
+                    const SimpleDir d = dirs[i];
+
+                    const SimpleDir looks[3] = {d, turn_left(d), turn_right(d)};
+                    for (unsigned l = 0; l < 3; l++) {
+                        const Cell c = board.get_raw(neighbor(positions[i], looks[l], dims));
+                        s[l * 4 + static_cast<unsigned>(c.get_type())] = 1.0f;
+                    }
+
+                    s[12] = energy[i] / sim::ORGANISM_ENERGY;
+
+                    if (smelled[r].is_valid()) {
+                        const IVec2 ahead = facing(offset(positions[i], smelled[r].position, dims), d);
+                        s[SMELL_INPUT] = static_cast<float>(ahead.x()) / sim::SMELL_RADIUS;
+                        s[SMELL_INPUT + 1] = static_cast<float>(ahead.y()) / sim::SMELL_RADIUS;
+                    }
+
+                    for (unsigned ray = 0; ray < Eyes::RAY_COUNT; ray++) {
+                        const vision::Sight& sight = sights[r * Eyes::RAY_COUNT + ray];
+                        if (CellType::Empty == sight.type) continue;
+
+                        const float closeness = static_cast<float>(Eyes::RAY_DISTANCE + 1 - sight.distance) / Eyes::RAY_DISTANCE;
+                        s[SIGHT_INPUT + ray * 3 + static_cast<unsigned>(sight.type) - 1] = closeness;
+                    }
+                }
+            }
+
+            void think (ThreadPool& pool) {
+                const size_t n = awake.size();
+                if (sensors.size() != n * SENSOR_COUNT) return;
+
+                if (all_awake) {
+                    brain.evaluate(sensors.data(), species_of.data(), n, decisions.data(), pool);
+                    return;
+                }
+
+                row_species.resize(n);
+                row_decisions.resize(n);
+                for (size_t r = 0; r < n; r++) row_species[r] = species_of[awake[r]];
+
+                brain.evaluate(sensors.data(), row_species.data(), n, row_decisions.data(), pool);
+                for (size_t r = 0; r < n; r++) decisions[awake[r]] = row_decisions[r];
+            }
+
+            template <typename B>
+            void act (B& board) {
+                const UVec2 dims = board.get_dimensions();
+                fitness.resize(brain.get_species_count(), 0.0f);
+
+                size_t i = 0;
+                while (i < size()) {
+                    energy[i] -= 1.0f;
+                    fitness[species_of[i]] += 1.0f;
+
+                    if (0.0f >= energy[i]) {
+                        board.set_raw(positions[i], Cell::Empty());
+                        remove(i);
+                        continue;
+                    }
+
+                    // Slow organisms wait to be woken up
+                    if (!ready[i]) {
+                        i += 1;
+                        continue;
+                    }
+
+                    if (1 < periods[i]) {
+                        sleep_index(i);
+                        acted.push_back(ids[i]);
+                    }
+
+                    switch (static_cast<Action>(decisions[i])) {
+                        case Action::Forward: {
+                            const UVec2 target = neighbor(positions[i], dirs[i], dims);
+                            const Cell t = board.get_raw(target);
+
+                            if (t.is_empty() || CellType::Food == t.get_type()) {
+                                if (!t.is_empty()) {
+                                    energy[i] += sim::FOOD_ENERGY;
+                                    fitness[species_of[i]] += sim::FOOD_ENERGY;
+                                    eaten.push_back(target);
+                                }
+
+                                board.set_raw(positions[i], Cell::Empty());
+                                board.set_raw(target, Cell::Organism(dirs[i]));
+                                positions[i] = target;
+                            }
+                            break;
+                        }
+
+                        case Action::TurnLeft:
+                            dirs[i] = turn_left(dirs[i]);
+                            board.set_raw(positions[i], Cell::Organism(dirs[i]));
+                            break;
+
+                        case Action::TurnRight:
+                            dirs[i] = turn_right(dirs[i]);
+                            board.set_raw(positions[i], Cell::Organism(dirs[i]));
+                            break;
+
+                        default:
+                            break;
+                    }
+
+                    i += 1;
+                }
+            }
+
+            // Removes every organism from the board
+            template <typename B>
+            void clear (B& board) {
+                for (const UVec2& p : positions) board.set_raw(p, Cell::Empty());
+                deaths += size();
+                died.insert(died.end(), ids.begin(), ids.end());
+
+                ids.clear();
+                positions.clear();
+                dirs.clear();
+                energy.clear();
+                species_of.clear();
+                decisions.clear();
+                periods.clear();
+                ready.clear();
+                awake.clear();
+                awake_slot.clear();
+                index_of.clear();
+            }
+
+            // Keeps where each organism id is, which wake ups need. Only
+            //  dishes with events ask for it.
+            void index_ids () {
+                if (indexing) return;
+                indexing = true;
+                for (size_t i = 0; i < size(); i++) index_of[ids[i]] = static_cast<uint32_t>(i);
+            }
+
+            // Wakes up a slow organism for its next move, if still alive
+            void wake (const uint64_t id) {
+                const auto found = index_of.find(id);
+                if (index_of.end() != found) wake_index(found->second);
+            }
+
+            size_t get_awake_count () const {return awake.size();}
+
+            // SENSOR_COUNT inputs per awake organism, from the last sense
+            const std::vector<float>& get_sensors () const {return sensors;}
+
+            // What happened since the last clear_events: slow organisms that
+            //  moved, cells whose food was eaten and organisms that died
+            const std::vector<uint64_t>& get_acted () const {return acted;}
+            const std::vector<UVec2>& get_eaten () const {return eaten;}
+            const std::vector<uint64_t>& get_died () const {return died;}
+
+            void clear_events () {
+                acted.clear();
+                eaten.clear();
+                died.clear();
+            }
+
+            // Energy gathered plus generations lived, summed per species
+            const std::vector<float>& get_fitness () const {return fitness;}
+            void reset_fitness () {fitness.assign(brain.get_species_count(), 0.0f);}
+
+            Brain& get_brain () {return brain;}
+            const Brain& get_brain () const {return brain;}
+
+            size_t size () const {return ids.size();}
+
+            // Organisms spawned and removed since the population was made,
+            //  including the ones cleared when an epoch ends
+            uint64_t get_births () const {return births;}
+            uint64_t get_deaths () const {return deaths;}
+            uint64_t get_next_id () const {return next_id;}
+            uint64_t get_id (const size_t i) const {return ids[i];}
+            UVec2 get_position (const size_t i) const {return positions[i];}
+            const std::vector<UVec2>& get_positions () const {return positions;}
+            SimpleDir get_dir (const size_t i) const {return dirs[i];}
+            float get_energy (const size_t i) const {return energy[i];}
+            uint32_t get_species (const size_t i) const {return species_of[i];}
+            uint8_t get_period (const size_t i) const {return periods[i];}
+
+            // Whole columns, one entry per organism
+            const std::vector<uint64_t>& get_ids () const {return ids;}
+            const std::vector<SimpleDir>& get_dirs () const {return dirs;}
+            const std::vector<float>& get_energies () const {return energy;}
+            const std::vector<uint32_t>& get_species_of () const {return species_of;}
+            const std::vector<uint8_t>& get_periods () const {return periods;}
+
+            // Zero once the organism is gone, or without index_ids
+            uint8_t get_period_of (const uint64_t id) const {
+                const auto found = index_of.find(id);
+                return index_of.end() == found ? 0 : periods[found->second];
+            }
+
+            static SimpleDir turn_left (const SimpleDir d) {
+                switch (d) {
+                    case SimpleDir::Up: return SimpleDir::Left;
+                    case SimpleDir::Left: return SimpleDir::Down;
+                    case SimpleDir::Down: return SimpleDir::Right;
+                    default: return SimpleDir::Up;
+                }
+            }
+
+            static SimpleDir turn_right (const SimpleDir d) {
+                switch (d) {
+                    case SimpleDir::Up: return SimpleDir::Right;
+                    case SimpleDir::Right: return SimpleDir::Down;
+                    case SimpleDir::Down: return SimpleDir::Left;
+                    default: return SimpleDir::Up;
+                }
+            }
+
+            // Shortest offset from a to b around the edges of the board
+            static IVec2 offset (const UVec2 a, const UVec2 b, const UVec2 dims) {
+                auto axis = [](const unsigned from, const unsigned to, const unsigned n) {
+                    int d = static_cast<int>(to) - static_cast<int>(from);
+                    if (2 * d > static_cast<int>(n)) d -= static_cast<int>(n);
+                    if (-2 * d > static_cast<int>(n)) d += static_cast<int>(n);
+                    return d;
+                };
+                return IVec2(axis(a.x(), b.x(), dims.x()), axis(a.y(), b.y(), dims.y()));
+            }
+
+            // A board offset seen by an organism facing d, as cells ahead
+            //  and cells to its right
+            static IVec2 facing (const IVec2 v, const SimpleDir d) {
+                switch (d) {
+                    case SimpleDir::Up: return IVec2(-v.y(), v.x());
+                    case SimpleDir::Down: return IVec2(v.y(), -v.x());
+                    case SimpleDir::Left: return IVec2(-v.x(), -v.y());
+                    default: return IVec2(v.x(), v.y());
+                }
+            }
+
+            // The cell next to p in the given direction, wrapping around
+            static UVec2 neighbor (const UVec2 p, const SimpleDir d, const UVec2 dims) {
+                switch (d) {
+                    case SimpleDir::Up: return UVec2(p.x(), (0 == p.y() ? dims.y() : p.y()) - 1);
+                    case SimpleDir::Down: return UVec2(p.x(), (dims.y() - 1 == p.y() ? 0 : p.y() + 1));
+                    case SimpleDir::Left: return UVec2((0 == p.x() ? dims.x() : p.x()) - 1, p.y());
+                    default: return UVec2((dims.x() - 1 == p.x() ? 0 : p.x() + 1), p.y());
+                }
+            }
+
         private:
+            Brain brain;
+            uint64_t next_id = 0;
+            uint64_t births = 0;
+            uint64_t deaths = 0;
+
+            std::vector<uint64_t> ids;
+            std::vector<UVec2> positions;
+            std::vector<SimpleDir> dirs;
+            std::vector<float> energy;
+            std::vector<uint32_t> species_of;
+            std::vector<uint8_t> periods;
+
+            // Awake organisms, and where each one is in that list
+            std::vector<uint8_t> ready;
+            std::vector<uint32_t> awake;
+            std::vector<uint32_t> awake_slot;
+            bool all_awake = true;
+
+            bool indexing = false;
+            std::unordered_map<uint64_t, uint32_t> index_of;
+
+            std::vector<uint64_t> acted;
+            std::vector<UVec2> eaten;
+            std::vector<uint64_t> died;
+
+            std::vector<float> sensors;
+            std::vector<UVec2> row_positions;
+            std::vector<SimpleDir> row_dirs;
+            std::vector<spatial::Hit> smelled;
+            std::vector<vision::Sight> sights;
+            std::vector<uint8_t> decisions;
+            std::vector<float> fitness;
+
+            // Species and decisions of the awake organisms only
+            std::vector<uint32_t> row_species;
+            std::vector<uint8_t> row_decisions;
+
+            void wake_index (const size_t i) {
+                if (ready[i]) return;
+                ready[i] = 1;
+                awake_slot[i] = static_cast<uint32_t>(awake.size());
+                awake.push_back(static_cast<uint32_t>(i));
+            }
+
+            void sleep_index (const size_t i) {
+                if (!ready[i]) return;
+                ready[i] = 0;
+
+                const uint32_t moved = awake.back();
+                awake[awake_slot[i]] = moved;
+                awake_slot[moved] = awake_slot[i];
+                awake.pop_back();
+            }
+
+            // Swaps the last organism into i
+            void remove (const size_t i) {
+                deaths += 1;
+                died.push_back(ids[i]);
+                if (indexing) {
+                    index_of.erase(ids[i]);
+                    if (i + 1 < ids.size()) index_of[ids.back()] = static_cast<uint32_t>(i);
+                }
+
+                sleep_index(i);
+                const size_t last = ids.size() - 1;
+                if (i < last && ready[last]) awake[awake_slot[last]] = static_cast<uint32_t>(i);
+
+                ids[i] = ids.back(); ids.pop_back();
+                positions[i] = positions.back(); positions.pop_back();
+                dirs[i] = dirs.back(); dirs.pop_back();
+                energy[i] = energy.back(); energy.pop_back();
+                species_of[i] = species_of.back(); species_of.pop_back();
+                decisions[i] = decisions.back(); decisions.pop_back();
+                periods[i] = periods.back(); periods.pop_back();
+                ready[i] = ready.back(); ready.pop_back();
+                awake_slot[i] = awake_slot.back(); awake_slot.pop_back();
+            }
     };
-}
\ No newline at end of file
+}
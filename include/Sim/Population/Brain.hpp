@@ -0,0 +1,535 @@
+#pragma once
+
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include "utils/Cpu.hpp"
+
+#if defined(CPU_DISPATCH)
+    #include <immintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+#include "Sim/sim_constants.hpp"
+#include "utils/ThreadPool.hpp"
+
+
+namespace brain {
+    using ThreadPool = pool::ThreadPool;
+
+    // Shape of the perceptron shared by every organism: one ReLU hidden layer
+    //  and a linear output layer whose highest output is the decision.
+    class BrainTopology {
+        public:
+            unsigned inputs = 0;
+            unsigned hidden = 0;
+            unsigned outputs = 0;
+
+            // Weights of one species, laid out as W1[inputs][hidden], b1[hidden],
+            //  W2[hidden][outputs], b2[outputs].
+            size_t weight_count () const {
+                return static_cast<size_t>(inputs) * hidden + hidden
+                    + static_cast<size_t>(hidden) * outputs + outputs;
+            }
+    };
+
+
+    // Evaluates the brains of a whole population at once. Organisms are
+    //  grouped by species so each group is a single matrix product against
+    //  the weights of its species, split in row blocks over the thread pool.
+    class Brain {
+        public:
+            Brain () {}
+
+            Brain (const BrainTopology brain_topology, const bool use_int8 = false) :
+                topology(brain_topology),
+                quantized(use_int8)
+            {}
+
+            ~Brain () {}
+
+            // Adds a species with the given weights, returning its index
+            uint32_t add_species (const float* species_weights) {
+                weights.insert(weights.end(), species_weights, species_weights + topology.weight_count());
+                dirty = true;
+                return static_cast<uint32_t>(get_species_count() - 1);
+            }
+
+            // Weights of a species, to be changed in place by evolution
+            float* get_weights (const uint32_t species) {
+                dirty = true;
+                return &weights[species * topology.weight_count()];
+            }
+
+            const float* get_weights (const uint32_t species) const {
+                return &weights[species * topology.weight_count()];
+            }
+
+            // Trades the weight buffer for another of the same layout, which
+            //  lets evolution breed into a buffer without copying it back.
+            void swap_weights (std::vector<float>& other) {
+                if (0 != other.size() % std::max<size_t>(1, topology.weight_count())) {
+                    throw std::invalid_argument("Weights do not match the brain topology");
+                }
+
+                weights.swap(other);
+                dirty = true;
+            }
+
+            void clear_species () {
+                weights.clear();
+                dirty = true;
+            }
+
+            size_t get_species_count () const {
+                const size_t count = topology.weight_count();
+                return 0 == count ? 0 : weights.size() / count;
+            }
+
+            const BrainTopology& get_topology () const {return topology;}
+            bool is_quantized () const {return quantized;}
+            void set_quantized (const bool use_int8) {quantized = use_int8; dirty = true;}
+
+            /**
+            * @brief Decide for every organism.
+            * @param sensors n rows of topology.inputs sensor values.
+            * @param species Species of each organism.
+            * @param n Amount of organisms.
+            * @param decisions Output, index of the highest output per organism.
+            * @param pool Pool the row blocks are spread over.
+            */
+            void evaluate (
+                const float* sensors,
+                const uint32_t* species,
+                const size_t n,
+                uint8_t* decisions,
+                ThreadPool& pool
+            ) {
+                if (0 == n || 0 == get_species_count()) return;
+                if (dirty && quantized) quantize_weights();
+                dirty = false;
+
+                group(species, n);
+                gather(sensors, n);
+
+                const unsigned out = topology.outputs;
+
+                // Blocks never cross a species boundary
+                std::vector<Block> blocks;
+                for (size_t s = 0; s + 1 < group_offsets.size(); s++) {
+                    for (size_t b = group_offsets[s]; b < group_offsets[s + 1]; b += sim::BRAIN_BLOCK_ROWS) {
+                        blocks.push_back({
+                            static_cast<uint32_t>(s),
+                            b,
+                            std::min(group_offsets[s + 1], b + sim::BRAIN_BLOCK_ROWS)
+                        });
+                    }
+                }
+
+                outputs.resize(n * out);
+                pool.parallel_for(0, blocks.size(), 1, [&](size_t begin, size_t end) {
+                    std::vector<float> hidden_rows;
+                    Scratch scratch;
+
+                    for (size_t i = begin; i < end; i++) run_block(blocks[i], hidden_rows, scratch);
+                });
+
+                // Scatter the decisions back in organism order
+                for (size_t r = 0; r < n; r++) {
+                    const float* o = &outputs[r * out];
+                    decisions[order[r]] = static_cast<uint8_t>(std::max_element(o, o + out) - o);
+                }
+            }
+
+        private:
+            struct Block {
+                uint32_t species;
+                size_t begin;
+                size_t end;
+            };
+
+            // Per thread buffers of the int8 path
+            struct Scratch {
+                std::vector<int8_t> row;
+                std::vector<int16_t> row16;
+                std::vector<int16_t> weights16;
+            };
+
+            BrainTopology topology;
+            bool quantized = false;
+            bool dirty = true;
+
+            std::vector<float> weights;
+
+            // Int8 copy of the weights, one padded row per neuron, with the
+            //  scale of each row.
+            std::vector<int8_t> q_weights1, q_weights2;
+            std::vector<float> q_scales1, q_scales2;
+
+            // Per call scratch: rows sorted by species
+            std::vector<size_t> order;
+            std::vector<size_t> group_offsets;
+            std::vector<float> inputs;
+            std::vector<float> outputs;
+
+            static size_t pad16 (const size_t v) {return (v + 15) & ~size_t(15);}
+
+            void group (const uint32_t* species, const size_t n) {
+                const size_t species_count = get_species_count();
+
+                group_offsets.assign(species_count + 1, 0);
+                for (size_t i = 0; i < n; i++) group_offsets[species[i] + 1] += 1;
+                for (size_t s = 0; s < species_count; s++) group_offsets[s + 1] += group_offsets[s];
+
+                std::vector<size_t> cursor (group_offsets.begin(), group_offsets.end() - 1);
+                order.resize(n);
+                for (size_t i = 0; i < n; i++) order[cursor[species[i]]++] = i;
+            }
+
+            void gather (const float* sensors, const size_t n) {
+                const unsigned in = topology.inputs;
+                inputs.resize(n * in);
+                for (size_t r = 0; r < n; r++) {
+                    std::copy(&sensors[order[r] * in], &sensors[order[r] * in] + in, &inputs[r * in]);
+                }
+            }
+
+            void run_block (const Block& block, std::vector<float>& hidden_rows, Scratch& scratch) {
+                const unsigned in = topology.inputs;
+                const unsigned hid = topology.hidden;
+                const unsigned out = topology.outputs;
+                const size_t rows = block.end - block.begin;
+
+                const float* w = &weights[block.species * topology.weight_count()];
+                const float* w1 = w;
+                const float* b1 = w1 + static_cast<size_t>(in) * hid;
+                const float* w2 = b1 + hid;
+                const float* b2 = w2 + static_cast<size_t>(hid) * out;
+
+                hidden_rows.resize(rows * hid);
+                const float* x = &inputs[block.begin * in];
+                float* y = &outputs[block.begin * out];
+
+                if (quantized) {
+                    const size_t s = block.species;
+                    layer_int8(
+                        x, rows, in, &q_weights1[s * hid * pad16(in)], &q_scales1[s * hid],
+                        b1, hid, true, hidden_rows.data(), scratch
+                    );
+                    layer_int8(
+                        hidden_rows.data(), rows, hid, &q_weights2[s * out * pad16(hid)], &q_scales2[s * out],
+                        b2, out, false, y, scratch
+                    );
+                } else {
+                    layer_float(x, rows, in, w1, b1, hid, true, hidden_rows.data());
+                    layer_float(hidden_rows.data(), rows, hid, w2, b2, out, false, y);
+                }
+            }
+
+            // Y[rows][m] = act(X[rows][k] * W[k][m] + b), computed in tiles of
+            //  4 rows by 4, 8 or 16 outputs held in registers. Each output sums
+            //  its products in the same order whatever the tile width, so
+            //  every instruction set decides the same.
+            static void layer_float (
+                const float* x,
+                const size_t rows,
+                const unsigned k,
+                const float* w,
+                const float* b,
+                const unsigned m,
+                const bool relu,
+                float* y
+            ) {
+                size_t r = 0;
+
+                #if defined(__SSE2__)
+                    const cpu::Isa isa = cpu::level();
+                    const __m128 zero = _mm_setzero_ps();
+
+                    for (; cpu::Isa::Sse2 <= isa && r + 4 <= rows; r += 4) {
+                        const float* x0 = x + (r + 0) * k;
+                        const float* x1 = x + (r + 1) * k;
+                        const float* x2 = x + (r + 2) * k;
+                        const float* x3 = x + (r + 3) * k;
+
+                        unsigned j = 0;
+
+                        #if defined(CPU_DISPATCH)
+                            if (cpu::Isa::Avx512 == isa) j = tiles_avx512(x + r * k, k, w, b, m, relu, y + r * m, j);
+                            if (cpu::Isa::Avx2 <= isa) j = tiles_avx2(x + r * k, k, w, b, m, relu, y + r * m, j);
+                        #endif
+
+                        for (; j + 4 <= m; j += 4) {
+                            __m128 a0 = _mm_loadu_ps(b + j);
+                            __m128 a1 = a0, a2 = a0, a3 = a0;
+
+                            for (unsigned i = 0; i < k; i++) {
+                                const __m128 wv = _mm_loadu_ps(w + static_cast<size_t>(i) * m + j);
+                                a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_set1_ps(x0[i]), wv));
+                                a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_set1_ps(x1[i]), wv));
+                                a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_set1_ps(x2[i]), wv));
+                                a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_set1_ps(x3[i]), wv));
+                            }
+
+                            if (relu) {
+                                a0 = _mm_max_ps(a0, zero);
+                                a1 = _mm_max_ps(a1, zero);
+                                a2 = _mm_max_ps(a2, zero);
+                                a3 = _mm_max_ps(a3, zero);
+                            }
+
+                            _mm_storeu_ps(y + (r + 0) * m + j, a0);
+                            _mm_storeu_ps(y + (r + 1) * m + j, a1);
+                            _mm_storeu_ps(y + (r + 2) * m + j, a2);
+                            _mm_storeu_ps(y + (r + 3) * m + j, a3);
+                        }
+
+                        for (size_t t = r; t < r + 4; t++) {
+                            for (unsigned jj = j; jj < m; jj++) y[t * m + jj] = neuron(x + t * k, k, w, b, m, jj, relu);
+                        }
+                    }
+                #endif
+
+                for (; r < rows; r++) {
+                    for (unsigned j = 0; j < m; j++) y[r * m + j] = neuron(x + r * k, k, w, b, m, j, relu);
+                }
+            }
+
+            #if defined(CPU_DISPATCH)
+                // 4 rows of outputs from j on, 8 at a time. Returns where it stopped.
+                CPU_TARGET_AVX2 static unsigned tiles_avx2 (
+                    const float* x,
+                    const unsigned k,
+                    const float* w,
+                    const float* b,
+                    const unsigned m,
+                    const bool relu,
+                    float* y,
+                    unsigned j
+                ) {
+                    const __m256 zero = _mm256_setzero_ps();
+
+                    for (; j + 8 <= m; j += 8) {
+                        __m256 a0 = _mm256_loadu_ps(b + j);
+                        __m256 a1 = a0, a2 = a0, a3 = a0;
+
+                        for (unsigned i = 0; i < k; i++) {
+                            const __m256 wv = _mm256_loadu_ps(w + static_cast<size_t>(i) * m + j);
+                            a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_set1_ps(x[i]), wv));
+                            a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_set1_ps(x[k + i]), wv));
+                            a2 = _mm256_add_ps(a2, _mm256_mul_ps(_mm256_set1_ps(x[2 * k + i]), wv));
+                            a3 = _mm256_add_ps(a3, _mm256_mul_ps(_mm256_set1_ps(x[3 * k + i]), wv));
+                        }
+
+                        if (relu) {
+                            a0 = _mm256_max_ps(a0, zero);
+                            a1 = _mm256_max_ps(a1, zero);
+                            a2 = _mm256_max_ps(a2, zero);
+                            a3 = _mm256_max_ps(a3, zero);
+                        }
+
+                        _mm256_storeu_ps(y + j, a0);
+                        _mm256_storeu_ps(y + m + j, a1);
+                        _mm256_storeu_ps(y + 2 * m + j, a2);
+                        _mm256_storeu_ps(y + 3 * m + j, a3);
+                    }
+
+                    return j;
+                }
+
+                // Same, 16 at a time
+                CPU_TARGET_AVX512 static unsigned tiles_avx512 (
+                    const float* x,
+                    const unsigned k,
+                    const float* w,
+                    const float* b,
+                    const unsigned m,
+                    const bool relu,
+                    float* y,
+                    unsigned j
+                ) {
+                    const __m512 zero = _mm512_setzero_ps();
+
+                    for (; j + 16 <= m; j += 16) {
+                        __m512 a0 = _mm512_loadu_ps(b + j);
+                        __m512 a1 = a0, a2 = a0, a3 = a0;
+
+                        for (unsigned i = 0; i < k; i++) {
+                            const __m512 wv = _mm512_loadu_ps(w + static_cast<size_t>(i) * m + j);
+                            a0 = _mm512_add_ps(a0, _mm512_mul_ps(_mm512_set1_ps(x[i]), wv));
+                            a1 = _mm512_add_ps(a1, _mm512_mul_ps(_mm512_set1_ps(x[k + i]), wv));
+                            a2 = _mm512_add_ps(a2, _mm512_mul_ps(_mm512_set1_ps(x[2 * k + i]), wv));
+                            a3 = _mm512_add_ps(a3, _mm512_mul_ps(_mm512_set1_ps(x[3 * k + i]), wv));
+                        }
+
+                        // Masked moves rather than max, which trips an
+                        //  uninitialized warning in some compiler headers
+                        if (relu) {
+                            a0 = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(a0, zero, _CMP_GT_OQ), a0);
+                            a1 = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(a1, zero, _CMP_GT_OQ), a1);
+                            a2 = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(a2, zero, _CMP_GT_OQ), a2);
+                            a3 = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(a3, zero, _CMP_GT_OQ), a3);
+                        }
+
+                        _mm512_storeu_ps(y + j, a0);
+                        _mm512_storeu_ps(y + m + j, a1);
+                        _mm512_storeu_ps(y + 2 * m + j, a2);
+                        _mm512_storeu_ps(y + 3 * m + j, a3);
+                    }
+
+                    return j;
+                }
+            #endif
+
+            static float neuron (
+                const float* x,
+                const unsigned k,
+                const float* w,
+                const float* b,
+                const unsigned m,
+                const unsigned j,
+                const bool relu
+            ) {
+                float a = b[j];
+                for (unsigned i = 0; i < k; i++) a += x[i] * w[static_cast<size_t>(i) * m + j];
+                return (relu && 0.0f > a) ? 0.0f : a;
+            }
+
+            // Symmetric per row quantization to int8, returning the scale
+            static float quantize_row (const float* v, const size_t n, const size_t stride, int8_t* q, const size_t padded) {
+                float max_abs = 0.0f;
+                for (size_t i = 0; i < n; i++) max_abs = std::max(max_abs, std::fabs(v[i * stride]));
+
+                const float scale = 0.0f < max_abs ? max_abs / 127.0f : 1.0f;
+                const float inv = 1.0f / scale;
+
+                for (size_t i = 0; i < n; i++) {
+                    const float scaled = v[i * stride] * inv;
+                    q[i] = static_cast<int8_t>(scaled + (0.0f > scaled ? -0.5f : 0.5f));
+                }
+                for (size_t i = n; i < padded; i++) q[i] = 0;
+
+                return scale;
+            }
+
+            void quantize_weights () {
+                const unsigned in = topology.inputs;
+                const unsigned hid = topology.hidden;
+                const unsigned out = topology.outputs;
+                const size_t species_count = get_species_count();
+
+                q_weights1.assign(species_count * hid * pad16(in), 0);
+                q_weights2.assign(species_count * out * pad16(hid), 0);
+                q_scales1.assign(species_count * hid, 1.0f);
+                q_scales2.assign(species_count * out, 1.0f);
+
+                for (size_t s = 0; s < species_count; s++) {
+                    const float* w1 = &weights[s * topology.weight_count()];
+                    const float* w2 = w1 + static_cast<size_t>(in) * hid + hid;
+
+                    // Transposed so each neuron reads a contiguous row
+                    for (unsigned j = 0; j < hid; j++) {
+                        q_scales1[s * hid + j] = quantize_row(
+                            w1 + j, in, hid, &q_weights1[(s * hid + j) * pad16(in)], pad16(in)
+                        );
+                    }
+
+                    for (unsigned j = 0; j < out; j++) {
+                        q_scales2[s * out + j] = quantize_row(
+                            w2 + j, hid, out, &q_weights2[(s * out + j) * pad16(hid)], pad16(hid)
+                        );
+                    }
+                }
+            }
+
+            // Int8 values widened to int16, the operand width of madd
+            static void widen (const int8_t* q, const size_t n, int16_t* out) {
+                for (size_t i = 0; i < n; i++) out[i] = q[i];
+            }
+
+            // Y[rows][m] = act(dequant(Xq[rows][k] . Wq[m][k]) + b). The
+            //  weights are widened once per block, each row once, and
+            //  4 neurons are reduced together.
+            static void layer_int8 (
+                const float* x,
+                const size_t rows,
+                const unsigned k,
+                const int8_t* w,
+                const float* w_scales,
+                const float* b,
+                const unsigned m,
+                const bool relu,
+                float* y,
+                Scratch& scratch
+            ) {
+                const size_t padded = pad16(k);
+
+                scratch.row.resize(padded);
+                scratch.row16.resize(padded);
+                scratch.weights16.resize(m * padded);
+                widen(w, m * padded, scratch.weights16.data());
+
+                const int16_t* xs = scratch.row16.data();
+                const int16_t* ws = scratch.weights16.data();
+                [[maybe_unused]] const bool sse2 = cpu::Isa::Sse2 <= cpu::level();
+
+                for (size_t r = 0; r < rows; r++) {
+                    const float x_scale = quantize_row(x + r * k, k, 1, scratch.row.data(), padded);
+                    widen(scratch.row.data(), padded, scratch.row16.data());
+
+                    float* out = y + r * m;
+                    unsigned j = 0;
+
+                    #if defined(__SSE2__)
+                        const __m128 vx_scale = _mm_set1_ps(x_scale);
+
+                        for (; sse2 && j + 4 <= m; j += 4) {
+                            __m128i a[4];
+                            for (unsigned t = 0; t < 4; t++) {
+                                const int16_t* wr = ws + (j + t) * padded;
+                                __m128i acc = _mm_setzero_si128();
+
+                                for (size_t i = 0; i < padded; i += 8) {
+                                    acc = _mm_add_epi32(acc, _mm_madd_epi16(
+                                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(xs + i)),
+                                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(wr + i))
+                                    ));
+                                }
+
+                                a[t] = acc;
+                            }
+
+                            // Transpose and add, leaving the 4 dot products in one register
+                            const __m128i t0 = _mm_unpacklo_epi32(a[0], a[1]);
+                            const __m128i t1 = _mm_unpackhi_epi32(a[0], a[1]);
+                            const __m128i t2 = _mm_unpacklo_epi32(a[2], a[3]);
+                            const __m128i t3 = _mm_unpackhi_epi32(a[2], a[3]);
+                            const __m128i sums = _mm_add_epi32(
+                                _mm_add_epi32(_mm_unpacklo_epi64(t0, t2), _mm_unpackhi_epi64(t0, t2)),
+                                _mm_add_epi32(_mm_unpacklo_epi64(t1, t3), _mm_unpackhi_epi64(t1, t3))
+                            );
+
+                            const __m128 scale = _mm_mul_ps(vx_scale, _mm_loadu_ps(w_scales + j));
+                            __m128 v = _mm_add_ps(_mm_loadu_ps(b + j), _mm_mul_ps(scale, _mm_cvtepi32_ps(sums)));
+                            if (relu) v = _mm_max_ps(v, _mm_setzero_ps());
+                            _mm_storeu_ps(out + j, v);
+                        }
+                    #endif
+
+                    for (; j < m; j++) {
+                        const int16_t* wr = ws + j * padded;
+                        int32_t acc = 0;
+                        for (size_t i = 0; i < padded; i++) acc += static_cast<int32_t>(xs[i]) * wr[i];
+
+                        const float v = b[j] + x_scale * w_scales[j] * static_cast<float>(acc);
+                        out[j] = (relu && 0.0f > v) ? 0.0f : v;
+                    }
+                }
+            }
+    };
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "Sim/sim_constants.hpp"
+#include "Sim/Board/Cell.hpp"
+#include "Sim/Board/BitPlanes.hpp"
+#include "utils/Vec.hpp"
+#include "utils/types.hpp"
+#include "utils/ThreadPool.hpp"
+
+
+namespace vision {
+    using CellType = cell::CellType;
+    using SimpleDir = types::SimpleDir;
+    using BitPlanes = bitplane::BitPlanes;
+    using ThreadPool = pool::ThreadPool;
+
+    // What a ray ran into first. Distance is in steps, 0 when the ray saw
+    //  nothing before its end.
+    class Sight {
+        public:
+            CellType type = CellType::Empty;
+            uint16_t distance = 0;
+    };
+
+    class Offset {
+        public:
+            int16_t x = 0;
+            int16_t y = 0;
+    };
+
+    // Consecutive steps of a ray along one row, scanned a word at a time
+    class Span {
+        public:
+            int16_t x = 0;
+            int16_t y = 0;
+            uint16_t first = 0;
+            uint16_t length = 0;
+            int8_t step = 1;
+    };
+
+    // The cells each ray of one facing goes through, relative to the
+    //  organism, as single steps and as row spans
+    template <unsigned RAYS, unsigned DISTANCE>
+    class RayTable {
+        public:
+            std::array<std::array<Offset, DISTANCE>, RAYS> offsets {};
+            std::array<std::array<Span, DISTANCE>, RAYS> spans {};
+            std::array<uint16_t, RAYS> span_counts {};
+    };
+
+    // n / d rounded to nearest, halves away from zero, for d > 0
+    constexpr int round_div (const int n, const int d) {
+        return 0 <= n ? (2 * n + d) / (2 * d) : -((-2 * n + d) / (2 * d));
+    }
+
+    // Rays fan evenly from the front left diagonal to the front right one.
+    //  They are drawn facing up and turned a quarter at a time, so every
+    //  facing sees the same shapes.
+    template <unsigned RAYS, unsigned DISTANCE>
+    constexpr RayTable<RAYS, DISTANCE> make_table (const SimpleDir dir) {
+        RayTable<RAYS, DISTANCE> table {};
+        constexpr int D = static_cast<int>(DISTANCE);
+
+        for (unsigned r = 0; r < RAYS; r++) {
+            const int end = (1 == RAYS) ? 0 : round_div(-D * static_cast<int>(RAYS - 1) + 2 * D * static_cast<int>(r), static_cast<int>(RAYS - 1));
+
+            for (int s = 1; s <= D; s++) {
+                const int ux = round_div(end * s, D);
+                const int uy = -s;
+
+                int x = ux, y = uy;
+                switch (dir) {
+                    case SimpleDir::Right: x = -uy; y = ux; break;
+                    case SimpleDir::Down: x = -ux; y = -uy; break;
+                    case SimpleDir::Left: x = uy; y = -ux; break;
+                    default: break;
+                }
+
+                table.offsets[r][s - 1].x = static_cast<int16_t>(x);
+                table.offsets[r][s - 1].y = static_cast<int16_t>(y);
+            }
+
+            // Steps staying on a row and moving one cell the same way join
+            //  the span before them
+            uint16_t count = 0;
+            for (unsigned s = 0; s < DISTANCE; s++) {
+                const Offset o = table.offsets[r][s];
+
+                if (0 < count) {
+                    Span& last = table.spans[r][count - 1];
+                    const int next = last.x + last.step * static_cast<int>(last.length);
+                    const bool along = last.y == o.y && (next == o.x || (1 == last.length && last.x - 1 == o.x));
+
+                    if (along) {
+                        if (1 == last.length) last.step = static_cast<int8_t>(o.x - last.x);
+                        last.length += 1;
+                        continue;
+                    }
+                }
+
+                Span& span = table.spans[r][count++];
+                span.x = o.x;
+                span.y = o.y;
+                span.first = static_cast<uint16_t>(s);
+                span.length = 1;
+                span.step = 1;
+            }
+            table.span_counts[r] = count;
+        }
+
+        return table;
+    }
+
+
+    /**
+    * @brief Ray cast vision over the board bitplanes.
+    *
+    * Each organism looks along RAYS rays of DISTANCE cells and gets the
+    *  first non empty cell of each. Rays are read from tables built at
+    *  compile time, and the steps a ray takes along a row are scanned 64
+    *  cells at a time from the occupancy words, so empty stretches cost a
+    *  bit scan instead of a cell read each.
+    */
+    template <unsigned RAYS = sim::VISION_RAYS, unsigned DISTANCE = sim::VISION_DISTANCE>
+    class Vision {
+        public:
+            static_assert(0 < RAYS && 0 < DISTANCE && DISTANCE < 0x8000, "Vision needs rays of some length");
+
+            using Table = RayTable<RAYS, DISTANCE>;
+
+            static constexpr unsigned RAY_COUNT = RAYS;
+            static constexpr unsigned RAY_DISTANCE = DISTANCE;
+
+            static constexpr std::array<Table, 4> TABLES = {
+                make_table<RAYS, DISTANCE>(SimpleDir::Up),
+                make_table<RAYS, DISTANCE>(SimpleDir::Right),
+                make_table<RAYS, DISTANCE>(SimpleDir::Down),
+                make_table<RAYS, DISTANCE>(SimpleDir::Left)
+            };
+
+            static const Table& table (const SimpleDir dir) {return TABLES[static_cast<size_t>(dir) - 1];}
+
+            // What one ray from the position sees
+            static Sight cast (const BitPlanes& planes, const UVec2 position, const SimpleDir dir, const unsigned ray) {
+                const Table& t = table(dir);
+                const UVec2 dims = planes.get_dimensions();
+
+                for (uint16_t i = 0; i < t.span_counts[ray]; i++) {
+                    const Span& span = t.spans[ray][i];
+                    const unsigned y = wrap(static_cast<int>(position.y()) + span.y, dims.y());
+                    const unsigned x = wrap(static_cast<int>(position.x()) + span.x, dims.x());
+
+                    const unsigned found = scan_row(planes, y, x, span.length, span.step);
+                    if (found == span.length) continue;
+
+                    const Offset o = t.offsets[ray][span.first + found];
+                    Sight sight;
+                    sight.type = planes.type_at(UVec2(
+                        wrap(static_cast<int>(position.x()) + o.x, dims.x()),
+                        y
+                    ));
+                    sight.distance = static_cast<uint16_t>(span.first + found + 1);
+                    return sight;
+                }
+
+                return Sight();
+            }
+
+            // Every ray from the position, into out[0] to out[RAYS - 1]
+            static void look (const BitPlanes& planes, const UVec2 position, const SimpleDir dir, Sight* out) {
+                for (unsigned r = 0; r < RAYS; r++) out[r] = cast(planes, position, dir, r);
+            }
+
+            /**
+            * @brief What every organism sees, in one pass over the pool.
+            * @param out RAYS sights per organism, organism i at i * RAYS.
+            *
+            * Only the regions within reach of the positions are caught up,
+            *  then only the bitplanes are read.
+            */
+            template <typename B>
+            static void evaluate (
+                const B& board,
+                const std::vector<UVec2>& positions,
+                const std::vector<SimpleDir>& dirs,
+                std::vector<Sight>& out,
+                ThreadPool& pool
+            ) {
+                out.resize(positions.size() * RAYS);
+                if (positions.empty()) return;
+
+                const BitPlanes& planes = board.get_planes_around(positions, DISTANCE);
+                pool.parallel_for(0, positions.size(), sim::BRAIN_BLOCK_ROWS, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++) look(planes, positions[i], dirs[i], &out[i * RAYS]);
+                });
+            }
+
+        private:
+            static unsigned wrap (const int v, const unsigned n) {
+                const int m = v % static_cast<int>(n);
+                return static_cast<unsigned>(0 > m ? m + static_cast<int>(n) : m);
+            }
+
+            // Index of the first occupied cell among n cells of row y, from
+            //  x going step (1 or -1) and wrapping around, or n if none is
+            static unsigned scan_row (const BitPlanes& planes, const unsigned y, unsigned x, const unsigned n, const int step) {
+                const unsigned width = planes.get_dimensions().x();
+
+                unsigned done = 0;
+                while (done < n) {
+                    const unsigned bit = x & 63;
+                    const uint64_t word = planes.any_word(y, x >> 6);
+
+                    if (0 < step) {
+                        const unsigned avail = std::min({64 - bit, n - done, width - x});
+                        const uint64_t hits = (word >> bit) & bitplane::bit_range(0, avail);
+                        if (0 != hits) return done + static_cast<unsigned>(__builtin_ctzll(hits));
+
+                        done += avail;
+                        x += avail;
+                        if (width == x) x = 0;
+                    } else {
+                        const unsigned avail = std::min({bit + 1, n - done, x + 1});
+                        const uint64_t hits = (word << (63 - bit)) & bitplane::bit_range(64 - avail, avail);
+                        if (0 != hits) return done + static_cast<unsigned>(__builtin_clzll(hits));
+
+                        done += avail;
+                        x = (avail > x) ? width - 1 : x - avail;
+                    }
+                }
+
+                return n;
+            }
+    };
+}
\ No newline at end of file
@@ -1,10 +1,13 @@
 #pragma once
 
 
-#include <sstream>
+#include <array>
+#include <string>
+#include <cstdio>
+#include <algorithm>
 
 #include "utils/Term.hpp"
-#include "utils/TermPlus.hpp"
+#include "utils/Screen.hpp"
 #include "utils/Timer.hpp"
 #include "Sim/sim_types.hpp"
 #include "Sim/Board.hpp"
@@ -12,128 +15,191 @@
 
 namespace printer {
     using Term = term::Term;
-    using TermPlus = term::TermPlus;
-    using Board = board::Board;
+    using Screen = canvas::Screen;
     using Timer = timer::Timer;
     using SimStatus = sim::SimStatus;
 
+    // Draws the board and its widgets into a screen model, then sends the
+    //  terminal only the cells that changed since the last frame.
     class Printer {
         public:
-            Printer () : term(Term::instance()), term_plus(TermPlus::instance()) {}
+            Printer () : term(Term::instance()) {}
             ~Printer () {}
 
+            template <typename B>
             void print(
-                const Board& board, 
+                const B& board, 
                 const Timer& timer, 
                 const SimStatus& sim_status,
                 const unsigned generation
             ) {
-                if (sim_status != saved_status) {
-                    saved_status = sim_status;
+                char timer_text[Timer::TEXT_SIZE];
+                timer.to_chars(timer_text, sizeof(timer_text));
+                print(board, timer_text, sim_status, generation);
+            }
+
+            // Same as above, with the timer already formatted (a viewer only
+            //  gets the numbers of a timer running in another process)
+            template <typename B>
+            void print(
+                const B& board, 
+                const std::string& timer_text, 
+                const SimStatus& sim_status,
+                const unsigned generation
+            ) {
+                print(board, timer_text.c_str(), sim_status, generation);
+            }
+
+            template <typename B>
+            void print(
+                const B& board, 
+                const char* timer_text, 
+                const SimStatus& sim_status,
+                const unsigned generation
+            ) {
+                screen.resize(
+                    static_cast<unsigned>(std::max(0, term.get_width())),
+                    static_cast<unsigned>(std::max(0, term.get_height()))
+                );
 
-                    print_all(board);
-                    print_edges();
-                    print_status(sim_status);
-                    print_timer(timer);
-                    print_generation(generation);
+                if (sim_status != saved_status || invalid) {
+                    saved_status = sim_status;
+                    invalid = false;
 
-                    if (sim_status.paused) print_paused();
+                    draw(board, timer_text, sim_status, generation);
+                    if (sim_status.paused) draw_paused();
                 } else if (sim_status.printing && !sim_status.paused) {
-                    bool board_is_of_diff_size = (
-                        0 >= state.get_length() 
-                        || state.get_dimensions() != board.get_dimensions()
-                    );
-
-                    if (board_is_of_diff_size) print_all(board);
-                    else print_diff(board);
-                    print_edges();
-                    print_status(sim_status);
-                    print_timer(timer);
-                    print_generation(generation);
-                } 
+                    draw(board, timer_text, sim_status, generation);
+                } else {
+                    return;
+                }
+
+                screen.flush([this](const unsigned x, const unsigned y, const std::wstring& glyphs, const uint8_t color) {
+                    term.printat(static_cast<int>(x), static_cast<int>(y), glyphs, color);
+                });
             }
 
+            // Redraws everything next time, as after the terminal was cleared
+            void invalidate () {
+                invalid = true;
+                screen.clear();
+                screen.invalidate();
+            }
+
+            // Counts of the dish, shown on the bottom edge from the next frame
+            void set_stats (const stats::Snapshot& snapshot) {
+                has_stats = true;
+                stats = {
+                    snapshot.get_count(cell::CellType::Food),
+                    snapshot.get_count(cell::CellType::Organism),
+                    snapshot.births,
+                    snapshot.deaths
+                };
+            }
 
         private:
             Term& term;
-            TermPlus& term_plus;
-            Board state;
+            Screen screen;
             SimStatus saved_status;
+            bool invalid = false;
+
+            bool has_stats = false;
+            std::array<uint64_t, 4> stats {};
+
+            template <typename B>
+            void draw (const B& board, const char* timer_text, const SimStatus& sim_status, const unsigned generation) {
+                draw_board(board);
+                draw_edges();
+                draw_status(sim_status);
+                draw_timer(timer_text);
+                draw_generation(generation);
+                if (has_stats) draw_stats();
+            }
 
-            inline void print_all (const Board& board) {
-                state = board;
-
-                UVec2 p;
-                UVec2 board_dim = board.get_dimensions();
-                for (p.y() = 0; p.y() < board_dim.y(); p.y() += 1) {
-                    for (p.x() = 0; p.x() < board_dim.x(); p.x() += 1) {
-                        cell::Cell c = board.get_raw(p);
-                        term.printat(p.x(), p.y(), c.to_str(), c.get_color());
-                    }
+            template <typename B>
+            void draw_board (const B& board) {
+                UVec2 board_dim = visible(board);
+                for (unsigned y = 0; y < board_dim.y(); y++) {
+                    board.for_each_in_row(y, 0, board_dim.x(), [&](const unsigned x, const cell::Cell c) {
+                        screen.put(x, y, c.glyph(), c.get_color());
+                    });
                 }
             }
 
-            inline void print_diff (const Board& board) {
-                UVec2 p;
-                UVec2 board_dim = board.get_dimensions();
-                for (p.y() = 0; p.y() < board_dim.y(); p.y() += 1) {
-                    for (p.x() = 0; p.x() < board_dim.x(); p.x() += 1) {
-                        cell::Cell c = board.get_raw(p);
-
-                        // If there is no difference, we do not print
-                        if (state.get_raw(p) == c) continue;
+            // The part of the board inside the terminal, which may have
+            //  shrunk since the board was made
+            template <typename B>
+            UVec2 visible (const B& board) const {
+                const UVec2 dims = board.get_dimensions();
+                return UVec2(
+                    std::min(dims.x(), static_cast<unsigned>(std::max(0, term.get_width()))),
+                    std::min(dims.y(), static_cast<unsigned>(std::max(0, term.get_height())))
+                );
+            }
 
-                        // Save difference
-                        state.set(p, c);
+            void draw_edges () {
+                const unsigned w = screen.get_width();
+                const unsigned h = screen.get_height();
+                if (2 > w || 2 > h) return;
 
-                        // Print difference
-                        term.printat(p.x(), p.y(), c.to_str(), c.get_color());
-                    }
+                screen.fill(1, 0, w - 2, L'─');
+                screen.fill(1, h - 1, w - 2, L'─');
+                for (unsigned y = 1; y < h - 1; y++) {
+                    screen.put(0, y, L'│');
+                    screen.put(w - 1, y, L'│');
                 }
+
+                screen.put(0, 0, L'┌');
+                screen.put(w - 1, 0, L'┐');
+                screen.put(0, h - 1, L'└');
+                screen.put(w - 1, h - 1, L'┘');
             }
 
-            inline void print_edges () const {
-                term_plus.rect_outline(
-                    UVec2(0u, 0u), 
-                    term_plus.get_dimensions() - UVec2(1u, 1u)
-                );
+            void draw_timer (const char* timer_text) {
+                screen.text(static_cast<unsigned>(std::max(0, term.get_width() - 101)), screen.get_height() - 1, timer_text);
             }
 
-            inline void print_timer (const Timer& timer) const {
-                term.printat(
-                    term.get_width() - 101, 
-                    term.get_height() - 1,
-                    timer.to_str()
+            void draw_status (const SimStatus& sim_status) {
+                char text[64];
+                std::snprintf(text, sizeof(text), "<sync: %s, powersave: %s, ui: %s, >",
+                    sim_status.syncing ? "ON" : "OFF",
+                    sim_status.powersave ? "ON" : "OFF",
+                    sim_status.printing ? "ON" : "OFF"
                 );
+                screen.text(5, 0, text);
             }
 
-            inline void print_status (const SimStatus& sim_status) {
-                std::wstringstream wss;
-                wss << "<" 
-                    << "sync: " << (sim_status.syncing ? "ON" : "OFF") << ", "
-                    << "powersave: " << (sim_status.powersave ? "ON" : "OFF") << ", "
-                    << "ui: " << (sim_status.printing ? "ON" : "OFF") << ", "
-                    << ">";
+            // On the bottom edge, left of the timer
+            void draw_stats () {
+                char text[128];
+                std::snprintf(text, sizeof(text), "<food: %llu, organisms: %llu, births: %llu, deaths: %llu>",
+                    static_cast<unsigned long long>(stats[0]),
+                    static_cast<unsigned long long>(stats[1]),
+                    static_cast<unsigned long long>(stats[2]),
+                    static_cast<unsigned long long>(stats[3])
+                );
 
-                term.printat(5, 0, wss.str());
+                const int room = term.get_width() - 101 - 5 - 1;
+                if (0 >= room) return;
+                text[std::min<size_t>(static_cast<size_t>(room), sizeof(text) - 1)] = '\0';
+                screen.text(5, screen.get_height() - 1, text);
             }
 
-            // NOTE: the code might error here due to term index out of bounds
-            inline void print_paused () const {
+            void draw_paused () {
                 unsigned x = term.get_width() / 2 - 8;
                 unsigned y = term.get_height() / 2;
 
-                term.printat(x, y - 2,  L"              ");
-                term.printat(x, y - 1,  L"  ╭────────╮  ");
-                term.printat(x, y,      L"  │ PAUSED │  ");
-                term.printat(x, y + 1,  L"  ╰────────╯  ");
-                term.printat(x, y + 2,  L"              ");
+                screen.text(x, y - 2,  L"              ");
+                screen.text(x, y - 1,  L"  ╭────────╮  ");
+                screen.text(x, y,      L"  │ PAUSED │  ");
+                screen.text(x, y + 1,  L"  ╰────────╯  ");
+                screen.text(x, y + 2,  L"              ");
             } 
 
-            inline void print_generation (const unsigned generation) {
-                std::wstringstream wss;
-                wss << "<Generation: " << generation << ">";
-                term.printat(term.get_width() - 24, 0,  wss.str());
+            void draw_generation (const unsigned generation) {
+                char text[32];
+                std::snprintf(text, sizeof(text), "<Generation: %u>", generation);
+                screen.text(static_cast<unsigned>(std::max(0, term.get_width() - 24)), 0, text);
             }
     };
 }
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+
+
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+
+#include "Sim/Board/Stats.hpp"
+
+
+namespace statslog {
+    using Snapshot = stats::Snapshot;
+
+    class StatsParams {
+        public:
+            std::string path;
+
+            // Generations between two lines
+            uint64_t every = 1;
+
+            // Per region arrays make lines grow with the board
+            bool heatmaps = true;
+
+            // Seconds between two flushes of the file
+            double flush_every = 1.0;
+    };
+
+
+    // Appends dish snapshots to a JSONL file, one line per snapshot, as a
+    //  time series for dashboards. Does nothing when made without a path.
+    //  Lines are flushed every params.flush_every seconds and on flush.
+    class StatsLog {
+        public:
+            StatsLog () {}
+
+            StatsLog (const StatsParams log_params) : params(log_params) {
+                out.open(params.path, std::ios::app);
+                if (!out) throw std::runtime_error("Can not open stats output " + params.path);
+            }
+
+            bool is_valid () const {return out.is_open();}
+
+            bool is_due (const uint64_t generation) const {
+                return is_valid() && 0 != params.every && 0 == generation % params.every;
+            }
+
+            void write (const Snapshot& snapshot) {
+                out << snapshot.to_jsonl(params.heatmaps) << "\n";
+
+                const auto now = std::chrono::steady_clock::now();
+                if (now < next_flush) return;
+                flush();
+                next_flush = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(params.flush_every)
+                );
+            }
+
+            void flush () {if (is_valid()) out.flush();}
+
+        private:
+            StatsParams params;
+            std::ofstream out;
+            std::chrono::steady_clock::time_point next_flush;
+    };
+}
\ No newline at end of file
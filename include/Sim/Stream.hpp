@@ -0,0 +1,543 @@
+#pragma once
+
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "Sim/sim_constants.hpp"
+#include "Sim/Mirror.hpp"
+#include "utils/Timer.hpp"
+#include "utils/Vec.hpp"
+
+
+namespace stream {
+    using Frame = mirror::Frame;
+    using SimStatus = sim::SimStatus;
+    using Timer = timer::Timer;
+
+    // Every message is a type byte and a payload size, then the payload:
+    //  Keyframe: generation u64, width u32, height u32, packed cells u32[]
+    //  Diff: first and last generation u64, count u32, (index, cell) u32[]
+    //  Status: packed status u32, delta, mean and up time f64, frames u64
+    // Cell indices are row major, and every number is little endian.
+    enum class Message : uint8_t {
+        Keyframe = 1, Diff = 2, Status = 3
+    };
+
+    constexpr size_t MESSAGE_HEADER = 5;
+    constexpr size_t STATUS_PAYLOAD = 36;
+
+    // "unix:/tmp/warms.sock" or any path is a Unix socket, "tcp:7000" or a
+    //  bare port number a TCP socket on localhost.
+    class Address {
+        public:
+            bool is_unix = true;
+            std::string path;
+            uint16_t port = 0;
+
+            static Address parse (const std::string& text) {
+                Address a;
+                if (0 == text.rfind("unix:", 0)) {
+                    a.path = text.substr(5);
+                } else if (0 == text.rfind("tcp:", 0)) {
+                    a.is_unix = false;
+                    a.port = static_cast<uint16_t>(std::stoul(text.substr(4)));
+                } else if (!text.empty() && std::string::npos == text.find_first_not_of("0123456789")) {
+                    a.is_unix = false;
+                    a.port = static_cast<uint16_t>(std::stoul(text));
+                } else {
+                    a.path = text;
+                }
+
+                if (a.is_unix && (a.path.empty() || a.path.size() >= sizeof(sockaddr_un::sun_path))) {
+                    throw std::invalid_argument("Bad socket path " + a.path);
+                }
+                return a;
+            }
+
+            // Socket bound (server) or connected (client) to the address
+            int open (const bool server) const {
+                const int fd = socket(is_unix ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (0 > fd) throw std::runtime_error("Can not create socket");
+
+                int result;
+                if (is_unix) {
+                    sockaddr_un addr {};
+                    addr.sun_family = AF_UNIX;
+                    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+                    if (server) unlink(path.c_str());
+
+                    result = server
+                        ? bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))
+                        : connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+                } else {
+                    sockaddr_in addr {};
+                    addr.sin_family = AF_INET;
+                    addr.sin_port = htons(port);
+                    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+                    const int yes = 1;
+                    if (server) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+                    else setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+                    result = server
+                        ? bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))
+                        : connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+                }
+
+                if (0 == result && server) result = listen(fd, 16);
+                if (0 != result) {
+                    close(fd);
+                    throw std::runtime_error("Can not reach socket " + (is_unix ? path : std::to_string(port)));
+                }
+
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                return fd;
+            }
+    };
+
+
+    /**
+    * @brief Streams a board to any amount of local clients.
+    *
+    * Clients get a keyframe when they connect, then the cells changed since
+    *  their last message, batched over sim::STREAM_BATCH generations. All
+    *  sockets are non-blocking behind one epoll, so the sim never waits for
+    *  a client: one that falls sim::STREAM_BACKLOG bytes behind its last
+    *  keyframe loses its queued diffs and is sent a fresh keyframe instead.
+    *  A status message goes with every batch, and whenever the status
+    *  changes while the sim is paused.
+    */
+    class StreamServer {
+        public:
+            StreamServer () {}
+
+            StreamServer (const std::string& address, const uint64_t generations_per_batch = sim::STREAM_BATCH)
+                : batch(std::max<uint64_t>(1, generations_per_batch))
+            {
+                const Address a = Address::parse(address);
+                if (a.is_unix) unix_path = a.path;
+
+                listener = a.open(true);
+                epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+                if (0 > epoll_fd) {
+                    close(listener);
+                    throw std::runtime_error("Can not create epoll");
+                }
+
+                watch(listener, EPOLLIN, EPOLL_CTL_ADD);
+            }
+
+            StreamServer (const StreamServer&) = delete;
+            StreamServer& operator= (const StreamServer&) = delete;
+
+            StreamServer (StreamServer&& other) noexcept {*this = std::move(other);}
+
+            StreamServer& operator= (StreamServer&& other) noexcept {
+                if (this == &other) return *this;
+                release();
+
+                listener = other.listener;
+                epoll_fd = other.epoll_fd;
+                unix_path = std::move(other.unix_path);
+                clients = std::move(other.clients);
+                batch = other.batch;
+                batch_start = other.batch_start;
+                sent_status = other.sent_status;
+
+                other.listener = -1;
+                other.epoll_fd = -1;
+                other.unix_path.clear();
+                other.clients.clear();
+                return *this;
+            }
+
+            ~StreamServer () {release();}
+
+            bool is_valid () const {return 0 <= listener;}
+            size_t get_client_count () const {return clients.size();}
+
+            /**
+            * @brief Serve clients. Call every generation, and every frame
+            *  while paused.
+            * @param board Board being streamed.
+            * @param timer Timer of the sim, sent along with its status.
+            * @param status Status of the sim.
+            * @param generation Generation the board is at.
+            */
+            template <typename B>
+            void update (const B& board, const Timer& timer, const SimStatus& status, const uint64_t generation) {
+                if (!is_valid()) return;
+                board.track_changes();
+
+                bool keyframe_wanted = false;
+                epoll_event events[64];
+                const int n = epoll_wait(epoll_fd, events, 64, 0);
+
+                for (int e = 0; e < n; e++) {
+                    const int fd = events[e].data.fd;
+                    if (listener == fd) {
+                        keyframe_wanted |= accept_clients();
+                        continue;
+                    }
+
+                    auto it = clients.find(fd);
+                    if (clients.end() == it) continue;
+
+                    if ((events[e].events & (EPOLLERR | EPOLLHUP)) || !drain(fd)) {
+                        drop(fd);
+                        continue;
+                    }
+                    if (events[e].events & EPOLLOUT) flush(it->second);
+                }
+
+                // Clients that fell behind while paused still get a keyframe
+                for (const auto& entry : clients) keyframe_wanted |= entry.second.needs_keyframe;
+
+                const uint32_t packed = mirror::pack_status(status);
+                // A paused sim sends the rest of its batch right away
+                const bool batch_due = keyframe_wanted
+                    || generation >= batch_start + batch
+                    || (status.paused && generation != batch_start);
+                if (!batch_due && packed == sent_status) return;
+
+                build_status(timer, packed);
+                sent_status = packed;
+
+                if (!batch_due) {
+                    for (auto& entry : clients) entry.second.queue(status_message, false);
+                    flush_all();
+                    return;
+                }
+
+                // Taken even without clients, so the change list stays small
+                board.take_changes(changes);
+                if (!clients.empty()) {
+                    build_diff(board, batch_start + 1, generation);
+                    keyframe.clear();
+
+                    for (auto& entry : clients) {
+                        Client& c = entry.second;
+                        c.queue(status_message, false);
+                        if (c.needs_keyframe) {
+                            if (keyframe.empty()) build_keyframe(board, generation);
+                            c.queue(keyframe, true);
+                            c.needs_keyframe = false;
+                        } else if (!changes.empty()) {
+                            c.queue(diff, false);
+                        }
+                    }
+
+                    flush_all();
+                }
+
+                batch_start = generation;
+            }
+
+        private:
+            class Client {
+                public:
+                    int fd = -1;
+                    bool needs_keyframe = true;
+                    bool writing = false;
+
+                    // Unsent bytes, and where each message in them ends. The
+                    //  first message may be half sent already.
+                    std::vector<uint8_t> out;
+                    std::vector<size_t> ends;
+                    bool head_sent = false;
+
+                    // End of the last keyframe still queued, zero without one
+                    size_t keyframe_end = 0;
+
+                    void queue (const std::vector<uint8_t>& message, const bool is_keyframe) {
+                        out.insert(out.end(), message.begin(), message.end());
+                        ends.push_back(out.size());
+                        if (is_keyframe) keyframe_end = out.size();
+                    }
+
+                    // Bytes queued after the last keyframe, so a keyframe
+                    //  bigger than the limit never counts against itself
+                    size_t backlog () const {return out.size() - keyframe_end;}
+
+                    // Forgets every whole message not sent yet
+                    void fall_behind () {
+                        const size_t keep = head_sent ? ends.front() : 0;
+                        out.resize(keep);
+                        ends.resize(head_sent ? 1 : 0);
+                        keyframe_end = std::min(keyframe_end, keep);
+                        needs_keyframe = true;
+                    }
+            };
+
+            int listener = -1;
+            int epoll_fd = -1;
+            std::string unix_path;
+            std::unordered_map<int, Client> clients;
+
+            uint64_t batch = sim::STREAM_BATCH;
+            uint64_t batch_start = 0;
+            uint32_t sent_status = ~0u;
+
+            // Scratch reused every batch
+            std::vector<uint32_t> changes;
+            std::vector<uint8_t> diff;
+            std::vector<uint8_t> keyframe;
+            std::vector<uint8_t> status_message;
+
+            void watch (const int fd, const uint32_t events, const int op) const {
+                epoll_event ev {};
+                ev.events = events;
+                ev.data.fd = fd;
+                epoll_ctl(epoll_fd, op, fd, &ev);
+            }
+
+            bool accept_clients () {
+                bool accepted = false;
+
+                int fd;
+                while (0 <= (fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC))) {
+                    Client c;
+                    c.fd = fd;
+                    clients[fd] = c;
+                    watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+                    accepted = true;
+                }
+
+                return accepted;
+            }
+
+            // Clients have nothing to say, their input is read and ignored.
+            //  False once the client hung up or its socket failed.
+            static bool drain (const int fd) {
+                uint8_t sink[256];
+                while (true) {
+                    const ssize_t r = recv(fd, sink, sizeof(sink), 0);
+                    if (0 < r) continue;
+                    if (0 == r) return false;
+                    if (EINTR == errno) continue;
+                    return EAGAIN == errno || EWOULDBLOCK == errno;
+                }
+            }
+
+            void drop (const int fd) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                close(fd);
+                clients.erase(fd);
+            }
+
+            // Flushes every client, dropping those whose socket broke
+            void flush_all () {
+                std::vector<int> broken;
+                for (auto& entry : clients) {
+                    if (!flush(entry.second)) broken.push_back(entry.first);
+                }
+                for (const int fd : broken) drop(fd);
+            }
+
+            // Sends what the socket takes right now. False on a broken socket.
+            bool flush (Client& c) {
+                size_t sent = 0;
+                while (sent < c.out.size()) {
+                    const ssize_t w = send(c.fd, c.out.data() + sent, c.out.size() - sent, MSG_NOSIGNAL);
+                    if (0 < w) {
+                        sent += static_cast<size_t>(w);
+                        continue;
+                    }
+                    if (0 > w && (EAGAIN == errno || EWOULDBLOCK == errno)) break;
+                    if (0 > w && EINTR == errno) continue;
+                    return false;
+                }
+
+                if (0 < sent) {
+                    c.out.erase(c.out.begin(), c.out.begin() + static_cast<std::ptrdiff_t>(sent));
+
+                    size_t done = 0;
+                    while (done < c.ends.size() && c.ends[done] <= sent) done += 1;
+
+                    const size_t head_start = (0 < done) ? c.ends[done - 1] : 0;
+                    c.head_sent = done < c.ends.size() && head_start < sent;
+
+                    c.ends.erase(c.ends.begin(), c.ends.begin() + static_cast<std::ptrdiff_t>(done));
+                    for (size_t& end : c.ends) end -= sent;
+                    c.keyframe_end = (c.keyframe_end > sent) ? c.keyframe_end - sent : 0;
+                }
+
+                if (sim::STREAM_BACKLOG < c.backlog()) c.fall_behind();
+
+                // Only wake up for writes while something is queued
+                const bool writing = !c.out.empty();
+                if (writing != c.writing) {
+                    c.writing = writing;
+                    watch(c.fd, writing ? (EPOLLIN | EPOLLOUT) : EPOLLIN, EPOLL_CTL_MOD);
+                }
+
+                return true;
+            }
+
+            static void put (std::vector<uint8_t>& out, const void* data, const size_t bytes) {
+                const uint8_t* b = static_cast<const uint8_t*>(data);
+                out.insert(out.end(), b, b + bytes);
+            }
+
+            static void begin (std::vector<uint8_t>& out, const Message type, const size_t payload) {
+                out.clear();
+                out.reserve(MESSAGE_HEADER + payload);
+                out.push_back(static_cast<uint8_t>(type));
+                const uint32_t size = static_cast<uint32_t>(payload);
+                put(out, &size, sizeof(size));
+            }
+
+            void build_status (const Timer& timer, const uint32_t packed) {
+                const double times[3] = {timer.delta_time(), timer.mean_time(), timer.up_time()};
+                const uint64_t frames = timer.get_frame_count();
+
+                begin(status_message, Message::Status, STATUS_PAYLOAD);
+                put(status_message, &packed, 4);
+                put(status_message, times, sizeof(times));
+                put(status_message, &frames, 8);
+            }
+
+            template <typename B>
+            void build_keyframe (const B& board, const uint64_t generation) {
+                const UVec2 dims = board.get_dimensions();
+                const uint32_t width = dims.x();
+                const uint32_t height = dims.y();
+
+                begin(keyframe, Message::Keyframe, 16 + static_cast<size_t>(width) * height * 4);
+                put(keyframe, &generation, 8);
+                put(keyframe, &width, 4);
+                put(keyframe, &height, 4);
+
+                UVec2 p;
+                for (p.y() = 0; p.y() < height; p.y() += 1) {
+                    for (p.x() = 0; p.x() < width; p.x() += 1) {
+                        const uint32_t bits = board.get_raw(p).pack();
+                        put(keyframe, &bits, 4);
+                    }
+                }
+            }
+
+            template <typename B>
+            void build_diff (const B& board, const uint64_t first, const uint64_t last) {
+                const uint32_t width = board.get_dimensions().x();
+                const uint32_t count = static_cast<uint32_t>(changes.size());
+
+                begin(diff, Message::Diff, 20 + static_cast<size_t>(count) * 8);
+                put(diff, &first, 8);
+                put(diff, &last, 8);
+                put(diff, &count, 4);
+
+                for (const uint32_t i : changes) {
+                    const uint32_t bits = board.get_raw(UVec2(i % width, i / width)).pack();
+                    put(diff, &i, 4);
+                    put(diff, &bits, 4);
+                }
+            }
+
+            void release () {
+                for (auto& entry : clients) close(entry.first);
+                clients.clear();
+
+                if (0 <= epoll_fd) close(epoll_fd);
+                if (0 <= listener) close(listener);
+                if (!unix_path.empty()) unlink(unix_path.c_str());
+
+                epoll_fd = -1;
+                listener = -1;
+            }
+    };
+
+
+    // Rebuilds the frames a StreamServer sends, for viewers
+    class StreamClient {
+        public:
+            StreamClient (const std::string& address) : fd(Address::parse(address).open(false)) {}
+
+            StreamClient (const StreamClient&) = delete;
+            StreamClient& operator= (const StreamClient&) = delete;
+
+            ~StreamClient () {if (0 <= fd) close(fd);}
+
+            /**
+            * @brief Apply every message received so far.
+            * @return False when nothing new arrived.
+            */
+            bool read (Frame& frame) {
+                uint8_t chunk[1 << 16];
+                ssize_t r;
+                while (0 < (r = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT))) {
+                    in.insert(in.end(), chunk, chunk + r);
+                }
+                if (0 == r) throw std::runtime_error("Stream closed");
+                if (0 > r && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+                    throw std::runtime_error("Stream failed: " + std::string(std::strerror(errno)));
+                }
+
+                bool changed = false;
+                size_t at = 0;
+                while (MESSAGE_HEADER <= in.size() - at) {
+                    uint32_t size;
+                    std::memcpy(&size, &in[at + 1], 4);
+                    if (MESSAGE_HEADER + size > in.size() - at) break;
+
+                    apply(static_cast<Message>(in[at]), &in[at + MESSAGE_HEADER], frame);
+                    at += MESSAGE_HEADER + size;
+                    changed = true;
+                }
+
+                in.erase(in.begin(), in.begin() + static_cast<std::ptrdiff_t>(at));
+                return changed;
+            }
+
+        private:
+            int fd = -1;
+            std::vector<uint8_t> in;
+
+            static void apply (const Message type, const uint8_t* payload, Frame& frame) {
+                if (Message::Keyframe == type) {
+                    std::memcpy(&frame.generation, payload, 8);
+                    std::memcpy(&frame.width, payload + 8, 4);
+                    std::memcpy(&frame.height, payload + 12, 4);
+
+                    frame.cells.resize(static_cast<size_t>(frame.width) * frame.height);
+                    std::memcpy(frame.cells.data(), payload + 16, frame.cells.size() * 4);
+                } else if (Message::Status == type) {
+                    uint32_t packed;
+                    std::memcpy(&packed, payload, 4);
+                    frame.status = mirror::unpack_status(packed);
+                    std::memcpy(&frame.delta_time, payload + 4, 8);
+                    std::memcpy(&frame.mean_time, payload + 12, 8);
+                    std::memcpy(&frame.up_time, payload + 20, 8);
+                    std::memcpy(&frame.frame_count, payload + 28, 8);
+                } else if (Message::Diff == type) {
+                    uint32_t count;
+                    std::memcpy(&frame.generation, payload + 8, 8);
+                    std::memcpy(&count, payload + 16, 4);
+
+                    const uint8_t* pair = payload + 20;
+                    for (uint32_t k = 0; k < count; k++, pair += 8) {
+                        uint32_t i, bits;
+                        std::memcpy(&i, pair, 4);
+                        std::memcpy(&bits, pair + 4, 4);
+                        if (i < frame.cells.size()) frame.cells[i] = bits;
+                    }
+                }
+            }
+    };
+}
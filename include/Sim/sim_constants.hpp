@@ -4,7 +4,86 @@
 namespace sim {
     constexpr float PROCEDURAL_WALLS_FACTOR = 0.01;
 
+    // Where generated wall masks are cached between runs.
+    constexpr const char* WALLS_CACHE_DIR = "target/cache/walls";
+
+    // Where exported frames go unless told otherwise.
+    constexpr const char* EXPORT_DIR = "target/frames";
+
+    // Where checkpoints go unless told otherwise.
+    constexpr const char* CHECKPOINT_DIR = "target/checkpoints";
+
     // This constant determines how many times a random atempt can be executed
     //  without success.
     constexpr uint8_t MAX_ATEMPTS = 16;
+
+    // Side (in cells) of the square regions used for activity tracking. Only
+    //  regions with organisms or pending events are stepped every generation.
+    constexpr unsigned REGION_SIZE = 32;
+
+    // Expected amount of food spawned per generation on the whole board.
+    constexpr double FOOD_SPAWN_RATE = 1.0;
+
+    // Amount of rows each thread diffuses at a time when stepping fields.
+    constexpr size_t FIELD_TILE_ROWS = 64;
+
+    // Organisms placed on a new dish, split evenly between the species.
+    constexpr unsigned INITIAL_ORGANISMS = 32;
+    constexpr unsigned INITIAL_SPECIES = 8;
+
+    // Energy an organism is born with, and gains from eating one food. Every
+    //  generation costs one energy, and organisms die when they run out.
+    constexpr float ORGANISM_ENERGY = 64.0f;
+    constexpr float FOOD_ENERGY = 16.0f;
+
+    // Hidden neurons of the organism brains, and amount of organisms each
+    //  thread evaluates at a time.
+    constexpr unsigned BRAIN_HIDDEN = 16;
+    constexpr size_t BRAIN_BLOCK_ROWS = 256;
+
+    // Rays organisms see along, fanned over the quarter turn ahead of
+    //  them, and cells each ray reaches.
+    constexpr unsigned VISION_RAYS = 5;
+    constexpr unsigned VISION_DISTANCE = 16;
+
+    // Cells away organisms smell the nearest food from
+    constexpr unsigned SMELL_RADIUS = 8;
+
+    // Generations the organisms live before the species are bred again
+    constexpr uint64_t EVOLUTION_EPOCH = 512;
+
+    // Births per block of a lineage file
+    constexpr size_t LINEAGE_BLOCK = 4096;
+
+    // Bytes of a checkpoint buffered between two writes
+    constexpr size_t CHECKPOINT_BUFFER = size_t(1) << 20;
+
+    // Generations between two migrations of genomes between islands, and
+    //  amount of migrants each queue between two islands holds at once.
+    constexpr uint64_t MIGRATION_INTERVAL = 256;
+    constexpr uint32_t MIGRATION_CAPACITY = 8;
+
+    // Seconds between two frames published for out of process viewers, and
+    //  seconds without a viewer reading after which publishing stops.
+    constexpr double PUBLISH_INTERVAL = 1.0 / 30.0;
+    constexpr double PUBLISH_IDLE = 1.0;
+
+    // Seconds a paused sim sleeps at most, before serving viewers and
+    //  stream clients again
+    constexpr double PAUSED_WAKEUP = 1.0 / 30.0;
+
+    // Generations of board changes sent together to stream clients, and
+    //  bytes a client may fall behind before it is sent a keyframe instead.
+    constexpr uint64_t STREAM_BATCH = 8;
+    constexpr size_t STREAM_BACKLOG = 8u << 20;
+
+    // Powersave mode: background dishes get at most this many turns a
+    //  second and step once every this many turns, and parallel work uses
+    //  this many workers. The watched dish keeps its own pace.
+    constexpr unsigned POWERSAVE_PERIOD = 8;
+    constexpr unsigned POWERSAVE_WORKERS = 1;
+    constexpr double POWERSAVE_FPS = 2.0;
+
+    // Most seeds a sweep takes, over all its lists and ranges
+    constexpr uint64_t SWEEP_MAX_SEEDS = 1000000;
 }
\ No newline at end of file
@@ -0,0 +1,379 @@
+#pragma once
+
+
+#include <vector>
+#include <string>
+#include <unordered_set>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <limits>
+
+#include "Sim/PetriDish.hpp"
+#include "Sim/Board.hpp"
+#include "utils/Vec.hpp"
+#include "utils/Cpu.hpp"
+
+
+namespace sweep {
+    using DishParams = petridish::DishParams;
+    using CellType = cell::CellType;
+
+    // Shortest text that reads back as the same rate. Rates that 6 digits
+    //  already told apart keep the text they always had.
+    inline std::string format_rate (const double rate) {
+        for (int digits = 6; ; digits++) {
+            std::stringstream ss;
+            ss << std::setprecision(digits) << rate;
+            if (std::numeric_limits<double>::max_digits10 <= digits || std::stod(ss.str()) == rate) return ss.str();
+        }
+    }
+
+    // One headless dish of the sweep
+    class RunConfig {
+        public:
+            uint64_t seed = 0;
+            UVec2 dimensions = UVec2::Zero();
+            double food_rate = 0.0;
+            unsigned max_atempts = 0;
+            uint64_t generations = 0;
+            geometry::Layout layout = geometry::Layout::Rows;
+
+            // Identifies the run in the output, so a sweep can be resumed
+            std::string key () const {
+                std::stringstream ss;
+                ss << "s" << seed
+                    << "_" << dimensions.x() << "x" << dimensions.y()
+                    << "_f" << format_rate(food_rate)
+                    << "_a" << max_atempts
+                    << "_g" << generations;
+
+                // Row major runs keep the keys they had before layouts
+                if (geometry::Layout::Tiled == layout) ss << "_tiled";
+                return ss.str();
+            }
+    };
+
+    class RunResult {
+        public:
+            RunConfig config;
+            size_t food = 0;
+            size_t walls = 0;
+            uint64_t hash = 0;
+            double seconds = 0.0;
+    };
+
+
+    class SweepParams {
+        public:
+            std::vector<uint64_t> seeds = {1029384756};
+            std::vector<UVec2> sizes = {UVec2(256u, 256u)};
+            std::vector<double> food_rates = {sim::FOOD_SPAWN_RATE};
+            std::vector<unsigned> max_atempts = {sim::MAX_ATEMPTS};
+            std::vector<geometry::Layout> layouts = {geometry::Layout::Rows};
+            uint64_t generations = 1000;
+            unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+            std::string output = "sweep.jsonl";
+            cpu::Isa isa = cpu::detect();
+
+            /**
+            * @brief Parse the sweep command line.
+            *
+            * Lists are comma separated, seeds also take inclusive ranges:
+            *   --seeds 1..100,555 --sizes 256x256,1024x512
+            *   --food-rates 0.5,1 --max-atempts 8,16 --layouts rows,tiled
+            *   --generations 1000 --jobs 8 --output runs.csv
+            *   --isa auto|scalar|sse2|avx2|avx512
+            * The output is CSV if it ends in ".csv" and JSONL otherwise.
+            */
+            static SweepParams from_args (const int argc, char** argv) {
+                SweepParams params;
+
+                for (int i = 0; i < argc; i++) {
+                    const std::string flag = argv[i];
+                    if (argc <= i + 1) throw std::invalid_argument("Missing value for " + flag);
+                    const std::string value = argv[++i];
+
+                    if ("--seeds" == flag) {
+                        params.seeds.clear();
+                        for (const std::string& item : split(value)) {
+                            size_t dots = item.find("..");
+                            if (std::string::npos == dots) {
+                                params.seeds.push_back(std::stoull(item));
+                                continue;
+                            }
+
+                            uint64_t first = std::stoull(item.substr(0, dots));
+                            uint64_t last = std::stoull(item.substr(dots + 2));
+                            if (first > last) throw std::invalid_argument("Seed range " + item + " goes backwards");
+                            if (params.seeds.size() >= sim::SWEEP_MAX_SEEDS || last - first >= sim::SWEEP_MAX_SEEDS - params.seeds.size()) {
+                                throw std::invalid_argument("Seed range " + item + " is too large");
+                            }
+
+                            // Stops on last itself, which may be the largest seed
+                            for (uint64_t s = first; ; s++) {
+                                params.seeds.push_back(s);
+                                if (s == last) break;
+                            }
+                        }
+                        if (params.seeds.size() > sim::SWEEP_MAX_SEEDS) throw std::invalid_argument("Too many seeds");
+                    } else if ("--sizes" == flag) {
+                        params.sizes.clear();
+                        for (const std::string& item : split(value)) {
+                            size_t x = item.find('x');
+                            if (std::string::npos == x) throw std::invalid_argument("Bad size " + item);
+                            params.sizes.push_back(UVec2(
+                                static_cast<unsigned>(std::stoul(item.substr(0, x))),
+                                static_cast<unsigned>(std::stoul(item.substr(x + 1)))
+                            ));
+                        }
+                    } else if ("--food-rates" == flag) {
+                        params.food_rates.clear();
+                        for (const std::string& item : split(value)) params.food_rates.push_back(std::stod(item));
+                    } else if ("--max-atempts" == flag) {
+                        params.max_atempts.clear();
+                        for (const std::string& item : split(value)) {
+                            params.max_atempts.push_back(static_cast<unsigned>(std::stoul(item)));
+                        }
+                    } else if ("--layouts" == flag) {
+                        params.layouts.clear();
+                        for (const std::string& item : split(value)) params.layouts.push_back(geometry::parse_layout(item));
+                    } else if ("--generations" == flag) {
+                        params.generations = std::stoull(value);
+                    } else if ("--jobs" == flag) {
+                        params.jobs = std::max(1u, static_cast<unsigned>(std::stoul(value)));
+                    } else if ("--output" == flag) {
+                        params.output = value;
+                    } else if ("--isa" == flag) {
+                        params.isa = cpu::parse_isa(value);
+                    } else {
+                        throw std::invalid_argument("Unknown sweep option " + flag);
+                    }
+                }
+
+                return params;
+            }
+
+            // Every combination of the parameter lists, once per key
+            std::vector<RunConfig> expand () const {
+                std::vector<RunConfig> runs;
+                std::unordered_set<std::string> keys;
+
+                for (const UVec2& size : sizes)
+                for (const double food_rate : food_rates)
+                for (const unsigned atempts : max_atempts)
+                for (const geometry::Layout layout : layouts)
+                for (const uint64_t seed : seeds) {
+                    RunConfig run;
+                    run.seed = seed;
+                    run.dimensions = size;
+                    run.food_rate = food_rate;
+                    // Boards count atempts in a byte, so the key must too
+                    run.max_atempts = std::min(255u, atempts);
+                    run.generations = generations;
+                    run.layout = layout;
+                    if (keys.insert(run.key()).second) runs.push_back(run);
+                }
+
+                return runs;
+            }
+
+        private:
+            static std::vector<std::string> split (const std::string& list) {
+                std::vector<std::string> items;
+                std::stringstream ss(list);
+                std::string item;
+                while (std::getline(ss, item, ',')) if (!item.empty()) items.push_back(item);
+                return items;
+            }
+    };
+
+
+    // Runs every configuration of a sweep on a bounded amount of threads,
+    //  appending one line per finished run to a single output file. Runs
+    //  already in the file are skipped, so an interrupted sweep just needs
+    //  to be started again.
+    class Sweep {
+        public:
+            Sweep (const SweepParams sweep_params) : params(sweep_params) {}
+            ~Sweep () {}
+
+            int run () {
+                cpu::use(params.isa);
+                const bool csv = is_csv();
+                const std::unordered_set<std::string> done = read_done(csv);
+
+                std::vector<RunConfig> pending;
+                for (const RunConfig& r : params.expand()) {
+                    if (0 == done.count(r.key())) pending.push_back(r);
+                }
+
+                std::ofstream out (params.output, std::ios::app);
+                if (!out) throw std::runtime_error("Can not open sweep output " + params.output);
+                if (!ends_with_newline()) out << "\n";
+                if (csv && done.empty() && is_empty()) out << CSV_HEADER << "\n" << std::flush;
+
+                std::cout << "[sweep] " << pending.size() << " runs to go ("
+                    << done.size() << " already done), " << params.jobs << " jobs, "
+                    << cpu::isa_name(params.isa) << " kernels" << std::endl;
+
+                std::atomic<size_t> next {0};
+                std::mutex out_mutex;
+                size_t finished = 0;
+
+                auto worker = [&] {
+                    size_t i;
+                    while ((i = next.fetch_add(1)) < pending.size()) {
+                        const RunResult result = execute(pending[i]);
+
+                        std::lock_guard<std::mutex> lock (out_mutex);
+                        out << (csv ? to_csv(result) : to_jsonl(result)) << "\n" << std::flush;
+                        finished += 1;
+                        std::cout << "[sweep] " << finished << "/" << pending.size()
+                            << " " << result.config.key() << std::endl;
+                    }
+                };
+
+                std::vector<std::thread> threads;
+                const size_t thread_count = std::min<size_t>(params.jobs, pending.size());
+                for (size_t t = 0; t < thread_count; t++) threads.emplace_back(worker);
+                for (std::thread& t : threads) t.join();
+
+                return 0;
+            }
+
+        private:
+            static constexpr const char* CSV_HEADER =
+                "key,seed,width,height,food_rate,max_atempts,generations,food,walls,hash,seconds,gens_per_second";
+
+            SweepParams params;
+
+            // Common board sizes run on a dish specialized for them, unless
+            //  the run asks for tiles
+            static RunResult execute (const RunConfig& config) {
+                return geometry::dispatch(config.dimensions, config.layout, [&](auto geometry) {
+                    return execute_on<decltype(geometry)>(config);
+                });
+            }
+
+            template <typename G>
+            static RunResult execute_on (const RunConfig& config) {
+                DishParams dish_params;
+                dish_params.board.food_rate = config.food_rate;
+                dish_params.board.max_atempts = static_cast<uint8_t>(std::min(255u, config.max_atempts));
+
+                auto start = std::chrono::steady_clock::now();
+
+                petridish::BasicPetriDish<G> dish (config.seed, config.dimensions, dish_params);
+                for (uint64_t g = 0; g < config.generations; g++) dish.foward();
+
+                const auto& board = dish.get_board();
+
+                RunResult result;
+                result.config = config;
+                result.food = board.count(CellType::Food);
+                result.walls = board.count(CellType::Wall);
+                result.hash = board.get_hash();
+                result.seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start
+                ).count();
+
+                return result;
+            }
+
+            static double gens_per_second (const RunResult& r) {
+                return 0.0 < r.seconds ? static_cast<double>(r.config.generations) / r.seconds : 0.0;
+            }
+
+            static std::string hex (const uint64_t v) {
+                std::stringstream ss;
+                ss << "0x" << std::hex << std::setw(16) << std::setfill('0') << v;
+                return ss.str();
+            }
+
+            static std::string to_jsonl (const RunResult& r) {
+                std::stringstream ss;
+                ss << "{\"key\":\"" << r.config.key() << "\""
+                    << ",\"seed\":" << r.config.seed
+                    << ",\"width\":" << r.config.dimensions.x()
+                    << ",\"height\":" << r.config.dimensions.y()
+                    << ",\"food_rate\":" << format_rate(r.config.food_rate)
+                    << ",\"max_atempts\":" << r.config.max_atempts
+                    << ",\"generations\":" << r.config.generations
+                    << ",\"food\":" << r.food
+                    << ",\"walls\":" << r.walls
+                    << ",\"hash\":\"" << hex(r.hash) << "\""
+                    << ",\"seconds\":" << r.seconds
+                    << ",\"gens_per_second\":" << gens_per_second(r)
+                    << "}";
+                return ss.str();
+            }
+
+            static std::string to_csv (const RunResult& r) {
+                std::stringstream ss;
+                ss << r.config.key()
+                    << "," << r.config.seed
+                    << "," << r.config.dimensions.x()
+                    << "," << r.config.dimensions.y()
+                    << "," << format_rate(r.config.food_rate)
+                    << "," << r.config.max_atempts
+                    << "," << r.config.generations
+                    << "," << r.food
+                    << "," << r.walls
+                    << "," << hex(r.hash)
+                    << "," << r.seconds
+                    << "," << gens_per_second(r);
+                return ss.str();
+            }
+
+            bool is_csv () const {
+                const std::string ext = ".csv";
+                return params.output.size() >= ext.size()
+                    && 0 == params.output.compare(params.output.size() - ext.size(), ext.size(), ext);
+            }
+
+            bool is_empty () const {
+                std::ifstream in (params.output, std::ios::ate);
+                return !in || 0 == in.tellg();
+            }
+
+            bool ends_with_newline () const {
+                std::ifstream in (params.output, std::ios::ate | std::ios::binary);
+                if (!in || 0 == in.tellg()) return true;
+
+                in.seekg(-1, std::ios::end);
+                return '\n' == in.get();
+            }
+
+            // Keys of the runs already in the output. A line cut short by a
+            //  crash has no closing brace (or too few columns) and is redone.
+            std::unordered_set<std::string> read_done (const bool csv) const {
+                std::unordered_set<std::string> done;
+                std::ifstream in (params.output);
+                std::string line;
+
+                while (std::getline(in, line)) {
+                    if (csv) {
+                        size_t columns = 1;
+                        for (char c : line) columns += (',' == c);
+                        if (12 != columns || 0 == line.rfind("key,", 0)) continue;
+                        done.insert(line.substr(0, line.find(',')));
+                    } else {
+                        const std::string tag = "{\"key\":\"";
+                        if (0 != line.rfind(tag, 0) || '}' != line.back()) continue;
+                        size_t end = line.find('"', tag.size());
+                        if (std::string::npos == end) continue;
+                        done.insert(line.substr(tag.size(), end - tag.size()));
+                    }
+                }
+
+                return done;
+            }
+    };
+}
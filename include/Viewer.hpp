@@ -0,0 +1,102 @@
+#pragma once
+
+
+#include <string>
+#include <algorithm>
+
+#include "Sim/Mirror.hpp"
+#include "Sim/Stream.hpp"
+#include "Sim/Printer.hpp"
+#include "Sim/Board.hpp"
+#include "utils/Term.hpp"
+#include "utils/Timer.hpp"
+#include "utils/InputWatcher.hpp"
+
+
+namespace viewer {
+    using Term = term::Term;
+    using Board = board::Board;
+    using Cell = cell::Cell;
+    using Frame = mirror::Frame;
+
+    // Renders a board published by a sim running in another process. The
+    //  sim never waits for it, so viewers come and go at no cost. The source
+    //  is anything reading frames: shared memory or a stream socket.
+    template <typename S>
+    class BasicViewer {
+        public:
+            BasicViewer (const std::string& name) :
+                source(name),
+                term(Term::instance()),
+                watcher(input::InputWatcher::instance())
+            {}
+            ~BasicViewer () {}
+
+            int run () {
+                timer::Timer timer;
+                bool running = true;
+
+                while (running) {
+                    timer.start_measurement();
+
+                    const bool resized = watcher.take_resize();
+                    if (resized) {
+                        term.resize();
+                        board_printer.invalidate();
+                    }
+
+                    if (watcher.has_input()) {
+                        int key;
+                        while (ERR != (key = term.input())) running &= ('q' != key);
+                        watcher.consumed();
+                    }
+
+                    if (source.read(frame) || (resized && !frame.cells.empty())) {
+                        load(frame);
+
+                        // The sim may run without a ui, the viewer is one
+                        sim::SimStatus shown = frame.status;
+                        shown.printing = true;
+                        board_printer.print(board, frame.timer_text(), shown, static_cast<unsigned>(frame.generation));
+                        term.refresh();
+                    }
+
+                    timer.end_measurement();
+                    timer.sync(sim::PUBLISH_INTERVAL);
+                }
+
+                return 0;
+            }
+
+        private:
+            S source;
+            Term& term;
+            input::InputWatcher& watcher;
+            printer::Printer board_printer;
+            Frame frame;
+            Board board;
+
+            // The part of the frame that fits the terminal
+            void load (const Frame& f) {
+                const UVec2 dims (
+                    std::min<unsigned>(f.width, static_cast<unsigned>(std::max(1, term.get_width() - 2))),
+                    std::min<unsigned>(f.height, static_cast<unsigned>(std::max(1, term.get_height() - 2)))
+                );
+
+                if (board.get_dimensions() != dims) {
+                    board::BoardParams still;
+                    still.food_rate = 0.0;
+                    board = Board(dims, 0, still);
+                }
+
+                UVec2 p;
+                for (p.y() = 0; p.y() < dims.y(); p.y() += 1) {
+                    const uint32_t* row = &f.cells[static_cast<size_t>(p.y()) * f.width];
+                    for (p.x() = 0; p.x() < dims.x(); p.x() += 1) board.set_raw(p, Cell::unpack(row[p.x()]));
+                }
+            }
+    };
+
+    using Viewer = BasicViewer<mirror::BoardViewer>;
+    using StreamViewer = BasicViewer<stream::StreamClient>;
+}
\ No newline at end of file
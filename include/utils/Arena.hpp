@@ -0,0 +1,197 @@
+#pragma once
+
+
+#include <new>
+#include <mutex>
+#include <memory>
+#include <type_traits>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+
+namespace arena {
+    enum class HugePages : uint8_t {
+        Off = 0, Transparent = 1, Explicit = 2
+    };
+
+    inline HugePages parse_huge_pages (const std::string& name) {
+        if ("off" == name) return HugePages::Off;
+        if ("thp" == name) return HugePages::Transparent;
+        if ("explicit" == name) return HugePages::Explicit;
+        throw std::invalid_argument("Unknown huge page mode " + name);
+    }
+
+    constexpr size_t HUGE_PAGE = size_t(2) << 20;
+    constexpr size_t PAGE = size_t(4) << 10;
+
+    inline size_t round_up (const size_t bytes, const size_t to) {return (bytes + to - 1) / to * to;}
+
+    /**
+    * @brief Pin the calling thread to a cpu.
+    * @return Whether the kernel accepted it.
+    *
+    * Memory first written after this lands on the cpu's NUMA node.
+    */
+    inline bool pin_thread (const unsigned cpu) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return 0 == pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+
+    /**
+    * @brief A bump allocator over one private mapping, for the memory of a
+    *  single dish.
+    *
+    * The whole range is reserved upfront but only backed when written, so
+    *  pages come from the NUMA node of the thread that first touches them.
+    *  The mapping is made of huge pages when asked: explicit ones if the
+    *  system has enough reserved for the whole arena, transparent ones
+    *  otherwise. Freed blocks
+    *  give their whole pages back. Freeing the last block allocated makes
+    *  its range the next one handed out, and once nothing is live the
+    *  whole arena is handed out again from the start.
+    */
+    class Arena {
+        public:
+            Arena () {}
+
+            /**
+            * @brief Reserve an arena.
+            * @param capacity Bytes of address space, rounded to huge pages.
+            */
+            Arena (const size_t capacity, const HugePages huge_pages) {
+                bytes = round_up(capacity, HUGE_PAGE);
+
+                // Reserved from the huge page pool as a whole, so a pool too
+                //  small fails here rather than faulting on first write
+                if (HugePages::Explicit == huge_pages) {
+                    void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                    if (MAP_FAILED != mapped) {
+                        base = static_cast<uint8_t*>(mapped);
+                        mapped_bytes = bytes;
+                        mode = HugePages::Explicit;
+                        return;
+                    }
+                }
+
+                // One huge page more, to align the start on one
+                mapped_bytes = bytes + HUGE_PAGE;
+                void* mapped = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+                if (MAP_FAILED == mapped) throw std::runtime_error("Can not reserve an arena of " + std::to_string(bytes) + " bytes");
+
+                mapping = static_cast<uint8_t*>(mapped);
+                base = reinterpret_cast<uint8_t*>(round_up(reinterpret_cast<uintptr_t>(mapping), HUGE_PAGE));
+
+                if (HugePages::Off != huge_pages && 0 == madvise(base, bytes, MADV_HUGEPAGE)) {
+                    mode = HugePages::Transparent;
+                }
+            }
+
+            Arena (const Arena&) = delete;
+            Arena& operator= (const Arena&) = delete;
+
+            ~Arena () {
+                if (nullptr == base) return;
+                munmap(nullptr != mapping ? mapping : base, mapped_bytes);
+            }
+
+            void* allocate (const size_t size, const size_t alignment) {
+                std::lock_guard<std::mutex> lock (mutex);
+
+                // Large blocks start on a page, so freeing them releases pages
+                const size_t align = std::max(alignment, PAGE <= size ? PAGE : alignof(std::max_align_t));
+                const size_t start = round_up(used, align);
+                if (start + size > bytes) throw std::bad_alloc();
+
+                used = start + size;
+                live += size;
+                return base + start;
+            }
+
+            void deallocate (void* pointer, const size_t size) {
+                std::lock_guard<std::mutex> lock (mutex);
+                live -= size;
+
+                const uintptr_t begin = round_up(reinterpret_cast<uintptr_t>(pointer), PAGE);
+                const uintptr_t end = (reinterpret_cast<uintptr_t>(pointer) + size) / PAGE * PAGE;
+                if (begin < end) madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+
+                const size_t start = static_cast<size_t>(static_cast<uint8_t*>(pointer) - base);
+                if (0 == live) used = 0;
+                else if (start + size == used) used = start;
+            }
+
+            bool owns (const void* pointer) const {
+                const uint8_t* p = static_cast<const uint8_t*>(pointer);
+                return base <= p && p < base + bytes;
+            }
+
+            size_t get_capacity () const {return bytes;}
+            size_t get_used () const {return used;}
+            size_t get_live () const {return live;}
+            HugePages get_mode () const {return mode;}
+
+        private:
+            uint8_t* mapping = nullptr;
+            uint8_t* base = nullptr;
+            size_t mapped_bytes = 0;
+            size_t bytes = 0;
+            size_t used = 0;
+            size_t live = 0;
+            HugePages mode = HugePages::Off;
+            std::mutex mutex;
+    };
+
+
+    // Standard allocator drawing from an arena, or from the heap when it
+    //  has none, so containers work the same either way. It keeps its arena
+    //  alive, and containers keep their allocator when assigned: the memory
+    //  of a container is chosen once, when it is made.
+    template <typename T>
+    class ArenaAllocator {
+        public:
+            using value_type = T;
+            using propagate_on_container_copy_assignment = std::false_type;
+            using propagate_on_container_move_assignment = std::false_type;
+            using propagate_on_container_swap = std::false_type;
+
+            ArenaAllocator () {}
+            ArenaAllocator (std::shared_ptr<Arena> allocator_arena) : arena(std::move(allocator_arena)) {}
+
+            template <typename U>
+            ArenaAllocator (const ArenaAllocator<U>& other) : arena(other.share_arena()) {}
+
+            T* allocate (const size_t n) {
+                if (nullptr == arena) return static_cast<T*>(::operator new(n * sizeof(T)));
+                return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+            }
+
+            void deallocate (T* pointer, const size_t n) {
+                if (nullptr == arena) ::operator delete(pointer);
+                else arena->deallocate(pointer, n * sizeof(T));
+            }
+
+            Arena* get_arena () const {return arena.get();}
+            const std::shared_ptr<Arena>& share_arena () const {return arena;}
+
+            template <typename U>
+            bool operator== (const ArenaAllocator<U>& other) const {return get_arena() == other.get_arena();}
+
+            template <typename U>
+            bool operator!= (const ArenaAllocator<U>& other) const {return get_arena() != other.get_arena();}
+
+        private:
+            std::shared_ptr<Arena> arena;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <cpuid.h>
+
+    // Kernels built for a wider instruction set than the binary, picked at
+    //  runtime by cpu::level
+    #define CPU_DISPATCH 1
+    #define CPU_TARGET_POPCNT __attribute__((target("popcnt")))
+    #define CPU_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+
+    // AVX-512 brings fma, which GCC would fuse multiplies and adds into,
+    //  rounding differently than the other kernels
+    #define CPU_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx2,popcnt"), optimize("fp-contract=off")))
+
+    // Inlined even at -O0, so a dispatched kernel compiles its helpers for
+    //  its own instruction set
+    #define CPU_INLINE __attribute__((always_inline)) inline
+#else
+    #define CPU_INLINE inline
+#endif
+
+
+namespace cpu {
+    // Instruction sets the kernels come in, each including the ones before.
+    //  Avx2 also implies popcnt.
+    enum class Isa : uint8_t {
+        Scalar = 0, Sse2 = 1, Avx2 = 2, Avx512 = 3
+    };
+
+    inline const char* isa_name (const Isa isa) {
+        switch (isa) {
+            case Isa::Scalar: return "scalar";
+            case Isa::Sse2: return "sse2";
+            case Isa::Avx2: return "avx2";
+            case Isa::Avx512: return "avx512";
+        }
+        return "unknown";
+    }
+
+    /**
+    * @brief The widest instruction set both the cpu and the os support.
+    *
+    * Reads cpuid for the features and xgetbv for the registers the os
+    *  saves, since a cpu with AVX-512 under an os that does not save zmm
+    *  registers can not use it.
+    */
+    inline Isa detect () {
+        #if defined(CPU_DISPATCH)
+            unsigned a = 0, b = 0, c = 0, d = 0;
+            if (!__get_cpuid(1, &a, &b, &c, &d)) return Isa::Scalar;
+
+            Isa best = (d & bit_SSE2) ? Isa::Sse2 : Isa::Scalar;
+            const bool popcnt = 0 != (c & bit_POPCNT);
+            if (!(c & bit_OSXSAVE)) return best;
+
+            uint32_t xcr0_low = 0, xcr0_high = 0;
+            __asm__ ("xgetbv" : "=a" (xcr0_low), "=d" (xcr0_high) : "c" (0));
+            const uint64_t xcr0 = (static_cast<uint64_t>(xcr0_high) << 32) | xcr0_low;
+
+            // SSE and AVX state, then also the AVX-512 mask and upper registers
+            const bool ymm = 0x06 == (xcr0 & 0x06);
+            const bool zmm = 0xe6 == (xcr0 & 0xe6);
+
+            if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return best;
+
+            if (Isa::Sse2 == best && ymm && popcnt && (b & bit_AVX2)) best = Isa::Avx2;
+            if (Isa::Avx2 == best && zmm && (b & bit_AVX512F) && (b & bit_AVX512BW)) best = Isa::Avx512;
+
+            return best;
+        #elif defined(__SSE2__)
+            return Isa::Sse2;
+        #else
+            return Isa::Scalar;
+        #endif
+    }
+
+    // The instruction set in use, detected once and lowered by use
+    inline std::atomic<Isa>& active () {
+        static std::atomic<Isa> isa {detect()};
+        return isa;
+    }
+
+    inline Isa level () {return active().load(std::memory_order_relaxed);}
+
+    /**
+    * @brief Run the kernels in another instruction set, to compare them.
+    *
+    * Call before stepping dishes. Sets the cpu lacks are refused, and so
+    *  are sets the binary has no kernels for.
+    */
+    inline void use (const Isa isa) {
+        if (isa > detect()) {
+            throw std::invalid_argument(std::string("This cpu can not run ") + isa_name(isa) + " kernels");
+        }
+        active().store(isa, std::memory_order_relaxed);
+    }
+
+    // "auto" is the widest the cpu supports
+    inline Isa parse_isa (const std::string& name) {
+        if ("auto" == name) return detect();
+        if ("scalar" == name) return Isa::Scalar;
+        if ("sse2" == name) return Isa::Sse2;
+        if ("avx2" == name) return Isa::Avx2;
+        if ("avx512" == name) return Isa::Avx512;
+        throw std::invalid_argument("Unknown instruction set " + name);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#pragma once
+
+
+#include <cstdint>
+
+
+namespace hash {
+    // SplitMix64 finalizer: a cheap, well mixed 64 bit hash of a 64 bit value.
+    inline uint64_t mix (uint64_t z) {
+        z += 0x9e3779b97f4a7c15ull;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    inline uint64_t combine (const uint64_t a, const uint64_t b) {
+        return mix(a ^ mix(b));
+    }
+}
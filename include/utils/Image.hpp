@@ -0,0 +1,200 @@
+#pragma once
+
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+
+namespace image {
+    /**
+    * @brief Encode an RGB image as a binary PPM.
+    * @param rgb Pixels, 3 bytes each, row major.
+    */
+    inline std::vector<uint8_t> encode_ppm (const std::vector<uint8_t>& rgb, const uint32_t width, const uint32_t height) {
+        const std::string head = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+
+        std::vector<uint8_t> out;
+        out.reserve(head.size() + rgb.size());
+        out.insert(out.end(), head.begin(), head.end());
+        out.insert(out.end(), rgb.begin(), rgb.end());
+        return out;
+    }
+
+
+    // Bits packed least significant first, as deflate wants them
+    class BitWriter {
+        public:
+            std::vector<uint8_t>& out;
+
+            explicit BitWriter (std::vector<uint8_t>& buffer) : out(buffer) {}
+
+            void put (const uint32_t bits, const unsigned count) {
+                acc |= static_cast<uint64_t>(bits) << filled;
+                filled += count;
+                while (8 <= filled) {
+                    out.push_back(static_cast<uint8_t>(acc));
+                    acc >>= 8;
+                    filled -= 8;
+                }
+            }
+
+            // Huffman codes go most significant bit first
+            void put_code (const uint32_t code, const unsigned length) {
+                uint32_t reversed = 0;
+                for (unsigned b = 0; b < length; b++) reversed |= ((code >> b) & 1u) << (length - 1 - b);
+                put(reversed, length);
+            }
+
+            void flush () {
+                if (0 < filled) out.push_back(static_cast<uint8_t>(acc));
+                acc = 0;
+                filled = 0;
+            }
+
+        private:
+            uint64_t acc = 0;
+            unsigned filled = 0;
+    };
+
+
+    /**
+    * @brief Deflate with the fixed Huffman codes, finding only runs.
+    *
+    * Every byte repeating the one before it is folded into a distance 1
+    *  match. After PNG filtering boards are mostly long runs of zeros, so
+    *  this gets most of what a full LZ77 search would, at memcpy speed.
+    */
+    inline void deflate_runs (const std::vector<uint8_t>& data, std::vector<uint8_t>& out) {
+        static constexpr uint16_t LENGTH_BASE[29] = {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+        };
+        static constexpr uint8_t LENGTH_EXTRA[29] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+        };
+
+        BitWriter bits (out);
+        bits.put(1, 1); // Final block
+        bits.put(1, 2); // Fixed Huffman codes
+
+        auto literal = [&](const unsigned symbol) {
+            if (144 > symbol) bits.put_code(0x30 + symbol, 8);
+            else if (256 > symbol) bits.put_code(0x190 + symbol - 144, 9);
+            else if (280 > symbol) bits.put_code(symbol - 256, 7);
+            else bits.put_code(0xc0 + symbol - 280, 8);
+        };
+
+        size_t i = 0;
+        while (i < data.size()) {
+            size_t run = 0;
+            if (0 < i) {
+                while (run < 258 && i + run < data.size() && data[i + run] == data[i - 1]) run += 1;
+            }
+
+            if (3 > run) {
+                literal(data[i]);
+                i += 1;
+                continue;
+            }
+
+            unsigned code = 28;
+            while (LENGTH_BASE[code] > run) code -= 1;
+
+            literal(257 + code);
+            bits.put(static_cast<uint32_t>(run - LENGTH_BASE[code]), LENGTH_EXTRA[code]);
+            bits.put_code(0, 5); // Distance 1
+            i += run;
+        }
+
+        literal(256); // End of block
+        bits.flush();
+    }
+
+
+    inline uint32_t crc32 (const uint8_t* data, const size_t n, uint32_t crc = 0) {
+        static const std::vector<uint32_t> table = [] {
+            std::vector<uint32_t> t (256);
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (unsigned k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+            return t;
+        }();
+
+        crc = ~crc;
+        for (size_t i = 0; i < n; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    inline uint32_t adler32 (const std::vector<uint8_t>& data) {
+        uint32_t a = 1, b = 0;
+        size_t i = 0;
+        while (i < data.size()) {
+            // Largest block that can not overflow before the modulo
+            const size_t end = std::min(data.size(), i + 5552);
+            for (; i < end; i++) {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        return (b << 16) | a;
+    }
+
+
+    /**
+    * @brief Encode an RGB image as a PNG, without any library.
+    * @param rgb Pixels, 3 bytes each, row major.
+    */
+    inline std::vector<uint8_t> encode_png (const std::vector<uint8_t>& rgb, const uint32_t width, const uint32_t height) {
+        auto be32 = [](std::vector<uint8_t>& v, const uint32_t x) {
+            v.push_back(static_cast<uint8_t>(x >> 24));
+            v.push_back(static_cast<uint8_t>(x >> 16));
+            v.push_back(static_cast<uint8_t>(x >> 8));
+            v.push_back(static_cast<uint8_t>(x));
+        };
+
+        std::vector<uint8_t> out = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+        auto chunk = [&](const char* type, const std::vector<uint8_t>& body) {
+            be32(out, static_cast<uint32_t>(body.size()));
+            const size_t start = out.size();
+            out.insert(out.end(), type, type + 4);
+            out.insert(out.end(), body.begin(), body.end());
+            be32(out, crc32(&out[start], out.size() - start));
+        };
+
+        std::vector<uint8_t> ihdr;
+        be32(ihdr, width);
+        be32(ihdr, height);
+        ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0}); // 8 bit RGB
+        chunk("IHDR", ihdr);
+
+        // Every row uses the Up filter, so rows equal to the one above
+        //  become zeros
+        const size_t stride = static_cast<size_t>(width) * 3;
+        std::vector<uint8_t> filtered;
+        filtered.reserve((stride + 1) * height);
+        for (uint32_t y = 0; y < height; y++) {
+            filtered.push_back(2);
+            const uint8_t* row = &rgb[y * stride];
+            for (size_t x = 0; x < stride; x++) {
+                filtered.push_back(static_cast<uint8_t>(row[x] - (0 < y ? row[x - stride] : 0)));
+            }
+        }
+
+        std::vector<uint8_t> idat = {0x78, 0x01};
+        deflate_runs(filtered, idat);
+        be32(idat, adler32(filtered));
+        chunk("IDAT", idat);
+
+        chunk("IEND", std::vector<uint8_t>());
+        return out;
+    }
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cerrno>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace input {
+    /**
+    * @brief Watches stdin and terminal resizes from a background thread.
+    *
+    * The thread sleeps in poll until a key arrives or SIGWINCH fires, then
+    *  raises a flag. Checking the flags costs no syscall, so a running loop
+    *  only reads input when there is some, and an idle one blocks in wait.
+    */
+    class InputWatcher {
+        public:
+            /**
+            * @brief Get the watcher of this process' stdin.
+            * @return A reference to the shared InputWatcher.
+            */
+            static InputWatcher& instance() {
+                static InputWatcher instance;
+                return instance;
+            }
+
+            InputWatcher (const InputWatcher&) = delete;
+            InputWatcher& operator= (const InputWatcher&) = delete;
+
+            ~InputWatcher () {
+                stopping = true;
+                notify(wake_pipe[1]);
+                {
+                    std::lock_guard<std::mutex> lock (mutex);
+                    changed.notify_all();
+                }
+                watcher.join();
+
+                sigaction(SIGWINCH, &previous_action, nullptr);
+                for (int fd : wake_pipe) close(fd);
+                for (int fd : signal_pipe) close(fd);
+            }
+
+            /**
+            * @brief Whether stdin has input waiting. No syscall involved.
+            */
+            bool has_input () const {return input_ready.load(std::memory_order_acquire);}
+
+            /**
+            * @brief Tell the watcher every waiting input was read.
+            */
+            void consumed () {
+                {
+                    std::lock_guard<std::mutex> lock (mutex);
+                    input_ready.store(false, std::memory_order_release);
+                }
+                notify(wake_pipe[1]);
+            }
+
+            /**
+            * @brief Whether the terminal was resized since the last call.
+            */
+            bool take_resize () {return resized.exchange(false, std::memory_order_acq_rel);}
+
+            /**
+            * @brief Block, without using the CPU, until input or a resize.
+            */
+            void wait () {
+                std::unique_lock<std::mutex> lock (mutex);
+                changed.wait(lock, [this] {
+                    return stopping || input_ready.load() || resized.load();
+                });
+            }
+
+            /**
+            * @brief Block until input or a resize, or until the timeout.
+            * @param seconds Longest time to wait.
+            */
+            void wait_for (const double seconds) {
+                std::unique_lock<std::mutex> lock (mutex);
+                changed.wait_for(lock, std::chrono::duration<double>(seconds), [this] {
+                    return stopping || input_ready.load() || resized.load();
+                });
+            }
+
+        private:
+            InputWatcher () {
+                if (0 != pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK)) wake_pipe[0] = wake_pipe[1] = -1;
+                if (0 != pipe2(signal_pipe, O_CLOEXEC | O_NONBLOCK)) signal_pipe[0] = signal_pipe[1] = -1;
+
+                // Chained, so curses still sees resizes
+                signal_write_fd = signal_pipe[1];
+                struct sigaction action {};
+                action.sa_handler = on_resize;
+                sigemptyset(&action.sa_mask);
+                action.sa_flags = SA_RESTART;
+                sigaction(SIGWINCH, &action, &previous_action);
+                previous_handler = previous_action.sa_handler;
+
+                watcher = std::thread([this] {watch_loop();});
+            }
+
+            std::thread watcher;
+            std::mutex mutex;
+            std::condition_variable changed;
+
+            std::atomic<bool> input_ready {false};
+            std::atomic<bool> resized {false};
+            std::atomic<bool> stopping {false};
+
+            int wake_pipe[2] = {-1, -1};
+            int signal_pipe[2] = {-1, -1};
+            struct sigaction previous_action {};
+
+            static inline volatile sig_atomic_t signal_write_fd = -1;
+            static inline void (*previous_handler)(int) = nullptr;
+
+            static void on_resize (const int signal) {
+                const int saved = errno;
+                notify(signal_write_fd);
+                errno = saved;
+
+                if (SIG_DFL != previous_handler && SIG_IGN != previous_handler && nullptr != previous_handler) {
+                    previous_handler(signal);
+                }
+            }
+
+            static void notify (const int fd) {
+                if (0 > fd) return;
+                const char byte = 1;
+                ssize_t ignored = write(fd, &byte, 1);
+                (void)ignored;
+            }
+
+            static void drain (const int fd) {
+                char sink[64];
+                while (0 < read(fd, sink, sizeof(sink))) {}
+            }
+
+            void watch_loop () {
+                bool stdin_open = true;
+
+                while (!stopping) {
+                    // Stdin stays readable until the input is consumed, so it
+                    //  is only watched while nothing is waiting.
+                    pollfd fds[3] = {
+                        {wake_pipe[0], POLLIN, 0},
+                        {signal_pipe[0], POLLIN, 0},
+                        {(input_ready.load() || !stdin_open) ? -1 : STDIN_FILENO, POLLIN, 0}
+                    };
+
+                    if (0 > poll(fds, 3, -1)) {
+                        if (EINTR == errno) continue;
+                        break;
+                    }
+
+                    if (fds[0].revents) drain(wake_pipe[0]);
+
+                    bool woke = false;
+                    if (fds[1].revents) {
+                        drain(signal_pipe[0]);
+                        resized = true;
+                        woke = true;
+                    }
+
+                    if (fds[2].revents & POLLIN) {
+                        input_ready = true;
+                        woke = true;
+                    } else if (fds[2].revents) {
+                        // Closed stdin would wake the poll forever
+                        stdin_open = false;
+                    }
+
+                    if (woke) {
+                        std::lock_guard<std::mutex> lock (mutex);
+                        changed.notify_all();
+                    }
+                }
+            }
+    };
+}
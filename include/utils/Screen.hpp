@@ -0,0 +1,182 @@
+#pragma once
+
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "utils/Cpu.hpp"
+
+#if defined(CPU_DISPATCH)
+    #include <immintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+
+namespace canvas {
+    /**
+    * @brief What the terminal should show, one glyph and attribute per cell.
+    *
+    * Widgets draw into the front frame. flush compares it with the frame
+    *  last sent, 8 cells (32 bytes) at a time in the widest instruction set
+    *  in use, and only hands out the spans that changed, so the terminal
+    *  gets the visual change and nothing more.
+    */
+    class Screen {
+        public:
+            Screen () {}
+
+            /**
+            * @brief Resize both frames, which forgets what was sent.
+            */
+            void resize (const unsigned screen_width, const unsigned screen_height) {
+                if (screen_width == width && screen_height == height) return;
+
+                width = screen_width;
+                height = screen_height;
+                stride = (screen_width + CHUNK - 1) / CHUNK * CHUNK;
+
+                front.assign(static_cast<size_t>(stride) * height, pack(L' ', 0));
+                back.assign(front.size(), UNKNOWN);
+            }
+
+            /**
+            * @brief Blank the front frame, as the terminal is after a clear.
+            */
+            void clear () {std::fill(front.begin(), front.end(), pack(L' ', 0));}
+
+            /**
+            * @brief Send every cell on the next flush.
+            */
+            void invalidate () {std::fill(back.begin(), back.end(), UNKNOWN);}
+
+            unsigned get_width () const {return width;}
+            unsigned get_height () const {return height;}
+
+            void put (const unsigned x, const unsigned y, const wchar_t glyph, const uint8_t attribute = 0) {
+                if (x < width && y < height) front[static_cast<size_t>(y) * stride + x] = pack(glyph, attribute);
+            }
+
+            void fill (const unsigned x, const unsigned y, const unsigned n, const wchar_t glyph, const uint8_t attribute = 0) {
+                for (unsigned i = 0; i < n; i++) put(x + i, y, glyph, attribute);
+            }
+
+            /**
+            * @brief Draw text, clipped to the screen.
+            */
+            void text (const unsigned x, const unsigned y, const char* s, const uint8_t attribute = 0) {
+                for (unsigned i = 0; '\0' != s[i]; i++) put(x + i, y, static_cast<wchar_t>(s[i]), attribute);
+            }
+
+            void text (const unsigned x, const unsigned y, const wchar_t* s, const uint8_t attribute = 0) {
+                for (unsigned i = 0; L'\0' != s[i]; i++) put(x + i, y, s[i], attribute);
+            }
+
+            /**
+            * @brief Hand out the changed spans and remember them as sent.
+            * @param emit Called as emit(x, y, glyphs, attribute) for each run
+            *  of changed cells sharing an attribute.
+            * @return Amount of cells handed out.
+            */
+            template <typename F>
+            size_t flush (F&& emit) {
+                size_t emitted = 0;
+                std::wstring span;
+
+                const cpu::Isa isa = cpu::level();
+
+                for (unsigned y = 0; y < height; y++) {
+                    uint32_t* f = &front[static_cast<size_t>(y) * stride];
+                    uint32_t* b = &back[static_cast<size_t>(y) * stride];
+
+                    unsigned start = 0;
+                    uint8_t attribute = 0;
+                    bool open = false;
+
+                    auto close = [&](const unsigned end) {
+                        if (!open) return;
+                        open = false;
+                        span.clear();
+                        for (unsigned x = start; x < end; x++) span.push_back(glyph_of(f[x]));
+                        emitted += span.size();
+                        emit(start, y, span, attribute);
+                    };
+
+                    bool changed = false;
+                    for (unsigned c = 0; c < stride; c += CHUNK) {
+                        if (same_chunk(f + c, b + c, isa)) {
+                            close(c);
+                            continue;
+                        }
+
+                        changed = true;
+                        for (unsigned x = c; x < std::min(c + CHUNK, width); x++) {
+                            if (f[x] == b[x]) {
+                                close(x);
+                            } else if (!open || attribute != attribute_of(f[x])) {
+                                close(x);
+                                open = true;
+                                start = x;
+                                attribute = attribute_of(f[x]);
+                            }
+                        }
+                    }
+                    close(width);
+
+                    if (changed) std::memcpy(b, f, stride * sizeof(uint32_t));
+                }
+
+                return emitted;
+            }
+
+        private:
+            static constexpr unsigned CHUNK = 8;
+
+            // Never produced by pack, glyphs stop at 0x10ffff
+            static constexpr uint32_t UNKNOWN = 0xffffffffu;
+
+            unsigned width = 0;
+            unsigned height = 0;
+            unsigned stride = 0;
+
+            std::vector<uint32_t> front;
+            std::vector<uint32_t> back;
+
+            static uint32_t pack (const wchar_t glyph, const uint8_t attribute) {
+                return (static_cast<uint32_t>(glyph) & 0xffffffu) | (static_cast<uint32_t>(attribute) << 24);
+            }
+
+            static wchar_t glyph_of (const uint32_t cell) {return static_cast<wchar_t>(cell & 0xffffffu);}
+            static uint8_t attribute_of (const uint32_t cell) {return static_cast<uint8_t>(cell >> 24);}
+
+            #if defined(CPU_DISPATCH)
+                CPU_TARGET_AVX2 static bool same_chunk_avx2 (const uint32_t* a, const uint32_t* b) {
+                    const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+                    const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+                    return -1 == _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+                }
+            #endif
+
+            static bool same_chunk (const uint32_t* a, const uint32_t* b, [[maybe_unused]] const cpu::Isa isa) {
+                #if defined(CPU_DISPATCH)
+                    if (cpu::Isa::Avx2 <= isa) return same_chunk_avx2(a, b);
+                #endif
+
+                #if defined(__SSE2__)
+                if (cpu::Isa::Sse2 <= isa) {
+                    const __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+                    const __m128i y0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+                    const __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 4));
+                    const __m128i y1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 4));
+                    const __m128i eq = _mm_and_si128(_mm_cmpeq_epi32(x0, y0), _mm_cmpeq_epi32(x1, y1));
+                    return 0xffff == _mm_movemask_epi8(eq);
+                }
+                #endif
+
+                return 0 == std::memcmp(a, b, CHUNK * sizeof(uint32_t));
+            }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,189 @@
+#pragma once
+
+
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+namespace shm {
+    /**
+    * @brief A memory segment shared between processes.
+    *
+    * Plain names ("warms_board") are POSIX shared memory objects, while
+    *  paths ("target/board.mmap") are regular memory-mapped files. The
+    *  process that created the segment unlinks it when done, so processes
+    *  attached to it keep their mapping but nobody new can attach.
+    */
+    class SharedMemory {
+        public:
+            SharedMemory () {}
+
+            /**
+            * @brief Create a segment, failing if one of that name exists.
+            *
+            * An older segment may still be mapped by other processes, so it
+            *  is left alone rather than replaced under them.
+            *
+            * @param name Shared memory name, or file path.
+            * @param bytes Size of the segment.
+            */
+            static SharedMemory create (const std::string& name, const size_t bytes) {
+                SharedMemory s (name);
+
+                const int fd = s.open_fd(O_RDWR | O_CREAT | O_EXCL);
+                if (0 > fd && EEXIST == errno) {
+                    throw std::runtime_error("Shared memory " + s.name + " already exists, remove it if nobody uses it");
+                }
+                if (0 > fd) throw std::runtime_error("Can not create shared memory " + s.name);
+
+                s.owner = true;
+                s.resize_and_map(fd, bytes, true);
+                return s;
+            }
+
+            /**
+            * @brief Create a segment, or attach to it if another process
+            *  already created it, waiting for it to be sized.
+            */
+            static SharedMemory create_or_attach (const std::string& name, const size_t bytes) {
+                SharedMemory s (name);
+
+                int fd = s.open_fd(O_RDWR | O_CREAT | O_EXCL);
+                s.owner = (0 <= fd);
+                if (!s.owner) fd = s.open_fd(O_RDWR);
+                if (0 > fd) throw std::runtime_error("Can not open shared memory " + s.name);
+
+                if (!s.owner) wait_for_size(fd, bytes);
+                s.resize_and_map(fd, bytes, true);
+                return s;
+            }
+
+            /**
+            * @brief Attach to an existing segment, whatever its size.
+            * @param writable Whether this process writes to it too.
+            */
+            static SharedMemory attach (const std::string& name, const bool writable) {
+                SharedMemory s (name);
+
+                const int fd = s.open_fd(writable ? O_RDWR : O_RDONLY);
+                if (0 > fd) throw std::runtime_error("Can not open shared memory " + s.name);
+
+                struct stat info;
+                if (0 != fstat(fd, &info) || 0 >= info.st_size) {
+                    close(fd);
+                    throw std::runtime_error("Shared memory " + s.name + " is empty");
+                }
+
+                s.writable = writable;
+                s.resize_and_map(fd, static_cast<size_t>(info.st_size), false);
+                return s;
+            }
+
+            SharedMemory (const SharedMemory&) = delete;
+            SharedMemory& operator= (const SharedMemory&) = delete;
+
+            SharedMemory (SharedMemory&& other) noexcept {*this = std::move(other);}
+
+            SharedMemory& operator= (SharedMemory&& other) noexcept {
+                if (this == &other) return *this;
+                release();
+
+                name = std::move(other.name);
+                memory = other.memory;
+                bytes = other.bytes;
+                owner = other.owner;
+                writable = other.writable;
+
+                other.memory = nullptr;
+                other.owner = false;
+                return *this;
+            }
+
+            ~SharedMemory () {release();}
+
+            // Leaves unlinking to whoever calls remove, rather than to the
+            //  creator when it lets go
+            void disown () {owner = false;}
+
+            // Nobody new can attach, those attached keep their mapping
+            void remove () const {unlink_name();}
+
+            uint8_t* data () const {return memory;}
+            size_t size () const {return bytes;}
+            bool is_owner () const {return owner;}
+            bool is_valid () const {return nullptr != memory;}
+            const std::string& get_name () const {return name;}
+
+        private:
+            std::string name;
+            uint8_t* memory = nullptr;
+            size_t bytes = 0;
+            bool owner = false;
+            bool writable = true;
+
+            explicit SharedMemory (const std::string& segment_name) {
+                if (segment_name.empty()) throw std::invalid_argument("Shared memory needs a name");
+
+                const bool path = std::string::npos != segment_name.find('/', 1);
+                name = (path || '/' == segment_name.front()) ? segment_name : "/" + segment_name;
+            }
+
+            bool is_file () const {return std::string::npos != name.find('/', 1);}
+
+            int open_fd (const int flags) const {
+                return is_file() ? open(name.c_str(), flags, 0600) : shm_open(name.c_str(), flags, 0600);
+            }
+
+            void resize_and_map (const int fd, const size_t segment_bytes, const bool resize) {
+                if (resize && owner && 0 != ftruncate(fd, static_cast<off_t>(segment_bytes))) {
+                    close(fd);
+                    unlink_name();
+                    throw std::runtime_error("Can not size shared memory " + name);
+                }
+
+                const int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+                void* mapped = mmap(nullptr, segment_bytes, protection, MAP_SHARED, fd, 0);
+                close(fd);
+                if (MAP_FAILED == mapped) {
+                    if (owner) unlink_name();
+                    throw std::runtime_error("Can not map shared memory " + name);
+                }
+
+                memory = static_cast<uint8_t*>(mapped);
+                bytes = segment_bytes;
+            }
+
+            static void wait_for_size (const int fd, const size_t expected) {
+                struct stat info;
+                for (unsigned a = 0; a < 5000; a++) {
+                    if (0 == fstat(fd, &info) && static_cast<size_t>(info.st_size) >= expected) return;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+
+                close(fd);
+                throw std::runtime_error("Shared memory was never sized, or has another size");
+            }
+
+            void unlink_name () const {
+                if (is_file()) unlink(name.c_str());
+                else shm_unlink(name.c_str());
+            }
+
+            void release () {
+                if (nullptr == memory) return;
+
+                munmap(memory, bytes);
+                if (owner) unlink_name();
+                memory = nullptr;
+            }
+    };
+}
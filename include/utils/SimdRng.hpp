@@ -0,0 +1,107 @@
+#pragma once
+
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+#include "utils/Hash.hpp"
+#include "utils/Cpu.hpp"
+
+
+namespace rng {
+    /**
+    * @brief Two lane xorshift128+ generator filling float buffers.
+    *
+    * Both lanes advance together, so the SSE2 path produces 4 floats per
+    *  step. The scalar fallback runs the exact same lanes, so results do
+    *  not depend on the instruction set. Wider sets would need more lanes,
+    *  which would change the stream, so SSE2 is as wide as it goes.
+    */
+    class SimdRng {
+        public:
+            SimdRng () : SimdRng(0) {}
+
+            explicit SimdRng (const uint64_t seed) {
+                for (unsigned lane = 0; lane < 2; lane++) {
+                    s0[lane] = hash::combine(seed, 2 * lane + 1);
+                    s1[lane] = hash::combine(seed, 2 * lane + 2);
+                }
+            }
+
+            /**
+            * @brief Fill a buffer with uniform floats in [0, 1).
+            * @param out Buffer to fill.
+            * @param n Amount of floats.
+            */
+            void fill_uniform (float* out, const size_t n) {
+                size_t i = 0;
+
+                #if defined(__SSE2__)
+                if (cpu::Isa::Sse2 <= cpu::level()) {
+                    __m128i a = _mm_set_epi64x(static_cast<long long>(s0[1]), static_cast<long long>(s0[0]));
+                    __m128i b = _mm_set_epi64x(static_cast<long long>(s1[1]), static_cast<long long>(s1[0]));
+                    const __m128i mantissa = _mm_set1_epi32(0x007fffff);
+                    const __m128i one = _mm_set1_epi32(0x3f800000);
+
+                    for (; i + 4 <= n; i += 4) {
+                        // xorshift128+ on both 64 bit lanes
+                        __m128i x = a;
+                        const __m128i y = b;
+                        a = y;
+                        x = _mm_xor_si128(x, _mm_slli_epi64(x, 23));
+                        b = _mm_xor_si128(_mm_xor_si128(x, y), _mm_xor_si128(_mm_srli_epi64(x, 17), _mm_srli_epi64(y, 26)));
+                        const __m128i r = _mm_add_epi64(b, y);
+
+                        // Each 32 bit half becomes a float in [1, 2)
+                        const __m128i bits = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(r, 9), mantissa), one);
+                        _mm_storeu_ps(out + i, _mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.0f)));
+                    }
+
+                    alignas(16) uint64_t lanes[2];
+                    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), a);
+                    s0[0] = lanes[0]; s0[1] = lanes[1];
+                    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), b);
+                    s1[0] = lanes[0]; s1[1] = lanes[1];
+                }
+                #endif
+
+                while (i < n) {
+                    uint32_t halves[4];
+                    for (unsigned lane = 0; lane < 2; lane++) {
+                        const uint64_t r = step(lane);
+                        halves[2 * lane] = static_cast<uint32_t>(r);
+                        halves[2 * lane + 1] = static_cast<uint32_t>(r >> 32);
+                    }
+
+                    for (unsigned h = 0; h < 4 && i < n; h++, i++) {
+                        const uint32_t bits = ((halves[h] >> 9) & 0x007fffffu) | 0x3f800000u;
+                        float f;
+                        std::memcpy(&f, &bits, sizeof(f));
+                        out[i] = f - 1.0f;
+                    }
+                }
+            }
+
+            // Both lanes, as s0 then s1
+            std::array<uint64_t, 4> get_state () const {return {s0[0], s0[1], s1[0], s1[1]};}
+
+        private:
+            uint64_t s0[2];
+            uint64_t s1[2];
+
+            uint64_t step (const unsigned lane) {
+                uint64_t x = s0[lane];
+                const uint64_t y = s1[lane];
+                s0[lane] = y;
+                x ^= x << 23;
+                s1[lane] = x ^ y ^ (x >> 17) ^ (y >> 26);
+                return s1[lane] + y;
+            }
+    };
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <new>
+
+
+namespace spsc {
+    /**
+    * @brief Lock-free single producer, single consumer ring of fixed size records.
+    *
+    * The ring is a view over memory it does not own, so the same code runs
+    *  over the heap or over a segment shared between processes. Head and
+    *  tail live on their own cache lines.
+    */
+    class SpscRing {
+        public:
+            /**
+            * @brief Bytes of memory a ring needs.
+            * @param capacity Maximum amount of records held at once.
+            * @param record_bytes Size of each record.
+            */
+            static size_t bytes_needed (const uint32_t capacity, const uint32_t record_bytes) {
+                return sizeof(Header) + static_cast<size_t>(capacity) * align(record_bytes);
+            }
+
+            SpscRing () {}
+
+            /**
+            * @brief View a ring over memory.
+            * @param memory At least bytes_needed(capacity, record_bytes), 64 byte aligned.
+            * @param initialize Whether to build a new empty ring there, or attach to one.
+            */
+            SpscRing (void* memory, const bool initialize, const uint32_t capacity, const uint32_t record_bytes) {
+                header = static_cast<Header*>(memory);
+                data = static_cast<uint8_t*>(memory) + sizeof(Header);
+
+                if (initialize) {
+                    new (header) Header();
+                    header->capacity = capacity;
+                    header->record_bytes = record_bytes;
+                }
+            }
+
+            /**
+            * @brief Copy a record in, from the producer side.
+            * @return False when the ring is full and the record was dropped.
+            */
+            bool push (const void* record) {
+                const uint64_t tail = header->tail.load(std::memory_order_relaxed);
+                const uint64_t head = header->head.load(std::memory_order_acquire);
+                if (header->capacity <= tail - head) return false;
+
+                std::memcpy(slot(tail), record, header->record_bytes);
+                header->tail.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+
+            /**
+            * @brief Copy the oldest record out, from the consumer side.
+            * @return False when the ring is empty.
+            */
+            bool pop (void* record) {
+                const uint64_t head = header->head.load(std::memory_order_relaxed);
+                const uint64_t tail = header->tail.load(std::memory_order_acquire);
+                if (head == tail) return false;
+
+                std::memcpy(record, slot(head), header->record_bytes);
+                header->head.store(head + 1, std::memory_order_release);
+                return true;
+            }
+
+            bool is_valid () const {return nullptr != header;}
+            uint32_t get_record_bytes () const {return header->record_bytes;}
+
+        private:
+            static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared rings need lock-free atomics");
+
+            struct Header {
+                alignas(64) std::atomic<uint64_t> head {0};
+                alignas(64) std::atomic<uint64_t> tail {0};
+                alignas(64) uint32_t capacity = 0;
+                uint32_t record_bytes = 0;
+            };
+
+            Header* header = nullptr;
+            uint8_t* data = nullptr;
+
+            static size_t align (const size_t bytes) {return (bytes + 63) & ~size_t(63);}
+
+            uint8_t* slot (const uint64_t position) const {
+                return data + (position % header->capacity) * align(header->record_bytes);
+            }
+    };
+}
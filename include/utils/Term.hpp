@@ -109,7 +109,27 @@ namespace term {
             /**
             * @brief Refresh the terminal screen.
             */
-            void refresh () const {refresh();}
+            void refresh () const {
+                #ifdef NO_CURSES
+                    return;
+                #endif
+
+                ::refresh();
+            }
+
+            /**
+            * @brief Pick up the new size of a resized terminal, clearing it.
+            */
+            void resize () {
+                #ifdef NO_CURSES
+                    return;
+                #endif
+
+                endwin();
+                ::refresh();
+                clear();
+                getmaxyx(stdscr, height, width);
+            }
 
             /**
             * @brief Get a character from the terminal input.
@@ -0,0 +1,172 @@
+#pragma once
+
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+
+namespace pool {
+    /**
+    * @brief A fixed size pool of worker threads.
+    */
+    class ThreadPool {
+        public:
+            /**
+            * @brief Get the shared pool, sized to the hardware concurrency.
+            * @return A reference to the shared ThreadPool.
+            */
+            static ThreadPool& instance() {
+                static ThreadPool instance(std::thread::hardware_concurrency());
+                return instance;
+            }
+
+            /**
+            * @brief Start a pool with the given amount of workers.
+            * @param worker_count Amount of worker threads. The thread calling
+            *   parallel_for also works, so 0 workers runs everything inline.
+            */
+            explicit ThreadPool (const unsigned worker_count) : active(worker_count) {
+                for (unsigned i = 0; i < worker_count; i++) {
+                    workers.emplace_back([this] {work_loop();});
+                }
+            }
+
+            ThreadPool (const ThreadPool&) = delete;
+            ThreadPool& operator= (const ThreadPool&) = delete;
+
+            ~ThreadPool () {
+                {
+                    std::lock_guard<std::mutex> lock (mutex);
+                    stopping = true;
+                }
+
+                wake.notify_all();
+                for (std::thread& w : workers) w.join();
+            }
+
+            /**
+            * @brief Get the amount of worker threads.
+            * @return The amount of worker threads in the pool.
+            */
+            unsigned get_size () const {return static_cast<unsigned>(workers.size());}
+
+            /**
+            * @brief Limit how many workers parallel_for hands chunks to.
+            * @param worker_count Amount of workers to use, the rest sleep.
+            */
+            void set_active (const unsigned worker_count) {
+                active.store(std::min(worker_count, get_size()));
+            }
+
+            /**
+            * @brief Get the amount of workers parallel_for uses.
+            * @return The amount of active workers.
+            */
+            unsigned get_active () const {return active.load();}
+
+            /**
+            * @brief Queue a task to run on some worker.
+            * @param task The task to run.
+            */
+            void submit (std::function<void()> task) {
+                {
+                    std::lock_guard<std::mutex> lock (mutex);
+                    tasks.push_back(std::move(task));
+                }
+
+                wake.notify_one();
+            }
+
+            /**
+            * @brief Run fn over [begin, end) split in chunks of grain and wait.
+            * @param begin First index of the range.
+            * @param end One past the last index of the range.
+            * @param grain Size of each chunk handed to a thread.
+            * @param fn Callable taking (chunk_begin, chunk_end).
+            *
+            * The calling thread takes chunks too, so calling this from inside
+            *  a worker can not deadlock.
+            */
+            template <typename F>
+            void parallel_for (
+                const size_t begin,
+                const size_t end,
+                const size_t grain,
+                F&& fn
+            ) {
+                if (end <= begin) return;
+
+                const size_t step = std::max<size_t>(1, grain);
+                const size_t chunks = (end - begin + step - 1) / step;
+
+                const size_t usable = std::min<size_t>(active.load(std::memory_order_relaxed), workers.size());
+                if (1 >= chunks || 0 == usable) {
+                    fn(begin, end);
+                    return;
+                }
+
+                std::shared_ptr<Job> job = std::make_shared<Job>();
+
+                auto run = [job, chunks, begin, end, step, &fn] {
+                    size_t c;
+                    while ((c = job->next.fetch_add(1)) < chunks) {
+                        const size_t b = begin + c * step;
+                        fn(b, std::min(end, b + step));
+
+                        if (chunks == job->done.fetch_add(1) + 1) {
+                            std::lock_guard<std::mutex> lock (job->mutex);
+                            job->finished.notify_all();
+                        }
+                    }
+                };
+
+                const size_t helpers = std::min<size_t>(chunks - 1, usable);
+                for (size_t i = 0; i < helpers; i++) submit(run);
+
+                run();
+
+                std::unique_lock<std::mutex> lock (job->mutex);
+                job->finished.wait(lock, [&] {return chunks == job->done.load();});
+            }
+
+        private:
+            struct Job {
+                std::atomic<size_t> next {0};
+                std::atomic<size_t> done {0};
+                std::mutex mutex;
+                std::condition_variable finished;
+            };
+
+            std::vector<std::thread> workers;
+            std::atomic<unsigned> active;
+            std::deque<std::function<void()>> tasks;
+            std::mutex mutex;
+            std::condition_variable wake;
+            bool stopping = false;
+
+            void work_loop () {
+                while (true) {
+                    std::function<void()> task;
+
+                    {
+                        std::unique_lock<std::mutex> lock (mutex);
+                        wake.wait(lock, [this] {return stopping || !tasks.empty();});
+
+                        if (tasks.empty()) return;
+
+                        task = std::move(tasks.front());
+                        tasks.pop_front();
+                    }
+
+                    task();
+                }
+            }
+    };
+}
@@ -5,7 +5,8 @@
 #include <thread>
 #include <cstdint>
 #include <string>
-#include <iomanip> 
+#include <cstdio>
+#include <algorithm>
 
 
 namespace timer {
@@ -20,7 +21,7 @@ namespace timer {
             }
 
             double delta_time () const {
-                duration_t duration = old_time - new_time;
+                duration_t duration = new_time - old_time;
                 return duration.count();
             }
 
@@ -56,28 +57,45 @@ namespace timer {
             }
 
             std::string to_str() const {
-                // Calculate the FPS
-                double fps = 1.0 / delta_time();
-                
-                // Set the precision to 2 decimal places
-                std::stringstream ss;
-                ss << std::fixed << std::setprecision(2) << fps;
-                std::string fps_str = ss.str();
-
-                std::stringstream ss1;
-                ss1 << std::fixed << std::setprecision(1) << up_time();
-                std::string up_time_str = ss1.str();
-
-                // Format the timer data as a string
-                return (
-                    "<delta-time: " + std::to_string(delta_time()) +
-                    ", mean-time: " + std::to_string(mean_time()) +
-                    ", up-time: " + up_time_str +
-                    ", fps: " + fps_str + // Use the formatted FPS string
-                    ", frame-amount: " + std::to_string(frame_count) + ">"
+                return format(delta_time(), mean_time(), up_time(), frame_count);
+            }
+
+            // Formats into a caller buffer, so a frame allocates nothing
+            size_t to_chars (char* out, const size_t size) const {
+                return format_to(out, size, delta_time(), mean_time(), up_time(), frame_count);
+            }
+
+            // Timer data measured elsewhere, formatted like to_str
+            static std::string format (
+                const double delta,
+                const double mean,
+                const double up,
+                const uint64_t frames
+            ) {
+                char text[TEXT_SIZE];
+                format_to(text, sizeof(text), delta, mean, up, frames);
+                return std::string(text);
+            }
+
+            static size_t format_to (
+                char* out,
+                const size_t size,
+                const double delta,
+                const double mean,
+                const double up,
+                const uint64_t frames
+            ) {
+                const int n = std::snprintf(
+                    out, size,
+                    "<delta-time: %f, mean-time: %f, up-time: %.1f, fps: %.2f, frame-amount: %llu>",
+                    delta, mean, up, 1.0 / delta, static_cast<unsigned long long>(frames)
                 );
+                return 0 > n ? 0 : std::min(static_cast<size_t>(n), size - 1);
             }
 
+            // Large enough for any formatted timer
+            static constexpr size_t TEXT_SIZE = 160;
+
         private:
             std::chrono::high_resolution_clock::time_point start_time;
             std::chrono::high_resolution_clock::time_point old_time;
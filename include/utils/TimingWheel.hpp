@@ -0,0 +1,226 @@
+#pragma once
+
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace wheel {
+    /**
+    * @brief Events due at a given tick, in a hierarchical timing wheel.
+    *
+    * Level L holds the events whose tick differs from the current one only
+    *  in the L-th group of SLOT_BITS bits, one slot per value of that group.
+    *  Each time a group wraps, the next level's slot is spread over the
+    *  levels below. Events further than every level go to an overflow list.
+    *  Scheduling, cancelling and firing are O(1), and events live in pooled
+    *  nodes linked by index, so a busy wheel does not allocate.
+    */
+    template <typename T, unsigned LEVELS = 4, unsigned SLOT_BITS = 6>
+    class TimingWheel {
+        public:
+            static constexpr unsigned SLOTS = 1u << SLOT_BITS;
+
+            class Handle {
+                public:
+                    uint32_t index = NONE;
+                    uint32_t version = 0;
+
+                    bool is_valid () const {return NONE != index;}
+            };
+
+            TimingWheel () {heads.fill(NONE);}
+            TimingWheel (const uint64_t start) : now(start) {heads.fill(NONE);}
+
+            /**
+            * @brief Schedule a payload.
+            * @param at Tick it fires at. Ticks already reached fire on the
+            *  next one.
+            */
+            Handle schedule (uint64_t at, const T& payload) {
+                if (at <= now) at = now + 1;
+
+                const uint32_t i = acquire();
+                nodes[i].payload = payload;
+                nodes[i].at = at;
+                place(i);
+
+                count += 1;
+                return Handle {i, nodes[i].version};
+            }
+
+            /**
+            * @brief Remove a scheduled event.
+            * @return Whether it was still waiting.
+            */
+            bool cancel (const Handle handle) {
+                if (!handle.is_valid() || handle.index >= nodes.size()) return false;
+
+                Node& n = nodes[handle.index];
+                if (n.version != handle.version || NOWHERE == n.list || CANCELLED == n.list) return false;
+
+                // Due this very tick, in the chain being fired: it is skipped
+                //  and released when the chain gets to it
+                if (FIRING == n.list) {
+                    n.list = CANCELLED;
+                    count -= 1;
+                    return true;
+                }
+
+                unlink(handle.index);
+                release(handle.index);
+                count -= 1;
+                return true;
+            }
+
+            /**
+            * @brief Step the wheel up to a tick, firing what comes due.
+            * @param fire Called as fire(payload, tick), in tick order. It may
+            *  schedule events, and cancel any other, including one due at
+            *  the same tick, which then does not fire.
+            */
+            template <typename F>
+            void advance (const uint64_t to, F&& fire) {
+                while (now < to) {
+                    now += 1;
+                    cascade();
+
+                    const uint32_t first = detach(slot_index(0, now));
+                    for (uint32_t i = first; NONE != i; i = nodes[i].next) nodes[i].list = FIRING;
+
+                    uint32_t i = first;
+                    while (NONE != i) {
+                        const uint32_t next = nodes[i].next;
+                        const bool cancelled = CANCELLED == nodes[i].list;
+                        const T payload = nodes[i].payload;
+
+                        nodes[i].list = NOWHERE;
+                        release(i);
+
+                        if (!cancelled) {
+                            count -= 1;
+                            fire(payload, now);
+                        }
+                        i = next;
+                    }
+                }
+            }
+
+            // Calls fn(payload, tick) for every waiting event, in no given order
+            template <typename F>
+            void for_each (F&& fn) const {
+                for (const Node& n : nodes) {
+                    if (n.list <= OVERFLOW_LIST) fn(n.payload, n.at);
+                }
+            }
+
+            uint64_t get_now () const {return now;}
+            size_t size () const {return count;}
+            bool empty () const {return 0 == count;}
+
+        private:
+            static constexpr uint32_t NONE = 0xffffffffu;
+            static constexpr uint32_t NOWHERE = 0xffffffffu;
+
+            // Lists of the nodes being fired, and of those cancelled meanwhile
+            static constexpr uint32_t FIRING = NOWHERE - 1;
+            static constexpr uint32_t CANCELLED = NOWHERE - 2;
+            static constexpr uint32_t OVERFLOW_LIST = LEVELS * SLOTS;
+            static constexpr uint64_t MASK = SLOTS - 1;
+
+            struct Node {
+                T payload {};
+                uint64_t at = 0;
+                uint32_t prev = NONE;
+                uint32_t next = NONE;
+                uint32_t list = NOWHERE;
+                uint32_t version = 0;
+            };
+
+            uint64_t now = 0;
+            size_t count = 0;
+
+            std::vector<Node> nodes;
+            uint32_t free_head = NONE;
+            std::array<uint32_t, LEVELS * SLOTS + 1> heads;
+
+            static uint32_t slot_index (const unsigned level, const uint64_t tick) {
+                return level * SLOTS + static_cast<uint32_t>((tick >> (level * SLOT_BITS)) & MASK);
+            }
+
+            uint32_t acquire () {
+                if (NONE == free_head) {
+                    nodes.emplace_back();
+                    return static_cast<uint32_t>(nodes.size() - 1);
+                }
+
+                const uint32_t i = free_head;
+                free_head = nodes[i].next;
+                return i;
+            }
+
+            void release (const uint32_t i) {
+                nodes[i].version += 1;
+                nodes[i].payload = T();
+                nodes[i].prev = NONE;
+                nodes[i].next = free_head;
+                free_head = i;
+            }
+
+            // The lowest level whose slot range still holds the tick
+            void place (const uint32_t i) {
+                const uint64_t differs = nodes[i].at ^ now;
+
+                uint32_t list = OVERFLOW_LIST;
+                for (unsigned level = 0; level < LEVELS; level++) {
+                    if (0 == (differs >> ((level + 1) * SLOT_BITS))) {
+                        list = slot_index(level, nodes[i].at);
+                        break;
+                    }
+                }
+
+                Node& n = nodes[i];
+                n.list = list;
+                n.prev = NONE;
+                n.next = heads[list];
+                if (NONE != n.next) nodes[n.next].prev = i;
+                heads[list] = i;
+            }
+
+            void unlink (const uint32_t i) {
+                Node& n = nodes[i];
+                if (NONE != n.prev) nodes[n.prev].next = n.next;
+                else heads[n.list] = n.next;
+                if (NONE != n.next) nodes[n.next].prev = n.prev;
+                n.list = NOWHERE;
+            }
+
+            uint32_t detach (const uint32_t list) {
+                const uint32_t first = heads[list];
+                heads[list] = NONE;
+                return first;
+            }
+
+            // Spreads the slots reached by the new tick over lower levels,
+            //  highest level first since it feeds the others
+            void cascade () {
+                if (0 == (now & ((uint64_t(1) << (LEVELS * SLOT_BITS)) - 1))) respread(OVERFLOW_LIST);
+
+                for (unsigned level = LEVELS - 1; 0 < level; level--) {
+                    if (0 != (now & ((uint64_t(1) << (level * SLOT_BITS)) - 1))) continue;
+                    respread(slot_index(level, now));
+                }
+            }
+
+            void respread (const uint32_t list) {
+                uint32_t i = detach(list);
+                while (NONE != i) {
+                    const uint32_t next = nodes[i].next;
+                    place(i);
+                    i = next;
+                }
+            }
+    };
+}
\ No newline at end of file
@@ -1,8 +1,125 @@
+#include <cstring>
+#include <iostream>
+
 #include "Sim.hpp"
+#include "Sweep.hpp"
+#include "Island.hpp"
+#include "Viewer.hpp"
+
+int main (int argc, char** argv) {
+    // Headless parameter sweep: "myapp sweep --seeds 1..100 ..."
+    if (1 < argc && 0 == std::strcmp(argv[1], "sweep")) {
+        try {
+            sweep::Sweep parameter_sweep (sweep::SweepParams::from_args(argc - 2, argv + 2));
+            return parameter_sweep.run();
+        } catch (const std::exception& e) {
+            std::cerr << "[sweep] " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // One island of a multi-process experiment: "myapp island --id 0 ..."
+    if (1 < argc && 0 == std::strcmp(argv[1], "island")) {
+        try {
+            island::Island dish (island::IslandParams::from_args(argc - 2, argv + 2));
+            return dish.run();
+        } catch (const std::exception& e) {
+            std::cerr << "[island] " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Queries a lineage file: "myapp lineage lineage.bin ancestry 1234"
+    if (1 < argc && 0 == std::strcmp(argv[1], "lineage")) {
+        try {
+            return lineage::query(argc - 2, argv + 2);
+        } catch (const std::exception& e) {
+            std::cerr << "[lineage] " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Inspects checkpoints: "myapp checkpoint target/checkpoints/*.bin"
+    if (1 < argc && 0 == std::strcmp(argv[1], "checkpoint")) {
+        try {
+            return checkpoint::query(argc - 2, argv + 2);
+        } catch (const std::exception& e) {
+            std::cerr << "[checkpoint] " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Renders a board another process publishes: "myapp view board0", or
+    //  streams: "myapp view tcp:7000"
+    if (2 < argc && 0 == std::strcmp(argv[1], "view")) {
+        try {
+            const std::string source = argv[2];
+            if (0 == source.rfind("tcp:", 0) || 0 == source.rfind("unix:", 0)) {
+                viewer::StreamViewer board_viewer (source);
+                return board_viewer.run();
+            }
+
+            viewer::Viewer board_viewer (source);
+            return board_viewer.run();
+        } catch (const std::exception& e) {
+            std::cerr << "[view] " << e.what() << std::endl;
+            return 1;
+        }
+    }
 
-int main () {
     uint64_t seed = 1029384756;
-    sim::Sim simulation (seed);
+
+    // "--dishes 4" runs several dishes as islands trading genomes (with
+    //  --topology, --interval and --migrants), and "--powersave-fps 2"
+    //  (with --powersave-period and --powersave-slice) sets how often the
+    //  unwatched ones step in powersave mode. "--publish board0" lets
+    //  viewers attach to this sim through shared memory, "--stream
+    //  tcp:7000" through a socket. "--export DIR" (with --export-every,
+    //  --export-format and --export-block) writes frames.
+    //  "--isa sse2" runs narrower kernels than the cpu supports.
+    //  "--checkpoint DIR" (with --checkpoint-every, --checkpoint-keep and
+    //  --checkpoint-keep-every) saves every dish in the background.
+    exporter::ExportParams frames;
+    bool export_frames = false;
+    checkpoint::CheckpointParams checkpoints;
+    bool save_checkpoints = false;
+    unsigned dishes = 1;
+    archipelago::MigrationParams migration;
+    sim::PowersaveParams powersave;
+    std::string publish_name;
+    std::string stream_address;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string flag = argv[i];
+        const std::string value = argv[i + 1];
+
+        if ("--publish" == flag) publish_name = value;
+        else if ("--stream" == flag) stream_address = value;
+        else if ("--dishes" == flag) dishes = std::max(1u, static_cast<unsigned>(std::stoul(value)));
+        else if ("--topology" == flag) migration.topology = archipelago::MigrationParams::parse_topology(value);
+        else if ("--interval" == flag) migration.interval = std::stoull(value);
+        else if ("--migrants" == flag) migration.migrants = static_cast<unsigned>(std::stoul(value));
+        else if ("--powersave-fps" == flag) powersave.target_fps = std::stod(value);
+        else if ("--powersave-period" == flag) powersave.period = static_cast<unsigned>(std::stoul(value));
+        else if ("--powersave-slice" == flag) powersave.slice = std::stod(value);
+        else if ("--export" == flag) {frames.directory = value; export_frames = true;}
+        else if ("--export-every" == flag) frames.every = std::stoull(value);
+        else if ("--export-format" == flag) frames.format = exporter::ExportParams::parse_format(value);
+        else if ("--export-block" == flag) frames.block = static_cast<unsigned>(std::stoul(value));
+        else if ("--checkpoint" == flag) {checkpoints.directory = value; save_checkpoints = true;}
+        else if ("--checkpoint-every" == flag) checkpoints.every = std::stoull(value);
+        else if ("--checkpoint-keep" == flag) checkpoints.keep_last = static_cast<unsigned>(std::stoul(value));
+        else if ("--checkpoint-keep-every" == flag) checkpoints.keep_every = static_cast<unsigned>(std::stoul(value));
+        else if ("--isa" == flag) cpu::use(cpu::parse_isa(value));
+    }
+
+    sim::Sim simulation (seed, dishes, migration);
+    simulation.configure_powersave(powersave);
+    if (!publish_name.empty()) simulation.publish(publish_name);
+    if (!stream_address.empty()) simulation.stream(stream_address);
+    if (export_frames) simulation.export_frames(frames);
+    if (save_checkpoints) simulation.checkpoint(checkpoints);
+
     simulation.run();
 
     return 0;